@@ -27,10 +27,17 @@ public:
   array3d_t() : data(nullptr), size(0) {}
   array3d_t(std::size_t size_, uint8_t init_val = MAX_E & 0xFF)
       : data(new T[size_ * size_ * K]), size(size_) {
-    memset(data, init_val, sizeof(data[0]) * size_ * size_ * K);
+    Fill(init_val);
   }
   ~array3d_t() { delete[] data; }
 
+  void Fill(uint8_t init_val = MAX_E & 0xFF) {
+    memset(data, init_val, sizeof(data[0]) * size * size * K);
+  }
+  std::size_t Size() const { return size; }
+  T* Data() { return data; }
+  const T* Data() const { return data; }
+
   array3d_t(const array3d_t&) = delete;
   array3d_t& operator=(const array3d_t&) = delete;
   array3d_t(array3d_t&& o) : data(nullptr), size(0) { *this = std::move(o); }
@@ -65,9 +72,14 @@ public:
 
   array2d_t(std::size_t size_, uint8_t init_val = MAX_E & 0xFF)
       : data(new T[size_ * K]), size(size_) {
-    memset(data, init_val, sizeof(data[0]) * size_ * K);
+    Fill(init_val);
   }
 
+  void Fill(uint8_t init_val = MAX_E & 0xFF) { memset(data, init_val, sizeof(data[0]) * size * K); }
+  std::size_t Size() const { return size; }
+  T* Data() { return data; }
+  const T* Data() const { return data; }
+
   array2d_t(const array2d_t&) = delete;
   array2d_t& operator=(const array2d_t&) = delete;
   array2d_t(array2d_t&& o) : data(nullptr), size(0) { *this = std::move(o); }
@@ -89,6 +101,25 @@ private:
   T* data;
   std::size_t size;
 };
+
+// Read only view of contiguous elements owned by something else.
+template <typename T>
+struct span_t {
+public:
+  span_t() : data(nullptr), size(0) {}
+  span_t(const T* data_, std::size_t size_) : data(data_), size(size_) {}
+  span_t(const std::vector<T>& v) : data(v.data()), size(v.size()) {}
+
+  std::size_t Size() const { return size; }
+  const T* Data() const { return data; }
+  const T* begin() const { return data; }
+  const T* end() const { return data + size; }
+  const T& operator[](std::size_t idx) const { return data[idx]; }
+
+private:
+  const T* data;
+  std::size_t size;
+};
 }
 
 #endif  // KEKRNA_ARRAY_H
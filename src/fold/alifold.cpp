@@ -0,0 +1,304 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "fold/alifold.h"
+#include <cctype>
+#include <cmath>
+#include <stack>
+#include <tuple>
+#include "array.h"
+
+namespace kekrna {
+namespace fold {
+
+using namespace energy;
+
+namespace {
+
+const uint8_t GAP = 4;
+// Bases and gaps.
+const int NUM_CODES = 5;
+
+enum { ALI_P, ALI_U, ALI_U2, ALI_SIZE };
+
+class AlignmentFolder {
+public:
+  AlignmentFolder(const std::vector<std::string>& rows, const EnergyModel& em_);
+
+  void ComputeTables();
+  alifold_t Traceback();
+
+private:
+  const EnergyModel& em;
+  const int n, L;
+  // Base or GAP of each sequence in each column. Column major, so sums over the sequences read
+  // contiguous memory.
+  std::vector<uint8_t> codes;
+  // Ungapped sequences, and the index of each column in them, or -1 for gaps.
+  std::vector<primary_t> seqs;
+  std::vector<std::vector<int>> idxs;
+  // For each pair of columns, the covariation term, or MAX_E if it can't be a consensus pair, and
+  // the sum of the AU/GU penalties of the sequences which can form it.
+  std::vector<std::vector<energy_t>> covariation;
+  std::vector<std::vector<energy_t>> augu;
+  // Stacking energy indexed by the codes of the four bases, or zero unless both pairs can form.
+  std::vector<energy_t> stack_codes;
+  array3d_t<energy_t, ALI_SIZE> dp;
+  std::vector<energy_t> ext;
+
+  const uint8_t* Column(int i) const { return &codes[i * n]; }
+  bool CanPairIn(int s, int st, int en) const {
+    const auto stc = codes[st * n + s], enc = codes[en * n + s];
+    return stc != GAP && enc != GAP && CanPair(base_t(stc), base_t(enc));
+  }
+  energy_t Branch(int st, int en) const {
+    return dp[st][en][ALI_P] + augu[st][en] + n * em.multiloop_hack_b;
+  }
+  energy_t HairpinSum(int st, int en) const;
+  energy_t TwoLoopSum(int st, int en, int ist, int ien) const;
+};
+
+AlignmentFolder::AlignmentFolder(const std::vector<std::string>& rows, const EnergyModel& em_)
+    : em(em_), n(int(rows.size())), L(rows.empty() ? 0 : int(rows.front().size())),
+      codes(n * L), seqs(n), idxs(n, std::vector<int>(L, -1)),
+      covariation(L, std::vector<energy_t>(L, MAX_E)), augu(L, std::vector<energy_t>(L, 0)),
+      stack_codes(NUM_CODES * NUM_CODES * NUM_CODES * NUM_CODES, 0), dp(L + 1), ext(L + 1, 0) {
+  verify_expr(n > 0 && L > 0, "cannot fold an empty alignment");
+  for (int s = 0; s < n; ++s) {
+    verify_expr(int(rows[s].size()) == L, "alignment rows differ in length");
+    for (int i = 0; i < L; ++i) {
+      char c = char(toupper(rows[s][i]));
+      if (c == 'T') c = 'U';
+      const auto b = CharToBase(c);
+      codes[i * n + s] = b == -1 ? GAP : uint8_t(b);
+      if (b == -1) continue;
+      idxs[s][i] = int(seqs[s].size());
+      seqs[s].push_back(b);
+    }
+  }
+
+  for (int a = 0; a < 4; ++a)
+    for (int b = 0; b < 4; ++b)
+      for (int c = 0; c < 4; ++c)
+        for (int d = 0; d < 4; ++d)
+          if (CanPair(base_t(a), base_t(d)) && CanPair(base_t(b), base_t(c))) {
+            stack_codes[((a * NUM_CODES + b) * NUM_CODES + c) * NUM_CODES + d] =
+                em.stack[a][b][c][d];
+          }
+
+  for (int st = 0; st < L; ++st) {
+    for (int en = st + HAIRPIN_MIN_SZ + 1; en < L; ++en) {
+      // Count the sequences forming each kind of pair.
+      int counts[4][4] = {};
+      int noncompatible = 0, compatible = 0;
+      for (int s = 0; s < n; ++s) {
+        const auto stc = codes[st * n + s], enc = codes[en * n + s];
+        if (CanPairIn(s, st, en)) {
+          ++counts[stc][enc];
+          ++compatible;
+          augu[st][en] += em.AuGuPenalty(base_t(stc), base_t(enc));
+        } else if (stc != GAP || enc != GAP) {
+          ++noncompatible;
+        }
+      }
+      if (compatible == 0 || 2 * noncompatible > n) continue;
+      // Sum of the Hamming distances between the pairs of each two sequences.
+      int distance = 0;
+      for (int a = 0; a < 16; ++a)
+        for (int b = a + 1; b < 16; ++b)
+          distance += counts[a / 4][a % 4] * counts[b / 4][b % 4] *
+              ((a / 4 != b / 4) + (a % 4 != b % 4));
+      // The bonus averages over the pairs of sequences and the penalty over the sequences, but
+      // the tables sum over the sequences.
+      energy_t bonus = 0;
+      if (n > 1)
+        bonus = energy_t(round(2.0 * ALIGNMENT_COVARIATION_BONUS * distance / (n - 1)));
+      covariation[st][en] = ALIGNMENT_NONCOMPATIBLE_PENALTY * noncompatible - bonus;
+    }
+  }
+  // Like folding, don't allow lonely pairs. This is one pass on purpose, to match the single step
+  // check of ViableFoldingPair: a pair whose only neighbour is removed here stays allowed, just as
+  // folding allows a pair whose neighbour could pair but never does.
+  std::vector<std::pair<int, int>> lonely;
+  for (int st = 0; st < L; ++st) {
+    for (int en = st + HAIRPIN_MIN_SZ + 1; en < L; ++en) {
+      if (covariation[st][en] >= CAP_E) continue;
+      if (en - st - 3 >= HAIRPIN_MIN_SZ && covariation[st + 1][en - 1] < CAP_E) continue;
+      if (st > 0 && en < L - 1 && covariation[st - 1][en + 1] < CAP_E) continue;
+      lonely.emplace_back(st, en);
+    }
+  }
+  for (const auto& pair : lonely)
+    covariation[pair.first][pair.second] = MAX_E;
+}
+
+energy_t AlignmentFolder::HairpinSum(int st, int en) const {
+  energy_t sum = 0;
+  for (int s = 0; s < n; ++s) {
+    if (!CanPairIn(s, st, en)) continue;
+    const int sst = idxs[s][st], sen = idxs[s][en];
+    // Gaps can leave a sequence with too few bases for a hairpin.
+    if (sen - sst - 1 < HAIRPIN_MIN_SZ)
+      sum += em.HairpinInitiation(HAIRPIN_MIN_SZ);
+    else
+      sum += em.Hairpin(seqs[s], sst, sen);
+  }
+  return sum;
+}
+
+energy_t AlignmentFolder::TwoLoopSum(int st, int en, int ist, int ien) const {
+  energy_t sum = 0;
+  if (ist == st + 1 && ien == en - 1) {
+    // Stacks are the most common, and summing them over the sequences vectorises.
+    const uint8_t *stc = Column(st), *istc = Column(ist), *ienc = Column(ien), *enc = Column(en);
+    for (int s = 0; s < n; ++s)
+      sum += stack_codes[((stc[s] * NUM_CODES + istc[s]) * NUM_CODES + ienc[s]) * NUM_CODES +
+          enc[s]];
+    return sum;
+  }
+  for (int s = 0; s < n; ++s) {
+    if (CanPairIn(s, st, en) && CanPairIn(s, ist, ien))
+      sum += em.TwoLoop(seqs[s], idxs[s][st], idxs[s][en], idxs[s][ist], idxs[s][ien]);
+  }
+  return sum;
+}
+
+void AlignmentFolder::ComputeTables() {
+  const auto ml_closing = n * (em.multiloop_hack_a + em.multiloop_hack_b);
+  for (int st = L - 1; st >= 0; --st) {
+    for (int en = st + HAIRPIN_MIN_SZ + 1; en < L; ++en) {
+      if (covariation[st][en] < CAP_E) {
+        auto mfe = HairpinSum(st, en);
+        const int max_inter = std::min(TWOLOOP_MAX_SZ, en - st - HAIRPIN_MIN_SZ - 3);
+        for (int ist = st + 1; ist - st - 1 <= max_inter; ++ist) {
+          for (int ien = en - 1; ien - ist > HAIRPIN_MIN_SZ &&
+               ist - st + en - ien - 2 <= max_inter; --ien) {
+            if (dp[ist][ien][ALI_P] < CAP_E)
+              mfe = std::min(mfe, TwoLoopSum(st, en, ist, ien) + dp[ist][ien][ALI_P]);
+          }
+        }
+        mfe = std::min(mfe, ml_closing + augu[st][en] + dp[st + 1][en - 1][ALI_U2]);
+        mfe += covariation[st][en];
+        if (mfe < CAP_E) dp[st][en][ALI_P] = mfe;
+      }
+
+      // Bases are unpaired for free in multiloops.
+      auto u = dp[st + 1][en][ALI_U], u2 = dp[st + 1][en][ALI_U2];
+      for (int piv = st + HAIRPIN_MIN_SZ + 1; piv <= en; ++piv) {
+        if (dp[st][piv][ALI_P] >= CAP_E) continue;
+        const auto branch = Branch(st, piv);
+        const auto rest = dp[piv + 1][en][ALI_U];
+        u = std::min(u, branch + std::min(rest, 0));
+        u2 = std::min(u2, branch + rest);
+      }
+      if (u < CAP_E) dp[st][en][ALI_U] = u;
+      if (u2 < CAP_E) dp[st][en][ALI_U2] = u2;
+    }
+  }
+
+  ext[L] = 0;
+  for (int st = L - 1; st >= 0; --st) {
+    ext[st] = ext[st + 1];
+    for (int en = st + HAIRPIN_MIN_SZ + 1; en < L; ++en) {
+      if (dp[st][en][ALI_P] < CAP_E)
+        ext[st] = std::min(ext[st], dp[st][en][ALI_P] + augu[st][en] + ext[en + 1]);
+    }
+  }
+}
+
+alifold_t AlignmentFolder::Traceback() {
+  const auto ml_closing = n * (em.multiloop_hack_a + em.multiloop_hack_b);
+  std::vector<int> p(L, -1);
+  energy_t covariation_sum = 0;
+  std::stack<std::tuple<int, int, int>> q;
+  q.emplace(0, -1, -1);
+  while (!q.empty()) {
+    int st, en, a;
+    std::tie(st, en, a) = q.top();
+    q.pop();
+    if (en == -1) {
+      if (st >= L) continue;
+      if (ext[st] == ext[st + 1]) {
+        q.emplace(st + 1, -1, -1);
+        continue;
+      }
+      for (en = st + HAIRPIN_MIN_SZ + 1; en < L; ++en) {
+        if (dp[st][en][ALI_P] < CAP_E &&
+            dp[st][en][ALI_P] + augu[st][en] + ext[en + 1] == ext[st]) {
+          q.emplace(st, en, ALI_P);
+          q.emplace(en + 1, -1, -1);
+          break;
+        }
+      }
+      continue;
+    }
+
+    if (a == ALI_P) {
+      p[st] = en;
+      p[en] = st;
+      covariation_sum += covariation[st][en];
+      const auto mfe = dp[st][en][ALI_P] - covariation[st][en];
+      if (HairpinSum(st, en) == mfe) continue;
+      if (ml_closing + augu[st][en] + dp[st + 1][en - 1][ALI_U2] == mfe) {
+        q.emplace(st + 1, en - 1, ALI_U2);
+        continue;
+      }
+      const int max_inter = std::min(TWOLOOP_MAX_SZ, en - st - HAIRPIN_MIN_SZ - 3);
+      bool found = false;
+      for (int ist = st + 1; ist - st - 1 <= max_inter && !found; ++ist) {
+        for (int ien = en - 1; ien - ist > HAIRPIN_MIN_SZ &&
+             ist - st + en - ien - 2 <= max_inter; --ien) {
+          if (dp[ist][ien][ALI_P] < CAP_E &&
+              TwoLoopSum(st, en, ist, ien) + dp[ist][ien][ALI_P] == mfe) {
+            q.emplace(ist, ien, ALI_P);
+            found = true;
+            break;
+          }
+        }
+      }
+      verify_expr(found, "bug");
+      continue;
+    }
+
+    // ALI_U or ALI_U2.
+    if (st + 1 <= en && dp[st + 1][en][a] == dp[st][en][a]) {
+      q.emplace(st + 1, en, a);
+      continue;
+    }
+    for (int piv = st + HAIRPIN_MIN_SZ + 1; piv <= en; ++piv) {
+      if (dp[st][piv][ALI_P] >= CAP_E) continue;
+      const auto branch = Branch(st, piv);
+      const auto rest = dp[piv + 1][en][ALI_U];
+      if (a == ALI_U && branch == dp[st][en][a]) {
+        q.emplace(st, piv, ALI_P);
+        break;
+      }
+      if (branch + rest == dp[st][en][a]) {
+        q.emplace(st, piv, ALI_P);
+        q.emplace(piv + 1, en, ALI_U);
+        break;
+      }
+    }
+  }
+  return {p, double(ext[0]) / n, double(covariation_sum) / n};
+}
+}
+
+alifold_t Alifold(const std::vector<std::string>& rows, const energy::EnergyModel& em) {
+  AlignmentFolder folder(rows, em);
+  folder.ComputeTables();
+  return folder.Traceback();
+}
+}
+}
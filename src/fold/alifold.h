@@ -0,0 +1,51 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_ALIFOLD_H
+#define KEKRNA_FOLD_ALIFOLD_H
+
+#include <string>
+#include <vector>
+#include "common.h"
+#include "energy/energy_model.h"
+
+namespace kekrna {
+namespace fold {
+
+// Bonus for a consensus pair per unit of the mean Hamming distance between the pairs of each two
+// sequences, so compensatory mutations count for it.
+const energy_t ALIGNMENT_COVARIATION_BONUS = 10;
+// Penalty for a consensus pair times the fraction of sequences which can't form it. Pairs which
+// more than half the sequences can't form aren't allowed.
+const energy_t ALIGNMENT_NONCOMPATIBLE_PENALTY = 10;
+
+struct alifold_t {
+  // Pairs of alignment columns.
+  std::vector<int> p;
+  // The free energy of the consensus structure averaged over the sequences plus the covariation
+  // term, and the covariation term on its own, in the same units as energies.
+  double energy;
+  double covariation;
+};
+
+// Folds the rows of an alignment into a consensus structure, with one DP over the columns instead
+// of one per sequence. Each loop's energy is the sum of its energies in the sequences which can
+// form its pairs, computed on their ungapped bases with the energy model, and each consensus pair
+// gets the covariation term. Bases other than ACGU are treated as gaps. There are no CTDs, only
+// AU/GU penalties on branches.
+alifold_t Alifold(const std::vector<std::string>& rows, const energy::EnergyModel& em);
+}
+}
+
+#endif  // KEKRNA_FOLD_ALIFOLD_H
@@ -159,6 +159,9 @@ void AddAllCombinations(int idx) {
 
 void FoldBruteForceInternal(int idx) {
   if (idx == int(base_pairs.size())) {
+    // All forced pairs must be present. Unpaired constraints are handled by |base_pairs|.
+    for (int i = 0; i < int(gp.size()); ++i)
+      if (gcons.forced[i] != -1 && gp[i] != gcons.forced[i]) return;
     // Small optimisation for case when we're just getting one structure.
     if (max_structures == 1) {
       auto computed = energy::ComputeEnergy({gr, gp}, gem);
@@ -198,9 +201,9 @@ void FoldBruteForceInternal(int idx) {
 }
 }
 
-std::vector<computed_t> FoldBruteForce(
-    const primary_t& r, const energy::EnergyModel& em, int max_structures_) {
-  internal::SetGlobalState(r, em);
+std::vector<computed_t> FoldBruteForce(const primary_t& r, const energy::EnergyModel& em,
+    int max_structures_, const constraints_t& constraints) {
+  internal::SetGlobalState(r, em, constraints);
   best_computeds.clear();
   base_pairs.clear();
   max_structures = max_structures_;
@@ -17,6 +17,7 @@
 
 #include "common.h"
 #include "energy/energy_model.h"
+#include "fold/constraints.h"
 
 namespace kekrna {
 namespace fold {
@@ -25,8 +26,8 @@ namespace internal {
 std::vector<int> GetBranchCounts(const std::vector<int>& p);
 }
 
-std::vector<computed_t> FoldBruteForce(
-    const primary_t& r, const energy::EnergyModel& em, int max_structures_);
+std::vector<computed_t> FoldBruteForce(const primary_t& r, const energy::EnergyModel& em,
+    int max_structures_, const constraints_t& constraints = {});
 }
 }
 #endif  // KEKRNA_BRUTE_FOLD_H
@@ -0,0 +1,361 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "fold/cofold.h"
+#include <algorithm>
+#include <utility>
+
+namespace kekrna {
+namespace fold {
+namespace internal {
+
+using namespace energy;
+
+namespace {
+
+// One way of forming one of the exterior loops next to an intermolecular pair.
+struct ext_choice_t {
+  energy_t energy;
+  Ctd ctd;
+  // The first strand's exterior loop ends before |a_en|, or starts at it for the loop containing
+  // the break. Likewise the second strand's exterior loop starts at |b_st| or ends before it.
+  int a_en, b_st;
+};
+
+class Cofolder {
+public:
+  Cofolder(strand_tables_t& a_, strand_tables_t& b_)
+      : a(a_), b(b_), NA(int(a.r.size())), NB(int(b.r.size())), r(a.r),
+        inter(NA, std::vector<energy_t>(NB, MAX_E)),
+        ml_unpaired(NA, std::vector<energy_t>(NB, MAX_E)),
+        ml_branched(NA, std::vector<energy_t>(NB, MAX_E)) {
+    r.insert(r.end(), b.r.begin(), b.r.end());
+  }
+
+  void ComputeTables();
+  cofold_t Traceback();
+
+private:
+  strand_tables_t& a;
+  strand_tables_t& b;
+  const int NA, NB;
+  primary_t r;
+  // |inter[i][k]| is the energy of the intermolecular pair of base |i| of the first strand with
+  // base |k| of the second, including everything inside it.
+  std::vector<std::vector<energy_t>> inter;
+  // Intermolecular multiloops are split at their inner intermolecular branch. |ml_unpaired[i][k]|
+  // is the best branch starting at |i| followed by only unpaired bases of the second strand
+  // before |k|, and |ml_branched[i][k]| is the same but followed by at least one intramolecular
+  // branch.
+  std::vector<std::vector<energy_t>> ml_unpaired;
+  std::vector<std::vector<energy_t>> ml_branched;
+  // Where the structure gets traced back to.
+  std::vector<int> p;
+  std::vector<Ctd> ctds;
+
+  // At least one intramolecular branch in bases [|st|, |en|] of |s|.
+  static energy_t Branches(const strand_tables_t& s, int st, int en) {
+    return st <= en ? s.dp[st][en][DP_U] : MAX_E;
+  }
+
+  energy_t Branch(int i, int k) const {
+    return inter[i][k] + gem.AuGuPenalty(r[i], r[NA + k]) + gem.multiloop_hack_b;
+  }
+
+  // Calls |fn| with each way of forming the exterior loop containing the break inside the pair
+  // of |i| and |k|.
+  template <typename F>
+  void ForEachBreakLoop(int i, int k, F fn) const {
+    const auto ib = r[i], kb = r[NA + k];
+    const auto base = gem.AuGuPenalty(ib, kb);
+    fn(ext_choice_t{base + a.ext[i + 1][EXT] + b.prefix_ext[k], CTD_UNUSED, i + 1, k});
+    if (i + 1 < NA) {
+      fn(ext_choice_t{base + gem.dangle3[ib][r[i + 1]][kb] + a.ext[i + 2][EXT] + b.prefix_ext[k],
+          CTD_3_DANGLE, i + 2, k});
+    }
+    if (k > 0) {
+      fn(ext_choice_t{base + gem.dangle5[ib][r[NA + k - 1]][kb] + a.ext[i + 1][EXT] +
+              b.prefix_ext[k - 1], CTD_5_DANGLE, i + 1, k - 1});
+    }
+    if (i + 1 < NA && k > 0) {
+      fn(ext_choice_t{base + gem.terminal[ib][r[i + 1]][r[NA + k - 1]][kb] + a.ext[i + 2][EXT] +
+              b.prefix_ext[k - 1], CTD_MISMATCH, i + 2, k - 1});
+    }
+  }
+
+  // Calls |fn| with each way of forming the exterior loop containing the ends around the pair of
+  // |i| and |k|, including the pair and the intermolecular initiation.
+  template <typename F>
+  void ForEachOuterLoop(int i, int k, F fn) const {
+    const auto ib = r[i], kb = r[NA + k];
+    const auto base = inter[i][k] + gem.AuGuPenalty(ib, kb) + INTERMOLECULAR_INIT;
+    fn(ext_choice_t{base + a.prefix_ext[i] + b.ext[k + 1][EXT], CTD_UNUSED, i, k + 1});
+    if (i > 0) {
+      fn(ext_choice_t{base + gem.dangle5[kb][r[i - 1]][ib] + a.prefix_ext[i - 1] +
+              b.ext[k + 1][EXT], CTD_5_DANGLE, i - 1, k + 1});
+    }
+    if (k + 1 < NB) {
+      fn(ext_choice_t{base + gem.dangle3[kb][r[NA + k + 1]][ib] + a.prefix_ext[i] +
+              b.ext[k + 2][EXT], CTD_3_DANGLE, i, k + 2});
+    }
+    if (i > 0 && k + 1 < NB) {
+      fn(ext_choice_t{base + gem.terminal[kb][r[NA + k + 1]][r[i - 1]][ib] +
+              a.prefix_ext[i - 1] + b.ext[k + 2][EXT], CTD_MISMATCH, i - 1, k + 2});
+    }
+  }
+
+  void TracebackInter(int i, int k, std::vector<index_t>& a_idxs, std::vector<index_t>& b_idxs);
+  // Traces back the exterior loop of |s| over bases [0, |en|) into |idxs|, with the CTDs going
+  // into |ctds| at |offset|.
+  void TracebackPrefix(const strand_tables_t& s, int en, int offset, std::vector<index_t>& idxs);
+  // Traces back |idxs| in the tables of |s| into the structure at |offset|.
+  void TracebackStrand(strand_tables_t& s, const std::vector<index_t>& idxs, int offset);
+};
+
+void Cofolder::ComputeTables() {
+  const auto ml_closing = gem.multiloop_hack_a + gem.multiloop_hack_b;
+  for (int i = NA - 1; i >= 0; --i) {
+    for (int k = 0; k < NB; ++k) {
+      const int j = NA + k;
+      if (!CanPair(r[i], r[j])) continue;
+      energy_t mfe = MAX_E;
+      ForEachBreakLoop(i, k, [&mfe](const ext_choice_t& c) { mfe = std::min(mfe, c.energy); });
+      // Two loops, which don't contain the break since the inner pair is also intermolecular.
+      for (int ist = i + 1; ist < NA && ist - i - 1 <= TWOLOOP_MAX_SZ; ++ist) {
+        for (int ik = k - 1; ik >= 0 && ist - i + k - ik - 2 <= TWOLOOP_MAX_SZ; --ik) {
+          if (inter[ist][ik] < CAP_E)
+            mfe = std::min(mfe, gem.TwoLoop(r, i, j, ist, NA + ik) + inter[ist][ik]);
+        }
+      }
+      // Multiloops, with the inner intermolecular branch at |ist|.
+      const auto ml_base = ml_closing + gem.AuGuPenalty(r[i], r[j]);
+      for (int ist = i + 1; ist < NA; ++ist) {
+        mfe = std::min(mfe, ml_base + ml_branched[ist][k]);
+        mfe = std::min(mfe, ml_base + Branches(a, i + 1, ist - 1) +
+                std::min(ml_unpaired[ist][k], ml_branched[ist][k]));
+      }
+      if (mfe < CAP_E) inter[i][k] = mfe;
+    }
+
+    // Row |i| is done, so it can be used as the inner branch of multiloops.
+    for (int k = 1; k < NB; ++k) {
+      ml_unpaired[i][k] = ml_unpaired[i][k - 1];
+      if (inter[i][k - 1] < CAP_E)
+        ml_unpaired[i][k] = std::min(ml_unpaired[i][k], Branch(i, k - 1));
+      for (int ik = 0; ik < k - 1; ++ik) {
+        if (inter[i][ik] < CAP_E) {
+          ml_branched[i][k] =
+              std::min(ml_branched[i][k], Branch(i, ik) + Branches(b, ik + 1, k - 1));
+        }
+      }
+    }
+  }
+}
+
+void Cofolder::TracebackInter(
+    int i, int k, std::vector<index_t>& a_idxs, std::vector<index_t>& b_idxs) {
+  const auto ml_closing = gem.multiloop_hack_a + gem.multiloop_hack_b;
+  while (true) {
+    const int j = NA + k;
+    p[i] = j;
+    p[j] = i;
+    const auto mfe = inter[i][k];
+
+    bool found = false;
+    ForEachBreakLoop(i, k, [&](const ext_choice_t& c) {
+      if (found || c.energy != mfe) return;
+      found = true;
+      ctds[j] = c.ctd;
+      a_idxs.emplace_back(c.a_en, -1, EXT);
+      TracebackPrefix(b, c.b_st, NA, b_idxs);
+    });
+    if (found) return;
+
+    for (int ist = i + 1; ist < NA && ist - i - 1 <= TWOLOOP_MAX_SZ && !found; ++ist) {
+      for (int ik = k - 1; ik >= 0 && ist - i + k - ik - 2 <= TWOLOOP_MAX_SZ; --ik) {
+        if (inter[ist][ik] < CAP_E &&
+            gem.TwoLoop(r, i, j, ist, NA + ik) + inter[ist][ik] == mfe) {
+          i = ist;
+          k = ik;
+          found = true;
+          break;
+        }
+      }
+    }
+    if (found) continue;
+
+    // Multiloop. Find the inner intermolecular branch, then where its right side ends.
+    ctds[j] = CTD_UNUSED;
+    const auto ml_base = ml_closing + gem.AuGuPenalty(r[i], r[j]);
+    int ist = i + 1;
+    bool branched = false;
+    for (; ist < NA; ++ist) {
+      if (ml_base + ml_branched[ist][k] == mfe) {
+        branched = true;
+        break;
+      }
+      const auto left = ml_base + Branches(a, i + 1, ist - 1);
+      if (left + ml_unpaired[ist][k] == mfe || left + ml_branched[ist][k] == mfe) {
+        a_idxs.emplace_back(i + 1, ist - 1, DP_U);
+        branched = left + ml_unpaired[ist][k] != mfe;
+        break;
+      }
+    }
+    verify_expr(ist < NA, "bug");
+    ctds[ist] = CTD_UNUSED;
+    const auto target = branched ? ml_branched[ist][k] : ml_unpaired[ist][k];
+    int ik = k - 1;
+    for (; ik >= 0; --ik) {
+      if (inter[ist][ik] >= CAP_E) continue;
+      if (!branched && Branch(ist, ik) == target) break;
+      if (branched && ik < k - 1 && Branch(ist, ik) + Branches(b, ik + 1, k - 1) == target) {
+        b_idxs.emplace_back(ik + 1, k - 1, DP_U);
+        break;
+      }
+    }
+    verify_expr(ik >= 0, "bug");
+    i = ist;
+    k = ik;
+  }
+}
+
+void Cofolder::TracebackPrefix(
+    const strand_tables_t& s, int en, int offset, std::vector<index_t>& idxs) {
+  const auto& sr = s.r;
+  while (en > 0) {
+    const auto mfe = s.prefix_ext[en];
+    if (s.prefix_ext[en - 1] == mfe) {
+      --en;
+      continue;
+    }
+    // The last branch ends at |last|, possibly with a dangle on it.
+    const int last = en - 1;
+    bool found = false;
+    for (int st = 0; st < last && !found; ++st) {
+      const auto stb = sr[st], st1b = sr[st + 1], enb = sr[last], en1b = sr[last - 1];
+      const auto pre = s.prefix_ext[st];
+      const auto try_branch = [&](int pst, int pen, energy_t extra, Ctd ctd) {
+        if (found || s.dp[pst][pen][DP_P] >= CAP_E) return;
+        if (pre + s.dp[pst][pen][DP_P] + gem.AuGuPenalty(sr[pst], sr[pen]) + extra != mfe) return;
+        found = true;
+        ctds[offset + pst] = ctd;
+        idxs.emplace_back(pst, pen, DP_P);
+        en = st;
+      };
+      try_branch(st, last, 0, CTD_UNUSED);
+      try_branch(st, last - 1, gem.dangle3[en1b][enb][stb], CTD_3_DANGLE);
+      try_branch(st + 1, last, gem.dangle5[enb][stb][st1b], CTD_5_DANGLE);
+      if (st + 1 < last - 1)
+        try_branch(st + 1, last - 1, gem.terminal[en1b][enb][stb][st1b], CTD_MISMATCH);
+    }
+    verify_expr(found, "bug");
+  }
+}
+
+void Cofolder::TracebackStrand(strand_tables_t& s, const std::vector<index_t>& idxs, int offset) {
+  const int N = int(s.r.size());
+  gr = s.r;
+  gp.assign(N, -1);
+  gctd.assign(N, CTD_NA);
+  gcons = PrecomputeConstraints(gr, {});
+  std::swap(gdp, s.dp);
+  std::swap(gext, s.ext);
+  for (const auto& idx : idxs)
+    if (idx.st < N) TracebackFrom(idx);
+  std::swap(gdp, s.dp);
+  std::swap(gext, s.ext);
+  for (int i = 0; i < N; ++i) {
+    if (gp[i] != -1) p[offset + i] = offset + gp[i];
+    if (gctd[i] != CTD_NA) ctds[offset + i] = gctd[i];
+  }
+}
+
+cofold_t Cofolder::Traceback() {
+  p.assign(r.size(), -1);
+  ctds.assign(r.size(), CTD_NA);
+  const energy_t separate = a.ext[0][EXT] + b.ext[0][EXT];
+  energy_t mfe = separate;
+  int best_i = -1, best_k = -1;
+  ext_choice_t best{};
+  for (int i = 0; i < NA; ++i) {
+    for (int k = 0; k < NB; ++k) {
+      if (inter[i][k] >= CAP_E) continue;
+      ForEachOuterLoop(i, k, [&](const ext_choice_t& c) {
+        if (c.energy < mfe) {
+          mfe = c.energy;
+          best_i = i;
+          best_k = k;
+          best = c;
+        }
+      });
+    }
+  }
+
+  std::vector<index_t> a_idxs, b_idxs;
+  if (best_i == -1) {
+    a_idxs.emplace_back(0, -1, EXT);
+    b_idxs.emplace_back(0, -1, EXT);
+  } else {
+    ctds[best_i] = best.ctd;
+    TracebackPrefix(a, best.a_en, 0, a_idxs);
+    b_idxs.emplace_back(best.b_st, -1, EXT);
+    TracebackInter(best_i, best_k, a_idxs, b_idxs);
+  }
+  TracebackStrand(a, a_idxs, 0);
+  TracebackStrand(b, b_idxs, NA);
+  return {computed_t({r, p}, ctds, mfe), NA, separate};
+}
+}
+
+strand_tables_t TakeStrandTables() {
+  strand_tables_t s;
+  s.r = gr;
+  s.dp = std::move(gdp);
+  s.ext = std::move(gext);
+  const int N = int(s.r.size());
+  const auto& sr = s.r;
+  s.prefix_ext.assign(N + 1, MAX_E);
+  s.prefix_ext[0] = 0;
+  for (int en = 0; en < N; ++en) {
+    // Case: No pair ending here
+    auto mfe = s.prefix_ext[en];
+    for (int st = 0; st < en - HAIRPIN_MIN_SZ; ++st) {
+      const auto stb = sr[st], st1b = sr[st + 1], enb = sr[en], en1b = sr[en - 1];
+      const auto pre = s.prefix_ext[st];
+      const auto base00 = s.dp[st][en][DP_P] + gem.AuGuPenalty(stb, enb);
+      const auto base01 = s.dp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b);
+      const auto base10 = s.dp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb);
+      const auto base11 = s.dp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b);
+      // <   >(   )
+      mfe = std::min(mfe, pre + base00);
+      // <   >(   )3 3'
+      mfe = std::min(mfe, pre + base01 + gem.dangle3[en1b][enb][stb]);
+      // <   >5(   ) 5'
+      mfe = std::min(mfe, pre + base10 + gem.dangle5[enb][stb][st1b]);
+      // <   >.(   ). Terminal mismatch
+      mfe = std::min(mfe, pre + base11 + gem.terminal[en1b][enb][stb][st1b]);
+    }
+    s.prefix_ext[en + 1] = mfe;
+  }
+  return s;
+}
+
+cofold_t Cofold(strand_tables_t& a, strand_tables_t& b) {
+  Cofolder cofolder(a, b);
+  cofolder.ComputeTables();
+  return cofolder.Traceback();
+}
+}
+}
+}
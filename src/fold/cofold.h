@@ -0,0 +1,70 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_COFOLD_H
+#define KEKRNA_FOLD_COFOLD_H
+
+#include <vector>
+#include "array.h"
+#include "common.h"
+#include "fold/fold.h"
+
+namespace kekrna {
+namespace fold {
+
+// Intermolecular initiation from the Turner 2004 parameters. Added once to each structure with
+// pairs between the strands.
+const energy_t INTERMOLECULAR_INIT = 41;
+
+struct cofold_t {
+  // Structure of the first strand followed by the second. The strand break is just before
+  // |split|, and intermolecular pairs cross it.
+  computed_t computed;
+  int split;
+  // Energy of the two strands folded on their own. |computed| is no worse than this, and the
+  // difference is the free energy of hybridization.
+  energy_t separate_energy;
+};
+
+namespace internal {
+
+// The intramolecular tables of one strand. Cofolding only needs these besides its intermolecular
+// tables, so they can be computed once for a strand and shared between all of its partners.
+struct strand_tables_t {
+  primary_t r;
+  array3d_t<energy_t, DP_SIZE> dp;
+  array2d_t<energy_t, EXT_SIZE> ext;
+  // |prefix_ext[en]| is the best exterior loop energy of bases [0, |en|). Unlike |ext|, branches
+  // in it don't coaxially stack.
+  std::vector<energy_t> prefix_ext;
+};
+
+// Takes the global tables, which must have been computed for the strand including the exterior
+// loop, and computes the prefix exterior loop table from them.
+strand_tables_t TakeStrandTables();
+
+// Cofolds |a| followed by |b| with the global energy model, overwriting the rest of the global
+// state. Pairs within a strand come from its own tables, and only the pairs between the strands
+// are computed here, in O(|a| |b| (|a| + |b|)) time. The loop containing the strand break is an
+// exterior loop, like the one containing the ends, so intramolecular branches in either are
+// scored as in the exterior loop of their strand. Intermolecular pairs can dangle or form
+// terminal mismatches in the exterior loops, but don't coaxially stack, and take no CTDs in
+// intermolecular multiloops. Intramolecular structures are unaffected by the break. The tables
+// of |a| and |b| are borrowed for the traceback and are unchanged afterwards.
+cofold_t Cofold(strand_tables_t& a, strand_tables_t& b);
+}
+}
+}
+
+#endif  // KEKRNA_FOLD_COFOLD_H
@@ -0,0 +1,109 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <stack>
+#include "fold/constraints.h"
+
+namespace kekrna {
+namespace fold {
+
+constraints_t ParseConstraintString(const std::string& constraint_str) {
+  constraints_t constraints;
+  std::stack<int> s;
+  for (int i = 0; i < int(constraint_str.size()); ++i) {
+    const char c = constraint_str[i];
+    if (c == '(') {
+      s.push(i);
+    } else if (c == ')') {
+      verify_expr(!s.empty(), "unmatched bracket in constraint");
+      constraints.forced_pairs.emplace_back(s.top(), i);
+      s.pop();
+    } else if (c == 'x') {
+      constraints.forced_unpaired.push_back(i);
+    } else {
+      verify_expr(c == '.', "invalid constraint character '%c'", c);
+    }
+  }
+  verify_expr(s.empty(), "unmatched bracket in constraint");
+  return constraints;
+}
+
+namespace internal {
+
+constraint_precomp_t PrecomputeConstraints(const primary_t& r, const constraints_t& constraints) {
+  const int N = int(r.size());
+  constraint_precomp_t cp;
+  cp.active = !constraints.Empty();
+  cp.N = N;
+  cp.forced.assign(N, -1);
+  cp.next_must_pair.assign(N + 2, N);
+  cp.prev_must_pair.assign(N + 1, -1);
+  if (!cp.active) return cp;
+
+  std::vector<uint8_t> no_pair(N, 0);
+  for (auto i : constraints.forced_unpaired) {
+    verify_expr(i >= 0 && i < N, "forced unpaired base %d out of range", i);
+    no_pair[i] = 1;
+  }
+  for (const auto& range : constraints.forbidden_ranges) {
+    verify_expr(range.first >= 0 && range.first <= range.second && range.second < N,
+        "forbidden range [%d, %d] out of range", range.first, range.second);
+    for (int i = range.first; i <= range.second; ++i)
+      no_pair[i] = 1;
+  }
+  for (const auto& pair : constraints.forced_pairs) {
+    const int st = pair.first, en = pair.second;
+    verify_expr(st >= 0 && st < en && en < N, "forced pair (%d, %d) out of range", st, en);
+    verify_expr(cp.forced[st] == -1 && cp.forced[en] == -1,
+        "base in more than one forced pair (%d, %d)", st, en);
+    verify_expr(!no_pair[st] && !no_pair[en], "forced pair (%d, %d) on an unpaired base", st, en);
+    cp.forced[st] = en;
+    cp.forced[en] = st;
+  }
+
+  for (int i = N - 1; i >= 0; --i)
+    cp.next_must_pair[i] = cp.forced[i] != -1 ? i : cp.next_must_pair[i + 1];
+  for (int i = 0; i < N; ++i)
+    cp.prev_must_pair[i] = cp.forced[i] != -1 ? i : (i > 0 ? cp.prev_must_pair[i - 1] : -1);
+  cp.prev_must_pair[N] = N > 0 ? cp.prev_must_pair[N - 1] : -1;
+
+  // A pair (st, en) is allowed if neither base is forced unpaired or forced to pair with something
+  // else, and it does not cross any forced pair. To check crossing, keep track of the range of
+  // forced partners of the bases strictly inside (st, en).
+  cp.allowed.assign(std::size_t(N) * N, 0);
+  for (int st = 0; st < N; ++st) {
+    if (no_pair[st]) continue;
+    int lo = N, hi = -1;
+    for (int en = st + 1; en < N; ++en) {
+      const int last = cp.forced[en - 1];
+      if (en - 1 > st && last != -1) {
+        lo = std::min(lo, last);
+        hi = std::max(hi, last);
+      }
+      if (no_pair[en]) continue;
+      if (cp.forced[st] != -1 && cp.forced[st] != en) continue;
+      if (cp.forced[en] != -1 && cp.forced[en] != st) continue;
+      if (lo <= st || hi >= en) continue;
+      cp.allowed[st * N + en] = 1;
+    }
+  }
+  // Forced pairs must not cross each other.
+  for (const auto& pair : constraints.forced_pairs)
+    verify_expr(cp.allowed[pair.first * N + pair.second], "forced pair (%d, %d) crosses another",
+        pair.first, pair.second);
+  return cp;
+}
+}
+}
+}
@@ -0,0 +1,70 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_CONSTRAINTS_H
+#define KEKRNA_FOLD_CONSTRAINTS_H
+
+#include "common.h"
+
+namespace kekrna {
+namespace fold {
+
+// Hard constraints on folding. All indices are 0 indexed.
+struct constraints_t {
+  // Pairs (st, en) which must be present in every structure.
+  std::vector<std::pair<int, int>> forced_pairs;
+  // Bases which must be left unpaired.
+  std::vector<int> forced_unpaired;
+  // Inclusive ranges [st, en] of bases which must all be left unpaired, e.g. protein bound regions.
+  std::vector<std::pair<int, int>> forbidden_ranges;
+
+  bool Empty() const {
+    return forced_pairs.empty() && forced_unpaired.empty() && forbidden_ranges.empty();
+  }
+};
+
+// Parses a constraint string with the same length as the primary sequence. Matching brackets
+// '(' and ')' are forced pairs, 'x' is forced unpaired, and '.' is unconstrained.
+constraints_t ParseConstraintString(const std::string& constraint_str);
+
+namespace internal {
+
+struct constraint_precomp_t {
+  // If there are no constraints, |allowed| is empty and all pairs are allowed.
+  bool active;
+  int N;
+  // Forced pair partner of each base, or -1.
+  std::vector<int> forced;
+  // Smallest index >= i which must be paired, or N if none. Has N + 2 entries.
+  std::vector<int> next_must_pair;
+  // Largest index <= i which must be paired, or -1 if none. Has N + 1 entries.
+  std::vector<int> prev_must_pair;
+  // N * N matrix of which pairs are allowed by the constraints.
+  std::vector<uint8_t> allowed;
+
+  bool CanPair(int st, int en) const { return !active || allowed[st * N + en]; }
+  // Empty ranges (st > en) can always be unpaired.
+  bool CanUnpair(int st, int en) const { return next_must_pair[st] > en; }
+  // These return an energy which can be added to a recurrence to forbid it if the given bases are
+  // required to be paired. This is 0 if they can be left unpaired, or MAX_E otherwise.
+  energy_t Unpaired(int st, int en) const { return CanUnpair(st, en) ? 0 : MAX_E; }
+  energy_t Unpaired(int i) const { return Unpaired(i, i); }
+};
+
+constraint_precomp_t PrecomputeConstraints(const primary_t& r, const constraints_t& constraints);
+}
+}
+}
+
+#endif  // KEKRNA_FOLD_CONSTRAINTS_H
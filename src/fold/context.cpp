@@ -12,10 +12,17 @@
 //
 // You should have received a copy of the GNU General Public License along with kekrna.
 // If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include "fold/context.h"
 #include "fold/brute_fold.h"
+#include "fold/snapshot.h"
+#include "fold/structure_hash.h"
 #include "fold/suboptimal0.h"
 #include "fold/suboptimal1.h"
+#include "parsing.h"
 
 namespace kekrna {
 namespace fold {
@@ -25,6 +32,57 @@ using namespace energy;
 constexpr context_options_t::TableAlg context_options_t::TABLE_ALGS[];
 constexpr context_options_t::SuboptimalAlg context_options_t::SUBOPTIMAL_ALGS[];
 
+namespace {
+
+// Identifies everything a suboptimal cursor position depends on, apart from the delta.
+uint32_t CursorKey(const primary_t& r, const energy::EnergyModel& em,
+    const context_options_t& options) {
+  std::string data(r.begin(), r.end());
+  const auto append = [&data](int value) {
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  append(int(em.Checksum()));
+  for (const auto& pairs : {options.constraints.forced_pairs,
+           options.constraints.forbidden_ranges, options.suboptimal_filter.must_contain,
+           options.suboptimal_filter.must_avoid}) {
+    append(int(pairs.size()));
+    for (const auto& pair : pairs) {
+      append(pair.first);
+      append(pair.second);
+    }
+  }
+  for (const auto& idxs : {options.constraints.forced_unpaired,
+           options.suboptimal_filter.must_unpaired}) {
+    append(int(idxs.size()));
+    for (int idx : idxs)
+      append(idx);
+  }
+  append(options.suboptimal_filter.max_pairs);
+  append(options.suboptimal_filter.max_multiloops);
+  return Crc32(data);
+}
+
+void ComputeTablesForAlg(context_options_t::TableAlg table_alg, int reuse_st) {
+  switch (table_alg) {
+    case context_options_t::TableAlg::ZERO:
+      internal::ComputeTables0(reuse_st);
+      break;
+    case context_options_t::TableAlg::ONE:
+      internal::ComputeTables1(reuse_st);
+      break;
+    case context_options_t::TableAlg::TWO:
+      internal::ComputeTables2(reuse_st);
+      break;
+    case context_options_t::TableAlg::THREE:
+      internal::ComputeTables3(reuse_st);
+      break;
+    default:
+      verify_expr(false, "bug");
+  }
+  internal::ComputeExterior();
+}
+}
+
 context_options_t ContextOptionsFromArgParse(const ArgParse& argparse) {
   context_options_t options;
   auto dp_alg = argparse.GetOption("dp-alg");
@@ -51,38 +109,153 @@ context_options_t ContextOptionsFromArgParse(const ArgParse& argparse) {
   } else {
     verify_expr(false, "unknown fold option");
   }
+  options.suboptimal_threads = atoi(argparse.GetOption("subopt-threads").c_str());
+  verify_expr(options.suboptimal_threads >= 1, "need at least one suboptimal thread");
+  options.suboptimal_unordered = argparse.HasFlag("subopt-unordered");
+  options.suboptimal_cache_mb = atoi(argparse.GetOption("subopt-cache-mb").c_str());
+  verify_expr(options.suboptimal_cache_mb >= 0, "suboptimal cache limit must not be negative");
+  options.suboptimal_mem_mb = atoi(argparse.GetOption("subopt-mem-mb").c_str());
+  verify_expr(options.suboptimal_mem_mb >= 0, "suboptimal memory limit must not be negative");
+  options.suboptimal_unique = argparse.HasFlag("subopt-unique");
+  options.partition_threads = atoi(argparse.GetOption("partition-threads").c_str());
+  verify_expr(options.partition_threads >= 1, "need at least one partition function thread");
+  // Filters use the same syntax as constraints.
+  if (argparse.HasFlag("subopt-filter")) {
+    const auto filter = ParseConstraintString(argparse.GetOption("subopt-filter"));
+    options.suboptimal_filter.must_contain = filter.forced_pairs;
+    options.suboptimal_filter.must_unpaired = filter.forced_unpaired;
+  }
+  if (argparse.HasFlag("subopt-avoid")) {
+    const auto avoid = ParseConstraintString(argparse.GetOption("subopt-avoid"));
+    verify_expr(avoid.forced_unpaired.empty(), "avoided pairs can't have unpaired bases");
+    options.suboptimal_filter.must_avoid = avoid.forced_pairs;
+  }
+  options.suboptimal_filter.max_pairs = atoi(argparse.GetOption("subopt-max-pairs").c_str());
+  options.suboptimal_filter.max_multiloops =
+      atoi(argparse.GetOption("subopt-max-multiloops").c_str());
+  if (argparse.HasFlag("constraint"))
+    options.constraints = ParseConstraintString(argparse.GetOption("constraint"));
+  if (argparse.HasFlag("tables")) options.tables_filename = argparse.GetOption("tables");
   return options;
 }
 
 void Context::ComputeTables() {
-  internal::SetGlobalState(r, *em);
-  switch (options.table_alg) {
-    case context_options_t::TableAlg::ZERO:
-      internal::ComputeTables0();
-      break;
-    case context_options_t::TableAlg::ONE:
-      internal::ComputeTables1();
-      break;
-    case context_options_t::TableAlg::TWO:
-      internal::ComputeTables2();
-      break;
-    case context_options_t::TableAlg::THREE:
-      internal::ComputeTables3();
-      break;
-    default:
-      verify_expr(false, "bug");
+  internal::SetGlobalState(r, *em, options.constraints);
+  if (options.tables_filename.empty()) {
+    ComputeTablesForAlg(options.table_alg, int(r.size()));
+    return;
   }
-  internal::ComputeExterior();
+  const auto checksum = em->Checksum();
+  if (internal::LoadTables(options.tables_filename, checksum, int(options.table_alg))) return;
+  ComputeTablesForAlg(options.table_alg, int(r.size()));
+  internal::SaveTables(options.tables_filename, checksum, int(options.table_alg));
 }
 
 computed_t Context::Fold() {
-  if (options.table_alg == context_options_t::TableAlg::BRUTE) return FoldBruteForce(r, *em, 1)[0];
+  if (options.table_alg == context_options_t::TableAlg::BRUTE) {
+    auto computeds = FoldBruteForce(r, *em, 1, options.constraints);
+    verify_expr(!computeds.empty(), "constraints cannot be satisfied");
+    return computeds[0];
+  }
 
   ComputeTables();
+  verify_expr(internal::gext[0][internal::EXT] < CAP_E, "constraints cannot be satisfied");
   internal::Traceback();
   return {{internal::gr, internal::gp}, internal::gctd, internal::genergy};
 }
 
+std::vector<computed_t> FoldBatch(const std::vector<primary_t>& rs,
+    const energy::EnergyModelPtr em, const context_options_t& options) {
+  std::vector<computed_t> computeds(rs.size());
+  if (options.table_alg == context_options_t::TableAlg::BRUTE || !options.constraints.Empty()) {
+    for (int i = 0; i < int(rs.size()); ++i)
+      computeds[i] = Context(rs[i], em, options).Fold();
+    return computeds;
+  }
+
+  // Visiting the sequences in order of their reversals is a depth first traversal of the trie of
+  // reversed sequences, so the longest suffix shared with any sequence already folded is the one
+  // shared with the previous sequence.
+  std::vector<int> order(rs.size());
+  for (int i = 0; i < int(order.size()); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&rs](int a, int b) {
+    return std::lexicographical_compare(
+        rs[a].rbegin(), rs[a].rend(), rs[b].rbegin(), rs[b].rend());
+  });
+
+  primary_t prev_r;
+  array3d_t<energy_t, internal::DP_SIZE> prev_dp;
+  for (int idx : order) {
+    const auto& r = rs[idx];
+    verify_expr(r.size() > 0u, "cannot fold zero length RNA");
+    const int N = int(r.size()), prev_N = int(prev_r.size());
+    int shared = 0;
+    while (shared < N && shared < prev_N && r[N - shared - 1] == prev_r[prev_N - shared - 1])
+      ++shared;
+    // Row st of the tables depends on bases [st - 1, N), so it can be reused if st - 1 is in the
+    // shared suffix.
+    const int reuse_st = std::min(N, N - shared + 1);
+    internal::SetGlobalState(r, *em);
+    const int offset = prev_N - N;
+    for (int st = reuse_st; st < N; ++st)
+      memcpy(&internal::gdp[st][st], &prev_dp[st + offset][st + offset],
+          sizeof(internal::gdp[st][st]) * (N - st));
+    ComputeTablesForAlg(options.table_alg, reuse_st);
+    internal::Traceback();
+    computeds[idx] = {{internal::gr, internal::gp}, internal::gctd, internal::genergy};
+
+    prev_r = r;
+    prev_dp = std::move(internal::gdp);
+  }
+  return computeds;
+}
+
+std::vector<cofold_t> CofoldBatch(const primary_t& r, const std::vector<primary_t>& partners,
+    const energy::EnergyModelPtr em, const context_options_t& options) {
+  verify_expr(options.table_alg != context_options_t::TableAlg::BRUTE,
+      "cofolding is not supported by the brute force algorithm");
+  verify_expr(options.constraints.Empty(), "cofolding does not support constraints");
+  verify_expr(r.size() > 0u, "cannot fold zero length RNA");
+  internal::SetGlobalState(r, *em);
+  ComputeTablesForAlg(options.table_alg, int(r.size()));
+  auto tables = internal::TakeStrandTables();
+
+  std::vector<cofold_t> cofolds;
+  for (const auto& partner : partners) {
+    verify_expr(partner.size() > 0u, "cannot fold zero length RNA");
+    internal::SetGlobalState(partner, *em);
+    ComputeTablesForAlg(options.table_alg, int(partner.size()));
+    auto partner_tables = internal::TakeStrandTables();
+    cofolds.push_back(internal::Cofold(tables, partner_tables));
+  }
+  return cofolds;
+}
+
+std::vector<computed_t> FoldModels(const primary_t& r,
+    const std::vector<energy::EnergyModelPtr>& ems, const context_options_t& options) {
+  std::vector<computed_t> computeds;
+  if (options.table_alg == context_options_t::TableAlg::BRUTE) {
+    for (const auto& em : ems)
+      computeds.push_back(Context(r, em, options).Fold());
+    return computeds;
+  }
+
+  verify_expr(r.size() > 0u, "cannot fold zero length RNA");
+  for (int i = 0; i < int(ems.size()); ++i) {
+    // Sequence level state and the table allocations are shared between models.
+    if (i == 0)
+      internal::SetGlobalState(r, *ems[i], options.constraints);
+    else
+      internal::SetGlobalEnergyModel(*ems[i]);
+    ComputeTablesForAlg(options.table_alg, int(r.size()));
+    verify_expr(internal::gext[0][internal::EXT] < CAP_E, "constraints cannot be satisfied");
+    internal::Traceback();
+    computeds.push_back({{internal::gr, internal::gp}, internal::gctd, internal::genergy});
+  }
+  return computeds;
+}
+
 std::vector<computed_t> Context::SuboptimalIntoVector(bool sorted,
     energy_t subopt_delta, int subopt_num) {
   std::vector<computed_t> computeds;
@@ -96,23 +269,151 @@ std::vector<computed_t> Context::SuboptimalIntoVector(bool sorted,
 
 int Context::Suboptimal(SuboptimalCallback fn, bool sorted,
     energy_t subopt_delta, int subopt_num) {
+  verify_expr(!options.suboptimal_unique ||
+          options.suboptimal_alg == context_options_t::SuboptimalAlg::ONE,
+      "unique suboptimal folding is only supported by suboptimal algorithm 1");
+  verify_expr(options.suboptimal_filter.Empty() ||
+          options.suboptimal_alg == context_options_t::SuboptimalAlg::ONE,
+      "suboptimal filters are only supported by suboptimal algorithm 1");
   if (options.suboptimal_alg == context_options_t::SuboptimalAlg::BRUTE) {
-    auto computeds = FoldBruteForce(r, *em, subopt_num);
+    auto computeds = FoldBruteForce(r, *em, subopt_num, options.constraints);
     for (const auto& computed : computeds)
       fn(computed);
     return int(computeds.size());
   }
 
   ComputeTables();
+  // No structures satisfy the constraints.
+  if (internal::gext[0][internal::EXT] >= CAP_E) return 0;
   switch (options.suboptimal_alg) {
     case context_options_t::SuboptimalAlg::ZERO:
-      return internal::Suboptimal0(subopt_delta, subopt_num).Run(fn);
+      return internal::Suboptimal0(
+          subopt_delta, subopt_num, std::size_t(options.suboptimal_mem_mb) << 20)
+          .Run(fn);
     case context_options_t::SuboptimalAlg::ONE:
-      return internal::Suboptimal1(subopt_delta, subopt_num).Run(fn, sorted);
+      return internal::Suboptimal1(subopt_delta, subopt_num, options.suboptimal_threads,
+          !options.suboptimal_unordered, options.suboptimal_shard, options.suboptimal_num_shards,
+          std::size_t(options.suboptimal_cache_mb) << 20, options.suboptimal_unique,
+          options.suboptimal_filter)
+          .Run(fn, sorted);
     default:
       verify_expr(false, "bug - no such suboptimal algorithm %d", int(options.suboptimal_alg));
   }
 }
 
+int Context::SuboptimalViews(SuboptimalViewCallback fn, bool sorted,
+    energy_t subopt_delta, int subopt_num) {
+  if (options.suboptimal_alg != context_options_t::SuboptimalAlg::ONE) {
+    // Only Suboptimal1 can hand out views of its state, so convert the others' structures.
+    return Suboptimal(
+        [&fn](const computed_t& c) {
+          const auto db = parsing::PairsToDotBracket(c.s.p);
+          fn({c.s.r, c.s.p, c.base_ctds, {db.data(), db.size()}, c.energy,
+              StructureHash(c.s.p, c.base_ctds)});
+        },
+        sorted, subopt_delta, subopt_num);
+  }
+
+  ComputeTables();
+  // No structures satisfy the constraints.
+  if (internal::gext[0][internal::EXT] >= CAP_E) return 0;
+  return internal::Suboptimal1(subopt_delta, subopt_num, options.suboptimal_threads,
+      !options.suboptimal_unordered, options.suboptimal_shard, options.suboptimal_num_shards,
+      std::size_t(options.suboptimal_cache_mb) << 20, options.suboptimal_unique,
+      options.suboptimal_filter)
+      .RunViews(fn, sorted);
+}
+
+SuboptimalResults Context::SuboptimalIntoResults(bool sorted,
+    energy_t subopt_delta, int subopt_num) {
+  SuboptimalResults results(r);
+  SuboptimalViews([&results](const subopt_view_t& view) { results.Add(view); }, sorted,
+      subopt_delta, subopt_num);
+  return results;
+}
+
+suboptimal_anytime_t Context::SuboptimalAnytime(SuboptimalViewCallback fn,
+    const suboptimal_budget_t& budget, energy_t subopt_delta) {
+  const auto start = std::chrono::steady_clock::now();
+  verify_expr(options.suboptimal_alg == context_options_t::SuboptimalAlg::ONE,
+      "anytime suboptimal folding is only supported by suboptimal algorithm 1");
+  verify_expr(budget.time_ms >= 0 && budget.num_structures >= 0, "invalid suboptimal budget");
+  // Eviction would keep the cache under the budget, so it would never run out.
+  verify_expr(budget.memory_bytes == 0 || options.suboptimal_cache_mb == 0 ||
+      std::size_t(options.suboptimal_cache_mb) << 20 > budget.memory_bytes,
+      "suboptimal cache limit must be larger than the memory budget");
+  ComputeTables();
+  // No structures satisfy the constraints.
+  if (internal::gext[0][internal::EXT] >= CAP_E) return {0, CAP_E, true};
+  const auto deadline = budget.time_ms == 0 ? std::chrono::steady_clock::time_point::max() :
+      start + std::chrono::milliseconds(budget.time_ms);
+  const int subopt_num = budget.num_structures == 0 ? -1 : budget.num_structures;
+  return internal::Suboptimal1(subopt_delta, subopt_num, options.suboptimal_threads,
+      !options.suboptimal_unordered, options.suboptimal_shard, options.suboptimal_num_shards,
+      std::size_t(options.suboptimal_cache_mb) << 20, options.suboptimal_unique,
+      options.suboptimal_filter)
+      .RunAnytime(fn, budget.memory_bytes, deadline);
+}
+
+std::unique_ptr<SuboptimalCursor> Context::OpenSuboptimalCursor(
+    energy_t subopt_delta, const std::string& position) {
+  verify_expr(options.suboptimal_alg == context_options_t::SuboptimalAlg::ONE,
+      "suboptimal cursors are only supported by suboptimal algorithm 1");
+  ComputeTables();
+  auto cursor = std::make_unique<SuboptimalCursor>(subopt_delta, options.suboptimal_filter,
+      std::size_t(options.suboptimal_cache_mb) << 20, CursorKey(r, *em, options));
+  if (!position.empty() && !cursor->Restore(position)) return nullptr;
+  return cursor;
+}
+
+std::map<energy_t, double> Context::SuboptimalHistogram(energy_t subopt_delta) {
+  verify_expr(subopt_delta >= 0, "counting structures needs a delta");
+  verify_expr(!options.suboptimal_unique, "counting unique secondary structures is not supported");
+  ComputeTables();
+  std::map<energy_t, double> histogram;
+  // No structures satisfy the constraints.
+  if (internal::gext[0][internal::EXT] >= CAP_E) return histogram;
+  const auto counts = internal::Suboptimal1(subopt_delta, -1, 1, true, 0, 1,
+      std::size_t(options.suboptimal_cache_mb) << 20, false, options.suboptimal_filter)
+      .CountByEnergy();
+  for (int i = 0; i < int(counts.size()); ++i) {
+    if (counts[i] > 0.0) histogram[internal::gext[0][internal::EXT] + i] = counts[i];
+  }
+  return histogram;
+}
+
+std::vector<shape_rep_t> Context::SuboptimalShapes(
+    int shape_level, energy_t subopt_delta, int num_shapes) {
+  verify_expr(subopt_delta >= 0, "finding shapes needs a delta");
+  ComputeTables();
+  if (internal::gext[0][internal::EXT] >= CAP_E) return {};
+  return internal::Suboptimal1(subopt_delta, num_shapes, 1, true, 0, 1,
+      std::size_t(options.suboptimal_cache_mb) << 20, false, options.suboptimal_filter)
+      .BestShapes(shape_level);
+}
+
+partition_t Context::Partition() {
+  verify_expr(options.table_alg != context_options_t::TableAlg::BRUTE,
+      "the partition function needs the DP tables");
+  ComputeTables();
+  verify_expr(internal::gext[0][internal::EXT] < CAP_E, "constraints cannot be satisfied");
+  internal::Partition1 part(options.partition_threads);
+  part.Inside();
+  return part.Outside();
+}
+
+std::vector<computed_t> Context::StochasticSample(int num_samples, std::mt19937& eng) {
+  verify_expr(options.table_alg != context_options_t::TableAlg::BRUTE,
+      "sampling needs the DP tables");
+  ComputeTables();
+  verify_expr(internal::gext[0][internal::EXT] < CAP_E, "constraints cannot be satisfied");
+  internal::Partition1 part(options.partition_threads);
+  part.Inside();
+  std::vector<computed_t> samples;
+  for (int i = 0; i < num_samples; ++i)
+    samples.push_back(part.Sample(eng));
+  return samples;
+}
+
 }
 }
@@ -15,11 +15,19 @@
 #ifndef KEKRNA_FOLD_CONTEXT_H
 #define KEKRNA_FOLD_CONTEXT_H
 
+#include <memory>
 #include <stack>
 #include "argparse.h"
 #include "common.h"
 #include "energy/energy.h"
+#include "fold/cofold.h"
+#include "fold/constraints.h"
 #include "fold/fold.h"
+#include "fold/partition.h"
+#include "fold/shapes.h"
+#include "fold/suboptimal_cursor.h"
+#include "fold/suboptimal_filter.h"
+#include "fold/suboptimal_results.h"
 
 namespace kekrna {
 namespace fold {
@@ -43,10 +51,39 @@ struct context_options_t {
 
   context_options_t(
       TableAlg table_alg_ = TableAlg::ZERO, SuboptimalAlg suboptimal_alg_ = SuboptimalAlg::ZERO)
-      : table_alg(table_alg_), suboptimal_alg(suboptimal_alg_) {}
+      : table_alg(table_alg_), suboptimal_alg(suboptimal_alg_), suboptimal_threads(1),
+        suboptimal_unordered(false), suboptimal_shard(0), suboptimal_num_shards(1),
+        suboptimal_cache_mb(0), suboptimal_mem_mb(0), suboptimal_unique(false),
+        partition_threads(1) {}
 
   TableAlg table_alg;
   SuboptimalAlg suboptimal_alg;
+  // Only used by SuboptimalAlg::ONE. Unordered output is faster with multiple threads, but the
+  // structures aren't reported in the same order as the serial enumeration.
+  int suboptimal_threads;
+  bool suboptimal_unordered;
+  // Only enumerate the |suboptimal_shard|th of |suboptimal_num_shards| disjoint slices of the
+  // suboptimal structures. Only used by SuboptimalAlg::ONE.
+  int suboptimal_shard;
+  int suboptimal_num_shards;
+  // Memory limit for cached expansions, shared between threads. Zero means no limit. Only used by
+  // SuboptimalAlg::ONE.
+  int suboptimal_cache_mb;
+  // Memory limit for queued search nodes, beyond which the most expensive ones are spilled to a
+  // temporary file. Zero means no limit. Only used by SuboptimalAlg::ZERO.
+  int suboptimal_mem_mb;
+  // Report each secondary structure once, with its best CTDs, instead of once for each CTD
+  // assignment. Only used by SuboptimalAlg::ONE, on a single thread.
+  bool suboptimal_unique;
+  // Predicates which all suboptimal structures must satisfy. Only used by SuboptimalAlg::ONE.
+  suboptimal_filter_t suboptimal_filter;
+  // Threads for the partition function.
+  int partition_threads;
+  // Hard constraints which all folded and suboptimal structures must satisfy.
+  constraints_t constraints;
+  // If set, Context loads the DP tables from this file when it was saved for the same fold, and
+  // otherwise computes them and saves them to it.
+  std::string tables_filename;
 };
 
 class Context {
@@ -70,6 +107,37 @@ public:
       energy_t subopt_delta = -1, int subopt_num = -1);
   int Suboptimal(SuboptimalCallback fn, bool sorted,
       energy_t subopt_delta = -1, int subopt_num = -1);
+  // Like Suboptimal, but |fn| gets views of the structures, which avoids copying them with
+  // SuboptimalAlg::ONE.
+  int SuboptimalViews(SuboptimalViewCallback fn, bool sorted,
+      energy_t subopt_delta = -1, int subopt_num = -1);
+  SuboptimalResults SuboptimalIntoResults(bool sorted,
+      energy_t subopt_delta = -1, int subopt_num = -1);
+  // Reports structures within |subopt_delta| of the MFE in nondecreasing energy order, one energy
+  // level at a time, until |budget| runs out. Time spent computing the tables counts towards it.
+  // Only supported by SuboptimalAlg::ONE.
+  suboptimal_anytime_t SuboptimalAnytime(SuboptimalViewCallback fn,
+      const suboptimal_budget_t& budget, energy_t subopt_delta = -1);
+  // Returns a cursor over the structures within |subopt_delta| of the MFE, starting from
+  // |position|, which is from SuboptimalCursor::Position, or from the beginning if it is empty.
+  // Returns nullptr if |position| is invalid. Set |tables_filename| to resume without computing
+  // the tables again.
+  std::unique_ptr<SuboptimalCursor> OpenSuboptimalCursor(
+      energy_t subopt_delta, const std::string& position = "");
+  // Counts the suboptimal structures within |subopt_delta| of the MFE by energy, without
+  // enumerating them. Only energies with at least one structure are included.
+  std::map<energy_t, double> SuboptimalHistogram(energy_t subopt_delta);
+  // Returns the best structure of each abstract shape at |shape_level| within |subopt_delta| of
+  // the MFE, in order of energy. Unlike enumerating the structures and grouping them, this takes
+  // time depending on the number of shapes rather than structures. Returns at most |num_shapes|
+  // if it is not -1.
+  std::vector<shape_rep_t> SuboptimalShapes(
+      int shape_level, energy_t subopt_delta, int num_shapes = -1);
+  // Computes the partition function and base pair probabilities over structures with their CTDs,
+  // with the same energies as folding.
+  partition_t Partition();
+  // Samples |num_samples| structures with their CTDs from the Boltzmann distribution.
+  std::vector<computed_t> StochasticSample(int num_samples, std::mt19937& eng);
 
 private:
   const primary_t r;
@@ -82,9 +150,52 @@ private:
 const std::map<std::string, ArgParse::option_t> FOLD_OPTIONS = {
     {"dp-alg",
         ArgParse::option_t("which algorithm for kekrna").Arg("2", {"0", "1", "2", "3", "brute"})},
-    {"subopt-alg", ArgParse::option_t("which algorithm for kekrna").Arg("1", {"0", "1", "brute"})}};
+    {"subopt-alg", ArgParse::option_t("which algorithm for kekrna").Arg("1", {"0", "1", "brute"})},
+    {"subopt-threads", ArgParse::option_t("number of threads for suboptimal folding").Arg("1")},
+    {"subopt-unordered",
+        ArgParse::option_t("report suboptimal structures in any order when using threads")},
+    {"subopt-cache-mb",
+        ArgParse::option_t("memory limit in MB for suboptimal expansions, including an index "
+            "table of about 12 N^2 bytes per thread, 0 for none").Arg("0")},
+    {"subopt-mem-mb", ArgParse::option_t(
+        "memory limit in MB for queued suboptimal nodes before spilling to disk, 0 for none")
+        .Arg("0")},
+    {"subopt-unique",
+        ArgParse::option_t("report each secondary structure once, with its best CTDs")},
+    {"subopt-filter", ArgParse::option_t(
+        "suboptimal structures must have: () pair, x unpaired, . unconstrained").Arg()},
+    {"subopt-avoid",
+        ArgParse::option_t("suboptimal structures must not have the () pairs").Arg()},
+    {"subopt-max-pairs",
+        ArgParse::option_t("most pairs in suboptimal structures, -1 for no limit").Arg("-1")},
+    {"subopt-max-multiloops",
+        ArgParse::option_t("most multiloops in suboptimal structures, -1 for no limit").Arg("-1")},
+    {"partition-threads", ArgParse::option_t("number of threads for the partition function")
+        .Arg("1")},
+    {"constraint",
+        ArgParse::option_t("hard constraints: () forced pair, x unpaired, . unconstrained").Arg()},
+    {"tables", ArgParse::option_t("file to reuse DP tables from, or save them to").Arg()}};
 
 context_options_t ContextOptionsFromArgParse(const ArgParse& argparse);
+
+// Folds a batch of sequences. DP table rows for suffixes shared between sequences are computed
+// once and reused, so this is much faster than folding each one for large libraries of variants.
+// Results are in the same order as |rs|.
+std::vector<computed_t> FoldBatch(const std::vector<primary_t>& rs,
+    const energy::EnergyModelPtr em, const context_options_t& options);
+
+// Folds one sequence under each of |ems|, e.g. for parameter sweeps. Sequence level
+// precomputation and the table allocations are shared between models. Results are in the same
+// order as |ems|.
+std::vector<computed_t> FoldModels(const primary_t& r,
+    const std::vector<energy::EnergyModelPtr>& ems, const context_options_t& options);
+
+// Cofolds |r| with each of |partners|, with |r| as the first strand. The intramolecular tables of
+// |r| are computed once and shared between all of the partners, so screening one sequence against
+// many is much cheaper than folding each pair joined together. Results are in the same order as
+// |partners|.
+std::vector<cofold_t> CofoldBatch(const primary_t& r, const std::vector<primary_t>& partners,
+    const energy::EnergyModelPtr em, const context_options_t& options);
 }
 }
 
@@ -0,0 +1,169 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "fold/duplex.h"
+#include <algorithm>
+#include "fold/cofold.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+int TwoLoopKey(const base_t* t, int j, int jst) {
+  return (t[j] << 6) | (t[j - 1] << 4) | (t[jst + 1] << 2) | t[jst];
+}
+
+// Updates |out| with the two loops with |tu| unpaired target bases inside each pair. Values which
+// can't be formed stay at least CAP_E, so this needs no branches. The table lookups are gathers,
+// which can only be vectorised if they can't alias |out|.
+void UpdateRow(const energy_t* __restrict__ table, const base_t* __restrict__ t,
+    const energy_t* __restrict__ inner, int tu, int N, energy_t* __restrict__ out) {
+  for (int j = tu + 1; j < N; ++j) {
+    const int jst = j - tu - 1;
+    out[j] = std::min(out[j], table[TwoLoopKey(t, j, jst)] + inner[jst]);
+  }
+}
+}
+
+DuplexSearch::DuplexSearch(const primary_t& probe_, const energy::EnergyModelPtr em_)
+    : probe(probe_), em(em_), M(int(probe.size())),
+      table_idx(M * (TWOLOOP_MAX_SZ + 1) * (TWOLOOP_MAX_SZ + 1), -1) {
+  verify_expr(M > 0, "cannot search with a zero length probe");
+  for (int i = 0; i < M; ++i) {
+    for (int pu = 0; pu <= TWOLOOP_MAX_SZ && i + pu + 1 < M; ++pu) {
+      const int ist = i + pu + 1;
+      for (int tu = 0; pu + tu <= TWOLOOP_MAX_SZ; ++tu) {
+        // Single base bulges depend on the runs of bases around them, so they aren't tabulated.
+        if (pu + tu == 1) continue;
+        table_idx[(i * (TWOLOOP_MAX_SZ + 1) + pu) * (TWOLOOP_MAX_SZ + 1) + tu] =
+            int(tables.size());
+        // The probe part of the loop followed by a target part with the key bases filled in.
+        primary_t loop(probe.begin() + i, probe.begin() + ist + 1);
+        const int ien = int(loop.size());
+        loop.resize(loop.size() + tu + 2, A);
+        for (int key = 0; key < NUM_KEYS; ++key) {
+          loop[ien + 1] = base_t((key >> 2) & 3);
+          loop[ien + tu] = base_t((key >> 4) & 3);
+          loop[ien] = base_t(key & 3);
+          loop.back() = base_t(key >> 6);
+          energy_t energy = MAX_E;
+          if (CanPair(loop[0], loop.back()) && CanPair(loop[ien - 1], loop[ien]))
+            energy = em->TwoLoop(loop, 0, int(loop.size()) - 1, ien - 1, ien);
+          tables.push_back(energy);
+        }
+      }
+    }
+  }
+}
+
+const energy_t* DuplexSearch::Table(int i, int probe_unpaired, int target_unpaired) const {
+  const int idx =
+      table_idx[(i * (TWOLOOP_MAX_SZ + 1) + probe_unpaired) * (TWOLOOP_MAX_SZ + 1) +
+          target_unpaired];
+  assert(idx != -1);
+  return &tables[idx];
+}
+
+energy_t DuplexSearch::InnerEnd(int i, int j) const {
+  const auto ib = r[i], jb = r[M + j];
+  energy_t best = 0;
+  if (i + 1 < M) best = std::min(best, em->dangle3[ib][r[i + 1]][jb]);
+  if (j > 0) best = std::min(best, em->dangle5[ib][r[M + j - 1]][jb]);
+  if (i + 1 < M && j > 0) best = std::min(best, em->terminal[ib][r[i + 1]][r[M + j - 1]][jb]);
+  return best + em->AuGuPenalty(ib, jb);
+}
+
+energy_t DuplexSearch::OuterEnd(int i, int j) const {
+  const int N = int(r.size()) - M;
+  const auto ib = r[i], jb = r[M + j];
+  energy_t best = 0;
+  if (i > 0) best = std::min(best, em->dangle5[jb][r[i - 1]][ib]);
+  if (j + 1 < N) best = std::min(best, em->dangle3[jb][r[M + j + 1]][ib]);
+  if (i > 0 && j + 1 < N) best = std::min(best, em->terminal[jb][r[M + j + 1]][r[i - 1]][ib]);
+  return best + em->AuGuPenalty(ib, jb);
+}
+
+energy_t DuplexSearch::TwoLoop(int i, int j, int ist, int jst) const {
+  const int pu = ist - i - 1, tu = j - jst - 1;
+  if (pu + tu == 1) return em->TwoLoop(r, i, M + j, ist, M + jst);
+  return Table(i, pu, tu)[TwoLoopKey(&r[M], j, jst)];
+}
+
+duplex_t DuplexSearch::Best(const primary_t& target) {
+  const int N = int(target.size());
+  r = probe;
+  r.insert(r.end(), target.begin(), target.end());
+  dp.resize(M);
+  const base_t* t = &r[M];
+  for (int i = M - 1; i >= 0; --i) {
+    auto& row = dp[i];
+    row.assign(N, MAX_E);
+    for (int j = 0; j < N; ++j)
+      if (CanPair(r[i], t[j])) row[j] = InnerEnd(i, j);
+    for (int pu = 0; pu <= TWOLOOP_MAX_SZ && i + pu + 1 < M; ++pu) {
+      const int ist = i + pu + 1;
+      const energy_t* inner = dp[ist].data();
+      for (int tu = 0; pu + tu <= TWOLOOP_MAX_SZ && tu + 1 < N; ++tu) {
+        if (pu + tu == 1) {
+          for (int j = tu + 1; j < N; ++j) {
+            const int jst = j - tu - 1;
+            if (inner[jst] < CAP_E && CanPair(r[i], t[j]))
+              row[j] = std::min(row[j], em->TwoLoop(r, i, M + j, ist, M + jst) + inner[jst]);
+          }
+          continue;
+        }
+        UpdateRow(Table(i, pu, tu), t, inner, tu, N, row.data());
+      }
+    }
+    for (int j = 0; j < N; ++j)
+      if (row[j] >= CAP_E) row[j] = MAX_E;
+  }
+
+  duplex_t duplex{MAX_E, {}};
+  int best_i = -1, best_j = -1;
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < N; ++j) {
+      if (dp[i][j] >= CAP_E) continue;
+      const auto energy = INTERMOLECULAR_INIT + OuterEnd(i, j) + dp[i][j];
+      if (energy < duplex.energy) {
+        duplex.energy = energy;
+        best_i = i;
+        best_j = j;
+      }
+    }
+  }
+  if (best_i == -1) return duplex;
+
+  int i = best_i, j = best_j;
+  while (true) {
+    duplex.pairs.emplace_back(i, j);
+    if (dp[i][j] == InnerEnd(i, j)) break;
+    bool found = false;
+    for (int ist = i + 1; ist < M && ist - i - 1 <= TWOLOOP_MAX_SZ && !found; ++ist) {
+      for (int jst = j - 1; jst >= 0 && ist - i + j - jst - 2 <= TWOLOOP_MAX_SZ; --jst) {
+        if (dp[ist][jst] < CAP_E && TwoLoop(i, j, ist, jst) + dp[ist][jst] == dp[i][j]) {
+          i = ist;
+          j = jst;
+          found = true;
+          break;
+        }
+      }
+    }
+    verify_expr(found, "bug");
+  }
+  return duplex;
+}
+}
+}
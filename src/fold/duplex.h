@@ -0,0 +1,77 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_DUPLEX_H
+#define KEKRNA_FOLD_DUPLEX_H
+
+#include <utility>
+#include <vector>
+#include "common.h"
+#include "energy/energy_model.h"
+
+namespace kekrna {
+namespace fold {
+
+struct duplex_t {
+  // MAX_E if the probe can't pair with the target at all.
+  energy_t energy;
+  // Pairs of a probe base with a target base, from the outside of the duplex in. The probe bases
+  // are increasing and the target bases decreasing.
+  std::vector<std::pair<int, int>> pairs;
+};
+
+// Finds the best duplex of a probe with each of many targets. A duplex is made of intermolecular
+// stacks, bulges and internal loops only, with energies as for cofolding the probe followed by
+// the target when neither folds on itself. That is O(|probe| |target| TWOLOOP_MAX_SZ^2) per
+// target, much less than cofolding. Two loop energies only depend on the probe and four target
+// bases next to the pairs, apart from single base bulges, so they are tabulated once per probe,
+// and the scan over target positions is a branch free loop over table lookups that the compiler
+// can vectorise.
+class DuplexSearch {
+public:
+  DuplexSearch(const primary_t& probe_, const energy::EnergyModelPtr em_);
+  DuplexSearch(const DuplexSearch&) = delete;
+  DuplexSearch& operator=(const DuplexSearch&) = delete;
+
+  duplex_t Best(const primary_t& target);
+
+private:
+  // Index of the keys of two loop tables: the base paired with the probe, the one after it, the
+  // one before the other pair, and the one paired with the probe there.
+  static const int NUM_KEYS = 256;
+
+  const primary_t probe;
+  const energy::EnergyModelPtr em;
+  const int M;
+  // Two loop tables, for the outer probe base, the number of unpaired probe bases and the number
+  // of unpaired target bases. |table_idx| is -1 if there is no table.
+  std::vector<int> table_idx;
+  std::vector<energy_t> tables;
+  // Per target state, kept between targets to reuse the allocations. |r| is the probe followed by
+  // the target. |dp[i][j]| is the energy of probe base |i| paired with target base |j| and
+  // everything inside it.
+  primary_t r;
+  std::vector<std::vector<energy_t>> dp;
+
+  const energy_t* Table(int i, int probe_unpaired, int target_unpaired) const;
+  // The best way for the pair of |i| and |j| to end the duplex on the inside or outside, including
+  // its AU/GU penalty.
+  energy_t InnerEnd(int i, int j) const;
+  energy_t OuterEnd(int i, int j) const;
+  energy_t TwoLoop(int i, int j, int ist, int jst) const;
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_DUPLEX_H
@@ -0,0 +1,87 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include "fold/expansion_cache.h"
+
+namespace kekrna {
+namespace fold {
+namespace internal {
+
+packed_expand_t packed_expand_t::Pack(const expand_t& exp) {
+  assert(exp.ctd0.ctd >= 0 && exp.ctd1.ctd >= 0);
+  packed_expand_t packed;
+  packed.energy = exp.energy;
+  packed.ctds = uint32_t(exp.ctd0.idx + 1) | uint32_t(exp.ctd1.idx + 1) << PACKED_POS_BITS |
+      uint32_t(exp.ctd1.ctd) << (2 * PACKED_POS_BITS);
+  packed.idxs = PackIndex(exp.to_expand) | PackIndex(exp.unexpanded) << INDEX_BITS |
+      uint64_t(exp.ctd0.ctd) << (2 * INDEX_BITS);
+  return packed;
+}
+
+ExpansionCache::ExpansionCache(std::size_t max_bytes_)
+    : max_bytes(max_bytes_), N(0), generation(0) {}
+
+void ExpansionCache::Reset(int N_) {
+  verify_expr(N_ <= MAX_PACKED_N, "sequences longer than %d bases are not supported",
+      MAX_PACKED_N);
+  N = N_;
+  table.assign(std::size_t(NumIndexSlots(N)), 0);
+  used_slots.clear();
+  arena.clear();
+  ++generation;
+}
+
+std::pair<const packed_expand_t*, int> ExpansionCache::Insert(
+    const index_t& key, const std::vector<expand_t>& exps) {
+  const int slot = IndexSlot(key, N);
+  assert(table[slot] == 0);
+  const std::size_t size = exps.size() + 1;
+  // Each list takes at least one entry of the arena, so reserving as many used slots as arena
+  // entries keeps both within the limit.
+  const std::size_t table_bytes = table.capacity() * sizeof(uint32_t);
+  const std::size_t max_size = max_bytes > table_bytes ?
+      (max_bytes - table_bytes) / (sizeof(packed_expand_t) + sizeof(uint32_t)) : 0;
+  if (max_bytes != 0 && arena.size() + size > max_size) {
+    for (uint32_t used_slot : used_slots)
+      table[used_slot] = 0;
+    used_slots.clear();
+    arena.clear();
+    ++generation;
+  }
+  if (arena.size() + size > arena.capacity()) {
+    // Grow geometrically, but not past the limit unless a single list needs it.
+    std::size_t capacity = std::max(2 * arena.capacity(), arena.size() + size);
+    if (max_bytes != 0) {
+      capacity = std::max(std::min(capacity, max_size), size);
+      used_slots.reserve(capacity);
+    }
+    arena.reserve(capacity);
+    ++generation;
+  }
+  const uint32_t offset = uint32_t(arena.size());
+  packed_expand_t header;
+  header.energy = energy_t(exps.size());
+  header.ctds = 0;
+  header.idxs = 0;
+  arena.push_back(header);
+  for (const auto& exp : exps)
+    arena.push_back(packed_expand_t::Pack(exp));
+  table[slot] = offset + 1;
+  used_slots.push_back(uint32_t(slot));
+  return {&arena[offset + 1], int(exps.size())};
+}
+}
+}
+}
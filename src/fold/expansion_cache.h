@@ -0,0 +1,161 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_EXPANSION_CACHE_H
+#define KEKRNA_FOLD_EXPANSION_CACHE_H
+
+#include <vector>
+#include "common.h"
+#include "fold/fold.h"
+
+namespace kekrna {
+namespace fold {
+namespace internal {
+
+struct expand_t {
+  expand_t() = delete;
+  expand_t(energy_t energy_) : energy(energy_) {}
+  expand_t(energy_t energy_, const index_t& to_expand_) : energy(energy_), to_expand(to_expand_) {}
+  expand_t(energy_t energy_, const index_t& to_expand_, const index_t& unexpanded_)
+      : energy(energy_), to_expand(to_expand_), unexpanded(unexpanded_) {}
+  expand_t(energy_t energy_, const index_t& to_expand_, const ctd_idx_t& ctd0_)
+      : energy(energy_), to_expand(to_expand_), ctd0(ctd0_) {}
+  expand_t(energy_t energy_, const index_t& to_expand_, const index_t& unexpanded_,
+      const ctd_idx_t& ctd0_)
+      : energy(energy_), to_expand(to_expand_), unexpanded(unexpanded_), ctd0(ctd0_) {}
+  expand_t(energy_t energy_, const index_t& to_expand_, const index_t& unexpanded_,
+      const ctd_idx_t& ctd0_, const ctd_idx_t& ctd1_)
+      : energy(energy_), to_expand(to_expand_), unexpanded(unexpanded_), ctd0(ctd0_), ctd1(ctd1_) {}
+  energy_t energy;
+  index_t to_expand, unexpanded;  // st is -1 if this does not exist
+  ctd_idx_t ctd0, ctd1;
+
+  bool operator<(const expand_t& o) const { return energy < o.energy; }
+};
+
+// Positions are stored plus one in this many bits, so that -1 fits.
+constexpr int PACKED_POS_BITS = 13;
+// Longest sequence whose expansions can be packed.
+constexpr int MAX_PACKED_N = (1 << PACKED_POS_BITS) - 2;
+
+// An expand_t in 16 bytes. The energy is kept unpacked since it is read far more often than the
+// rest, which is only needed once an expansion is taken.
+struct packed_expand_t {
+  energy_t energy;
+  uint32_t ctds;  // ctd0.idx, ctd1.idx, ctd1.ctd
+  uint64_t idxs;  // to_expand, unexpanded, ctd0.ctd
+
+  index_t to_expand() const { return UnpackIndex(idxs); }
+  index_t unexpanded() const { return UnpackIndex(idxs >> INDEX_BITS); }
+  ctd_idx_t ctd0() const {
+    return UnpackCtd(int(ctds & POS_MASK), Ctd((idxs >> (2 * INDEX_BITS)) & CTD_MASK));
+  }
+  ctd_idx_t ctd1() const {
+    return UnpackCtd(int((ctds >> PACKED_POS_BITS) & POS_MASK),
+        Ctd((ctds >> (2 * PACKED_POS_BITS)) & CTD_MASK));
+  }
+  bool has_to_expand() const { return (idxs & POS_MASK) != 0; }
+  bool has_unexpanded() const { return ((idxs >> INDEX_BITS) & POS_MASK) != 0; }
+
+  static packed_expand_t Pack(const expand_t& exp);
+
+private:
+  constexpr static int A_BITS = 3;
+  constexpr static int CTD_BITS = 4;
+  constexpr static int INDEX_BITS = 2 * PACKED_POS_BITS + A_BITS;
+  constexpr static uint64_t POS_MASK = (1u << PACKED_POS_BITS) - 1;
+  constexpr static uint64_t A_MASK = (1u << A_BITS) - 1;
+  constexpr static uint64_t CTD_MASK = (1u << CTD_BITS) - 1;
+  static_assert(DP_SIZE <= int(A_MASK) && EXT_SIZE <= int(A_MASK), "a does not fit");
+  static_assert(CTD_SIZE <= int(CTD_MASK) + 1, "ctd does not fit");
+
+  static uint64_t PackIndex(const index_t& idx) {
+    return uint64_t(idx.st + 1) | uint64_t(idx.en + 1) << PACKED_POS_BITS |
+        uint64_t(idx.a + 1) << (2 * PACKED_POS_BITS);
+  }
+  static index_t UnpackIndex(uint64_t bits) {
+    return index_t(int(bits & POS_MASK) - 1, int((bits >> PACKED_POS_BITS) & POS_MASK) - 1,
+        int((bits >> (2 * PACKED_POS_BITS)) & A_MASK) - 1);
+  }
+  static ctd_idx_t UnpackCtd(int idx, Ctd ctd) {
+    ctd_idx_t ctd_idx;
+    ctd_idx.idx = int16_t(idx - 1);
+    ctd_idx.ctd = ctd;
+    return ctd_idx;
+  }
+};
+
+static_assert(sizeof(packed_expand_t) == 16, "packed_expand_t should be 16 bytes");
+
+// Dense numbering of every index of a sequence of length |N|, over the upper triangle for DP
+// indices followed by the exterior loop indices.
+inline int NumIndexSlots(int N) { return N * (N + 1) / 2 * DP_SIZE + (N + 1) * EXT_SIZE; }
+inline int IndexSlot(const index_t& idx, int N) {
+  if (idx.en == -1) return N * (N + 1) / 2 * DP_SIZE + idx.st * EXT_SIZE + idx.a;
+  assert(idx.st <= idx.en && idx.en < N);
+  // Rows of the upper triangle, each starting at |en| == |st|.
+  const int row = idx.st * N - idx.st * (idx.st - 1) / 2;
+  return (row + idx.en - idx.st) * DP_SIZE + idx.a;
+}
+
+// Cache of the sorted expansions of each index. Keys are looked up directly in a table over every
+// (st, en, a), which holds offsets into one contiguous arena of packed expansions. The table is
+// always needed, so the arena gets what is left of |max_bytes| after it. If the arena would grow
+// past that, everything is evicted at once. Not thread safe.
+class ExpansionCache {
+public:
+  // A |max_bytes_| of zero means no limit.
+  explicit ExpansionCache(std::size_t max_bytes_ = 0);
+  ExpansionCache(const ExpansionCache&) = delete;
+  ExpansionCache& operator=(const ExpansionCache&) = delete;
+  ExpansionCache(ExpansionCache&&) = default;
+  ExpansionCache& operator=(ExpansionCache&&) = default;
+
+  // Empties the cache and sizes the table for a sequence of length |N_|.
+  void Reset(int N_);
+  // Returns the expansions of |key| and how many there are, or nullptr if they aren't cached.
+  std::pair<const packed_expand_t*, int> Find(const index_t& key) const {
+    const uint32_t offset = table[IndexSlot(key, N)];
+    if (offset == 0) return {nullptr, 0};
+    const packed_expand_t* header = &arena[offset - 1];
+    return {header + 1, header->energy};
+  }
+  // |exps| must not already be cached for |key|.
+  std::pair<const packed_expand_t*, int> Insert(
+      const index_t& key, const std::vector<expand_t>& exps);
+
+  // Changes whenever the arena is evicted or reallocated. Pointers returned before that are no
+  // longer valid, but looking the keys up again is cheap.
+  uint32_t Generation() const { return generation; }
+  std::size_t Bytes() const {
+    return arena.capacity() * sizeof(packed_expand_t) +
+        (table.capacity() + used_slots.capacity()) * sizeof(uint32_t);
+  }
+
+private:
+  std::size_t max_bytes;
+  int N;
+  uint32_t generation;
+  // Offsets into |arena| plus one, or zero if not cached.
+  std::vector<uint32_t> table;
+  // Slots which are set, so eviction doesn't need to clear the whole table.
+  std::vector<uint32_t> used_slots;
+  // Each cached list is preceded by a header holding its length in |energy|.
+  std::vector<packed_expand_t> arena;
+};
+}
+}
+}
+
+#endif  // KEKRNA_FOLD_EXPANSION_CACHE_H
@@ -15,6 +15,7 @@
 #ifndef KEKRNA_FOLD_INTERNAL_H
 #define KEKRNA_FOLD_INTERNAL_H
 
+#include "array.h"
 #include "base.h"
 #include "common.h"
 #include "fold/globals.h"
@@ -26,7 +27,7 @@ namespace internal {
 // MFE folding related
 
 inline bool ViableFoldingPair(int st, int en) {
-  return CanPair(gr[st], gr[en]) &&
+  return CanPair(gr[st], gr[en]) && gcons.CanPair(st, en) &&
       ((en - st - 3 >= HAIRPIN_MIN_SZ && CanPair(gr[st + 1], gr[en - 1])) ||
           (st > 0 && en < int(gr.size() - 1) && CanPair(gr[st - 1], gr[en + 1])));
 }
@@ -36,10 +37,12 @@ struct cand_t {
   int idx;
 };
 
-void ComputeTables0();
-void ComputeTables1();
-void ComputeTables2();
-void ComputeTables3();
+// Rows st >= |reuse_st| of gdp must already be filled in, e.g. copied from the tables of a sequence
+// with the same suffix. Pass the sequence length to compute every row.
+void ComputeTables0(int reuse_st);
+void ComputeTables1(int reuse_st);
+void ComputeTables2(int reuse_st);
+void ComputeTables3(int reuse_st);
 void ComputeExterior();
 void Traceback();
 
@@ -63,6 +66,10 @@ struct index_t {
   }
 };
 
+// Traces back the substructure of |idx| in the tables into gp and gctd, leaving the rest of them
+// alone. An |en| of -1 means the exterior loop from |st|.
+void TracebackFrom(const index_t& idx);
+
 struct ctd_idx_t {
   ctd_idx_t() : idx(-1), ctd(CTD_NA) {}
   ctd_idx_t(int idx_, Ctd ctd_) : idx(int16_t(idx_)), ctd(ctd_) { assert(idx_ == idx); }
@@ -74,6 +81,39 @@ struct ctd_idx_t {
 
 typedef std::function<void(const computed_t&)> SuboptimalCallback;
 
+// A suboptimal structure, viewing the search state directly instead of copying it. Only valid for
+// the duration of the callback it is passed to. |db| is the dot bracket representation, and is
+// followed by a null terminator.
+struct subopt_view_t {
+  span_t<base_t> r;
+  span_t<int> p;
+  span_t<Ctd> base_ctds;
+  span_t<char> db;
+  energy_t energy;
+  // The StructureHash of the pairs and CTDs, which Suboptimal1 keeps up to date as it goes.
+  uint64_t hash;
+};
+
+typedef std::function<void(const subopt_view_t&)> SuboptimalViewCallback;
+
+// Limits for anytime suboptimal folding. Zero means no limit.
+struct suboptimal_budget_t {
+  int time_ms = 0;
+  int num_structures = 0;
+  // Memory for cached expansions, which is what grows as the enumeration goes deeper, including
+  // the index table of the cache. It can only run out if the cache limit is larger.
+  std::size_t memory_bytes = 0;
+};
+
+struct suboptimal_anytime_t {
+  int num_structures;
+  // Every structure with energy at most this was reported. It is below the MFE if the budget ran
+  // out before the MFE structures were all reported.
+  energy_t covered_energy;
+  // Whether every structure within the delta was reported, rather than the budget running out.
+  bool complete;
+};
+
 }
 }
 
@@ -28,11 +28,11 @@ using namespace energy;
     }                                                                    \
   } while (0)
 
-void ComputeTables0() {
+void ComputeTables0(int reuse_st) {
   const int N = int(gr.size());
   static_assert(
       HAIRPIN_MIN_SZ >= 2, "Minimum hairpin size >= 2 is relied upon in some expressions.");
-  for (int st = N - 1; st >= 0; --st) {
+  for (int st = std::min(N, reuse_st) - 1; st >= 0; --st) {
     for (int en = st + HAIRPIN_MIN_SZ + 1; en < N; ++en) {
       const base_t stb = gr[st], st1b = gr[st + 1], st2b = gr[st + 2], enb = gr[en],
           en1b = gr[en - 1], en2b = gr[en - 2];
@@ -40,14 +40,17 @@ void ComputeTables0() {
       // Update paired - only if can actually pair.
       if (ViableFoldingPair(st, en)) {
         const int max_inter = std::min(TWOLOOP_MAX_SZ, en - st - HAIRPIN_MIN_SZ - 3);
-        for (int ist = st + 1; ist < st + max_inter + 2; ++ist) {
-          for (int ien = en - max_inter + ist - st - 2; ien < en; ++ien) {
+        // Bases strictly between the outer and inner pairs must be allowed to be unpaired.
+        const int max_ist = std::min(st + max_inter + 1, gcons.next_must_pair[st + 1]);
+        for (int ist = st + 1; ist <= max_ist; ++ist) {
+          for (int ien = std::max(en - max_inter + ist - st - 2, gcons.prev_must_pair[en - 1]);
+               ien < en; ++ien) {
             if (gdp[ist][ien][DP_P] < CAP_E)
               UPDATE_CACHE(DP_P, gem.TwoLoop(gr, st, en, ist, ien) + gdp[ist][ien][DP_P]);
           }
         }
         // Hairpin loops.
-        UPDATE_CACHE(DP_P, gem.Hairpin(gr, st, en));
+        UPDATE_CACHE(DP_P, gem.Hairpin(gr, st, en) + gcons.Unpaired(st + 1, en - 1));
 
         // Multiloops. Look at range [st + 1, en - 1].
         // Cost for initiation + one branch. Include AU/GU penalty for ending multiloop helix.
@@ -57,14 +60,15 @@ void ComputeTables0() {
         // (<   ><   >)
         UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 1][en - 1][DP_U2]);
         // (3<   ><   >) 3'
-        UPDATE_CACHE(
-            DP_P, base_branch_cost + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb]);
+        UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 2][en - 1][DP_U2] +
+                gem.dangle3[stb][st1b][enb] + gcons.Unpaired(st + 1));
         // (<   ><   >5) 5'
-        UPDATE_CACHE(
-            DP_P, base_branch_cost + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb]);
+        UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 1][en - 2][DP_U2] +
+                gem.dangle5[stb][en1b][enb] + gcons.Unpaired(en - 1));
         // (.<   ><   >.) Terminal mismatch
-        UPDATE_CACHE(DP_P,
-            base_branch_cost + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb]);
+        UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 2][en - 2][DP_U2] +
+                gem.terminal[stb][st1b][en1b][enb] + gcons.Unpaired(st + 1) +
+                gcons.Unpaired(en - 1));
 
         for (int piv = st + HAIRPIN_MIN_SZ + 2; piv < en - HAIRPIN_MIN_SZ - 2; ++piv) {
           // Paired coaxial stacking cases:
@@ -73,7 +77,8 @@ void ComputeTables0() {
           // stb st1b st2b          pl1b  plb     prb  pr1b         en2b en1b enb
 
           // (.(   )   .) Left outer coax - P
-          const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb);
+          const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb) +
+              gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1);
           UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 2][piv][DP_P] + gem.multiloop_hack_b +
               gem.AuGuPenalty(st2b, plb) + gdp[piv + 1][en - 2][DP_U] + outer_coax);
           // (.   (   ).) Right outer coax
@@ -83,11 +88,13 @@ void ComputeTables0() {
           // (.(   ).   ) Left right coax
           UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 2][piv - 1][DP_P] + gem.multiloop_hack_b +
               gem.AuGuPenalty(st2b, pl1b) + gdp[piv + 1][en - 1][DP_U] +
-              gem.MismatchCoaxial(pl1b, plb, st1b, st2b));
+              gem.MismatchCoaxial(pl1b, plb, st1b, st2b) + gcons.Unpaired(st + 1) +
+              gcons.Unpaired(piv));
           // (   .(   ).) Right left coax
           UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 1][piv][DP_U] + gem.multiloop_hack_b +
               gem.AuGuPenalty(pr1b, en2b) + gdp[piv + 2][en - 2][DP_P] +
-              gem.MismatchCoaxial(en2b, en1b, prb, pr1b));
+              gem.MismatchCoaxial(en2b, en1b, prb, pr1b) + gcons.Unpaired(piv + 1) +
+              gcons.Unpaired(en - 1));
 
           // ((   )   ) Left flush coax
           UPDATE_CACHE(DP_P, base_branch_cost + gdp[st + 1][piv][DP_P] + gem.multiloop_hack_b +
@@ -103,8 +110,8 @@ void ComputeTables0() {
       // Update unpaired.
       // Choose |st| to be unpaired.
       if (st + 1 < en) {
-        UPDATE_CACHE(DP_U, gdp[st + 1][en][DP_U]);
-        UPDATE_CACHE(DP_U2, gdp[st + 1][en][DP_U2]);
+        UPDATE_CACHE(DP_U, gdp[st + 1][en][DP_U] + gcons.Unpaired(st));
+        UPDATE_CACHE(DP_U2, gdp[st + 1][en][DP_U2] + gcons.Unpaired(st));
       }
       // Pair here.
       for (int piv = st + HAIRPIN_MIN_SZ + 1; piv <= en; ++piv) {
@@ -113,14 +120,15 @@ void ComputeTables0() {
         const auto pb = gr[piv], pl1b = gr[piv - 1];
         // baseAB indicates A bases left unpaired on the left, B bases left unpaired on the right.
         const auto base00 = gdp[st][piv][DP_P] + gem.AuGuPenalty(stb, pb) + gem.multiloop_hack_b;
-        const auto base01 =
-            gdp[st][piv - 1][DP_P] + gem.AuGuPenalty(stb, pl1b) + gem.multiloop_hack_b;
-        const auto base10 =
-            gdp[st + 1][piv][DP_P] + gem.AuGuPenalty(st1b, pb) + gem.multiloop_hack_b;
-        const auto base11 =
-            gdp[st + 1][piv - 1][DP_P] + gem.AuGuPenalty(st1b, pl1b) + gem.multiloop_hack_b;
+        const auto base01 = gdp[st][piv - 1][DP_P] + gem.AuGuPenalty(stb, pl1b) +
+            gem.multiloop_hack_b + gcons.Unpaired(piv);
+        const auto base10 = gdp[st + 1][piv][DP_P] + gem.AuGuPenalty(st1b, pb) +
+            gem.multiloop_hack_b + gcons.Unpaired(st);
+        const auto base11 = gdp[st + 1][piv - 1][DP_P] + gem.AuGuPenalty(st1b, pl1b) +
+            gem.multiloop_hack_b + gcons.Unpaired(st) + gcons.Unpaired(piv);
         // Min is for either placing another unpaired or leaving it as nothing.
-        const auto right_unpaired = std::min(gdp[piv + 1][en][DP_U], 0);
+        const auto right_unpaired =
+            std::min(gdp[piv + 1][en][DP_U], gcons.Unpaired(piv + 1, en));
 
         // (   )<   > - U, U_WC?, U_GU?
         UPDATE_CACHE(DP_U2, base00 + gdp[piv + 1][en][DP_U]);
@@ -20,7 +20,7 @@ namespace internal {
 
 using namespace energy;
 
-void ComputeTables2() {
+void ComputeTables2(int reuse_st) {
   const int N = int(gr.size());
   static_assert(
       HAIRPIN_MIN_SZ >= 2, "Minimum hairpin size >= 2 is relied upon in some expressions.");
@@ -37,20 +37,24 @@ void ComputeTables2() {
       energy_t mins[] = {MAX_E, MAX_E, MAX_E, MAX_E, MAX_E, MAX_E};
       static_assert(sizeof(mins) / sizeof(mins[0]) == DP_SIZE, "array wrong size");
 
-      // Update paired - only if can actually pair.
-      if (ViableFoldingPair(st, en)) {
+      // Update paired - only if can actually pair. Reused rows still need to build their
+      // candidate lists, but their paired values are already known.
+      if (st < reuse_st && ViableFoldingPair(st, en)) {
         const int max_inter = std::min(TWOLOOP_MAX_SZ, en - st - HAIRPIN_MIN_SZ - 3);
         mins[DP_P] =
             std::min(mins[DP_P], gem.stack[stb][st1b][en1b][enb] + gdp[st + 1][en - 1][DP_P]);
-        for (int ist = st + 1; ist < st + max_inter + 2; ++ist) {
-          for (int ien = en - max_inter + ist - st - 2; ien < en; ++ien) {
+        // Bases strictly between the outer and inner pairs must be allowed to be unpaired.
+        const int max_ist = std::min(st + max_inter + 1, gcons.next_must_pair[st + 1]);
+        for (int ist = st + 1; ist <= max_ist; ++ist) {
+          for (int ien = std::max(en - max_inter + ist - st - 2, gcons.prev_must_pair[en - 1]);
+               ien < en; ++ien) {
             if (gdp[ist][ien][DP_P] < mins[DP_P] - gpc.min_twoloop_not_stack)
               mins[DP_P] =
                   std::min(mins[DP_P], FastTwoLoop(st, en, ist, ien) + gdp[ist][ien][DP_P]);
           }
         }
         // Hairpin loops.
-        mins[DP_P] = std::min(mins[DP_P], FastHairpin(st, en));
+        mins[DP_P] = std::min(mins[DP_P], FastHairpin(st, en) + gcons.Unpaired(st + 1, en - 1));
 
         // Cost for initiation + one branch. Include AU/GU penalty for ending multiloop helix.
         const auto base_branch_cost = gpc.augubranch[stb][enb] + gem.multiloop_hack_a;
@@ -58,21 +62,23 @@ void ComputeTables2() {
         // (<   ><   >)
         mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 1][en - 1][DP_U2]);
         // (3<   ><   >) 3'
-        mins[DP_P] = std::min(mins[DP_P],
-            base_branch_cost + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb]);
+        mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 2][en - 1][DP_U2] +
+                gem.dangle3[stb][st1b][enb] + gcons.Unpaired(st + 1));
         // (<   ><   >5) 5'
-        mins[DP_P] = std::min(mins[DP_P],
-            base_branch_cost + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb]);
+        mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 1][en - 2][DP_U2] +
+                gem.dangle5[stb][en1b][enb] + gcons.Unpaired(en - 1));
         // (.<   ><   >.) Terminal mismatch
-        mins[DP_P] = std::min(mins[DP_P],
-            base_branch_cost + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb]);
+        mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 2][en - 2][DP_U2] +
+                gem.terminal[stb][st1b][en1b][enb] + gcons.Unpaired(st + 1) +
+                gcons.Unpaired(en - 1));
 
         // (.(   ).   ) Left right coax
         for (auto cand : cand_st[CAND_P_MISMATCH])
           mins[DP_P] = std::min(
               mins[DP_P], base_branch_cost + cand.energy + gdp[cand.idx + 1][en - 1][DP_U]);
         // (.(   )   .) Left outer coax
-        const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb);
+        const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb) +
+            gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1);
         for (auto cand : cand_st[CAND_P_OUTER])
           mins[DP_P] = std::min(mins[DP_P], base_branch_cost + cand.energy - gpc.min_mismatch_coax +
               outer_coax + gdp[cand.idx + 1][en - 2][DP_U]);
@@ -98,11 +104,12 @@ void ComputeTables2() {
       // Update unpaired.
       // Choose |st| to be unpaired.
       if (st + 1 < en) {
-        mins[DP_U] = std::min(mins[DP_U], gdp[st + 1][en][DP_U]);
-        mins[DP_U2] = std::min(mins[DP_U2], gdp[st + 1][en][DP_U2]);
+        mins[DP_U] = std::min(mins[DP_U], gdp[st + 1][en][DP_U] + gcons.Unpaired(st));
+        mins[DP_U2] = std::min(mins[DP_U2], gdp[st + 1][en][DP_U2] + gcons.Unpaired(st));
       }
       for (auto cand : cand_st[CAND_U]) {
-        mins[DP_U] = std::min(mins[DP_U], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U] = std::min(mins[DP_U], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
         mins[DP_U2] = std::min(mins[DP_U2], cand.energy + gdp[cand.idx + 1][en][DP_U]);
       }
       for (auto cand : cand_st[CAND_U_LCOAX]) {
@@ -128,16 +135,16 @@ void ComputeTables2() {
         mins[DP_U2] = std::min(mins[DP_U2], val);
       }
       for (auto cand : cand_st[CAND_U_WC])
-        mins[DP_U_WC] =
-            std::min(mins[DP_U_WC], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U_WC] = std::min(mins[DP_U_WC], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
       for (auto cand : cand_st[CAND_U_GU])
-        mins[DP_U_GU] =
-            std::min(mins[DP_U_GU], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U_GU] = std::min(mins[DP_U_GU], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
       for (auto cand : cand_st[CAND_U_RCOAX]) {
         // (   ).<( * ). > Right coax backward
         assert(st > 0);
-        mins[DP_U_RCOAX] =
-            std::min(mins[DP_U_RCOAX], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U_RCOAX] = std::min(mins[DP_U_RCOAX], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
       }
 
       // Set these so we can use sparse folding.
@@ -188,28 +195,28 @@ void ComputeTables2() {
       // the right part of the pivot is the same (from the same array).
       // Can only apply monotonicity optimisation to ones ending with min(U, 0).
       // (   ). - 3' - U, U2
-      const auto dangle3_base =
-          gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] + gem.dangle3[en1b][enb][stb];
+      const auto dangle3_base = gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] +
+          gem.dangle3[en1b][enb][stb] + gcons.Unpaired(en);
       if (dangle3_base < gdp[st][en][DP_U] && dangle3_base < cand_st_mins[CAND_U])
         cand_st_mins[CAND_U] = dangle3_base;
       // .(   ) - 5' - U, U2
-      const auto dangle5_base =
-          gdp[st + 1][en][DP_P] + gpc.augubranch[st1b][enb] + gem.dangle5[enb][stb][st1b];
+      const auto dangle5_base = gdp[st + 1][en][DP_P] + gpc.augubranch[st1b][enb] +
+          gem.dangle5[enb][stb][st1b] + gcons.Unpaired(st);
       if (dangle5_base < gdp[st][en][DP_U] && dangle5_base < cand_st_mins[CAND_U])
         cand_st_mins[CAND_U] = dangle5_base;
       // .(   ). - Terminal mismatch - U, U2
       const auto terminal_base = gdp[st + 1][en - 1][DP_P] + gpc.augubranch[st1b][en1b] +
-          gem.terminal[en1b][enb][stb][st1b];
+          gem.terminal[en1b][enb][stb][st1b] + gcons.Unpaired(st) + gcons.Unpaired(en);
       if (terminal_base < gdp[st][en][DP_U] && terminal_base < cand_st_mins[CAND_U])
         cand_st_mins[CAND_U] = terminal_base;
       // .(   ).<(   ) > - Left coax - U, U2
       const auto lcoax_base = gdp[st + 1][en - 1][DP_P] + gpc.augubranch[st1b][en1b] +
-          gem.MismatchCoaxial(en1b, enb, stb, st1b);
+          gem.MismatchCoaxial(en1b, enb, stb, st1b) + gcons.Unpaired(st) + gcons.Unpaired(en);
       if (lcoax_base < CAP_E && lcoax_base < gdp[st][en][DP_U])
         cand_st[CAND_U_LCOAX].push_back({lcoax_base, en});
       // (   ).<(   ). > Right coax forward - U, U2
-      const auto rcoaxf_base =
-          gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] + gpc.min_mismatch_coax;
+      const auto rcoaxf_base = gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] +
+          gpc.min_mismatch_coax + gcons.Unpaired(en);
       if (rcoaxf_base < CAP_E && rcoaxf_base < gdp[st][en][DP_U])
         cand_st[CAND_U_RCOAX_FWD].push_back({rcoaxf_base, en});
 
@@ -218,7 +225,7 @@ void ComputeTables2() {
       // itself.
       if (st > 0) {
         const auto rcoaxb_base = gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] +
-            gem.MismatchCoaxial(en1b, enb, gr[st - 1], stb);
+            gem.MismatchCoaxial(en1b, enb, gr[st - 1], stb) + gcons.Unpaired(en);
         if (rcoaxb_base < gdp[st][en][DP_U_RCOAX] && rcoaxb_base < cand_st_mins[CAND_U_RCOAX])
           cand_st_mins[CAND_U_RCOAX] = rcoaxb_base;
         // Base case.
@@ -250,23 +257,23 @@ void ComputeTables2() {
       // (.(   )   .) Left outer coax - P
       // Since we assumed the minimum energy coax stack and made this structure self contained,
       // we could potentially replace it with U[st + 1][en].
-      const auto plocoax_base =
-          gdp[st + 2][en][DP_P] + gpc.augubranch[st2b][enb] + gpc.min_mismatch_coax;
+      const auto plocoax_base = gdp[st + 2][en][DP_P] + gpc.augubranch[st2b][enb] +
+          gpc.min_mismatch_coax + gcons.Unpaired(st + 1);
       if (plocoax_base < CAP_E && plocoax_base < gdp[st + 1][en][DP_U])
         cand_st[CAND_P_OUTER].push_back({plocoax_base, en});
       // (.   (   ).) Right outer coax
-      const auto procoax_base =
-          gdp[st][en - 2][DP_P] + gpc.augubranch[stb][en2b] + gpc.min_mismatch_coax;
+      const auto procoax_base = gdp[st][en - 2][DP_P] + gpc.augubranch[stb][en2b] +
+          gpc.min_mismatch_coax + gcons.Unpaired(en - 1);
       if (procoax_base < CAP_E && procoax_base < gdp[st][en - 1][DP_U])
         p_cand_en[CAND_EN_P_OUTER][en].push_back({procoax_base, st});
       // (.(   ).   ) Left right coax
       const auto plrcoax_base = gdp[st + 2][en - 1][DP_P] + gpc.augubranch[st2b][en1b] +
-          gem.MismatchCoaxial(en1b, enb, st1b, st2b);
+          gem.MismatchCoaxial(en1b, enb, st1b, st2b) + gcons.Unpaired(st + 1) + gcons.Unpaired(en);
       if (plrcoax_base < CAP_E && plrcoax_base < gdp[st + 1][en][DP_U])
         cand_st[CAND_P_MISMATCH].push_back({plrcoax_base, en});
       // (   .(   ).) Right left coax
       const auto prlcoax_base = gdp[st + 1][en - 2][DP_P] + gpc.augubranch[st1b][en2b] +
-          gem.MismatchCoaxial(en2b, en1b, stb, st1b);
+          gem.MismatchCoaxial(en2b, en1b, stb, st1b) + gcons.Unpaired(st) + gcons.Unpaired(en - 1);
       if (prlcoax_base < CAP_E && prlcoax_base < gdp[st][en - 1][DP_U])
         p_cand_en[CAND_EN_P_MISMATCH][en].push_back({prlcoax_base, st});
       // ((   )   ) Left flush coax
@@ -280,10 +287,12 @@ void ComputeTables2() {
       if (prfcoax_base < CAP_E && prfcoax_base < gdp[st][en - 1][DP_U])
         p_cand_en[CAND_EN_P_FLUSH][en].push_back({prfcoax_base, st});
 
-      // Add potentials to the candidate lists.
+      // Add potentials to the candidate lists. A worse candidate can only be dropped if the bases
+      // between it and the previous candidate are allowed to be unpaired.
       for (int i = 0; i < CAND_SIZE; ++i) {
         if (cand_st_mins[i] < CAP_E &&
-            (cand_st[i].empty() || cand_st_mins[i] < cand_st[i].back().energy))
+            (cand_st[i].empty() || cand_st_mins[i] < cand_st[i].back().energy ||
+                !gcons.CanUnpair(cand_st[i].back().idx + 1, en)))
           cand_st[i].push_back({cand_st_mins[i], en});
       }
     }
@@ -20,7 +20,7 @@ namespace internal {
 
 using namespace energy;
 
-void ComputeTables3() {
+void ComputeTables3(int reuse_st) {
   const int N = int(gr.size());
   static_assert(
       HAIRPIN_MIN_SZ >= 3, "Minimum hairpin size >= 3 is relied upon in some expressions.");
@@ -43,62 +43,69 @@ void ComputeTables3() {
       for (int l = 0; l <= max_inter; ++l) {
         // Don't add asymmetry here
         if (l >= 2)
-          lyngso[st][en][l] = std::min(lyngso[st][en][l],
-              lyngso[st + 1][en - 1][l - 2] - gem.internal_init[l - 2] + gem.internal_init[l]);
+          lyngso[st][en][l] = std::min(lyngso[st][en][l], lyngso[st + 1][en - 1][l - 2] -
+                  gem.internal_init[l - 2] + gem.internal_init[l] + gcons.Unpaired(st) +
+                  gcons.Unpaired(en));
 
         // Add asymmetry here, on left and right
         auto val = std::min(l * gem.internal_asym, NINIO_MAX_ASYM) + gem.internal_init[l];
         lyngso[st][en][l] =
             std::min(lyngso[st][en][l], gem.InternalLoopAuGuPenalty(gr[st + l + 1], en1b) +
                 gem.internal_other_mismatch[en1b][enb][gr[st + l]][gr[st + l + 1]] + val +
-                gdp[st + l + 1][en - 1][DP_P]);
+                gdp[st + l + 1][en - 1][DP_P] + gcons.Unpaired(st, st + l) + gcons.Unpaired(en));
         lyngso[st][en][l] =
             std::min(lyngso[st][en][l], gem.InternalLoopAuGuPenalty(st1b, gr[en - l - 1]) +
                 gem.internal_other_mismatch[gr[en - l - 1]][gr[en - l]][stb][st1b] + val +
-                gdp[st + 1][en - l - 1][DP_P]);
+                gdp[st + 1][en - l - 1][DP_P] + gcons.Unpaired(st) + gcons.Unpaired(en - l, en));
       }
 
-      // Update paired - only if can actually pair.
-      if (ViableFoldingPair(st, en)) {
+      // Update paired - only if can actually pair. Reused rows still need to build their
+      // candidate lists, but their paired values are already known.
+      if (st < reuse_st && ViableFoldingPair(st, en)) {
         // Stacking
         mins[DP_P] =
             std::min(mins[DP_P], gem.stack[stb][st1b][en1b][enb] + gdp[st + 1][en - 1][DP_P]);
         // Bulge
         for (int isz = 1; isz <= max_inter; ++isz) {
-          mins[DP_P] = std::min(mins[DP_P],
-              gem.Bulge(gr, st, en, st + 1 + isz, en - 1) + gdp[st + 1 + isz][en - 1][DP_P]);
-          mins[DP_P] = std::min(mins[DP_P],
-              gem.Bulge(gr, st, en, st + 1, en - 1 - isz) + gdp[st + 1][en - 1 - isz][DP_P]);
+          mins[DP_P] = std::min(mins[DP_P], gem.Bulge(gr, st, en, st + 1 + isz, en - 1) +
+                  gdp[st + 1 + isz][en - 1][DP_P] + gcons.Unpaired(st + 1, st + isz));
+          mins[DP_P] = std::min(mins[DP_P], gem.Bulge(gr, st, en, st + 1, en - 1 - isz) +
+                  gdp[st + 1][en - 1 - isz][DP_P] + gcons.Unpaired(en - isz, en - 1));
         }
 
         // Ax1 internal loops. Make sure to skip 0x1, 1x1, 2x1, and 1x2 loops, since they have
         // special energies.
         static_assert(EnergyModel::INITIATION_CACHE_SZ > TWOLOOP_MAX_SZ,
             "need initiation cached up to TWOLOOP_MAX_SZ");
-        auto base_internal_loop = gem.InternalLoopAuGuPenalty(stb, enb);
+        // All internal loops, excluding the special cased ones, leave st + 1 and en - 1 unpaired.
+        auto base_internal_loop = gem.InternalLoopAuGuPenalty(stb, enb) + gcons.Unpaired(st + 1) +
+            gcons.Unpaired(en - 1);
         for (int isz = 4; isz <= max_inter; ++isz) {
           auto val = base_internal_loop + gem.internal_init[isz] +
               std::min((isz - 2) * gem.internal_asym, NINIO_MAX_ASYM);
-          mins[DP_P] = std::min(mins[DP_P],
-              val + gem.InternalLoopAuGuPenalty(gr[st + isz], en2b) + gdp[st + isz][en - 2][DP_P]);
-          mins[DP_P] = std::min(mins[DP_P],
-              val + gem.InternalLoopAuGuPenalty(st2b, gr[en - isz]) + gdp[st + 2][en - isz][DP_P]);
+          mins[DP_P] = std::min(mins[DP_P], val + gem.InternalLoopAuGuPenalty(gr[st + isz], en2b) +
+                  gdp[st + isz][en - 2][DP_P] + gcons.Unpaired(st + 2, st + isz - 1));
+          mins[DP_P] = std::min(mins[DP_P], val + gem.InternalLoopAuGuPenalty(st2b, gr[en - isz]) +
+                  gdp[st + 2][en - isz][DP_P] + gcons.Unpaired(en - isz + 1, en - 2));
         }
 
         // Internal loop cases. Since we require HAIRPIN_MIN_SZ >= 3 and initialise arr to MAX_E, we
         // don't need ifs
         // here.
-        mins[DP_P] = std::min(mins[DP_P],
-            gem.internal_1x1[stb][st1b][st2b][en2b][en1b][enb] + gdp[st + 2][en - 2][DP_P]);
+        mins[DP_P] = std::min(mins[DP_P], gem.internal_1x1[stb][st1b][st2b][en2b][en1b][enb] +
+                gdp[st + 2][en - 2][DP_P] + gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1));
         mins[DP_P] =
             std::min(mins[DP_P], gem.internal_1x2[stb][st1b][st2b][gr[en - 3]][en2b][en1b][enb] +
-                gdp[st + 2][en - 3][DP_P]);
+                gdp[st + 2][en - 3][DP_P] + gcons.Unpaired(st + 1) +
+                gcons.Unpaired(en - 2, en - 1));
         mins[DP_P] =
             std::min(mins[DP_P], gem.internal_1x2[en2b][en1b][enb][stb][st1b][st2b][gr[st + 3]] +
-                gdp[st + 3][en - 2][DP_P]);
+                gdp[st + 3][en - 2][DP_P] + gcons.Unpaired(st + 1, st + 2) +
+                gcons.Unpaired(en - 1));
         mins[DP_P] = std::min(
             mins[DP_P], gem.internal_2x2[stb][st1b][st2b][gr[st + 3]][gr[en - 3]][en2b][en1b][enb] +
-                gdp[st + 3][en - 3][DP_P]);
+                gdp[st + 3][en - 3][DP_P] + gcons.Unpaired(st + 1, st + 2) +
+                gcons.Unpaired(en - 2, en - 1));
 
         // 2x3 and 3x2 loops
         const auto two_by_three = base_internal_loop + gem.internal_init[5] +
@@ -107,11 +114,11 @@ void ComputeTables3() {
         mins[DP_P] = std::min(mins[DP_P], two_by_three +
             gem.InternalLoopAuGuPenalty(gr[st + 3], gr[en - 4]) +
             gem.internal_2x3_mismatch[gr[en - 4]][gr[en - 3]][st2b][gr[st + 3]] +
-            gdp[st + 3][en - 4][DP_P]);
+            gdp[st + 3][en - 4][DP_P] + gcons.Unpaired(st + 2) + gcons.Unpaired(en - 3, en - 2));
         mins[DP_P] = std::min(mins[DP_P], two_by_three +
             gem.InternalLoopAuGuPenalty(gr[st + 4], gr[en - 3]) +
             gem.internal_2x3_mismatch[gr[en - 3]][gr[en - 2]][gr[st + 3]][gr[st + 4]] +
-            gdp[st + 4][en - 3][DP_P]);
+            gdp[st + 4][en - 3][DP_P] + gcons.Unpaired(st + 2, st + 3) + gcons.Unpaired(en - 2));
 
         // For the rest of the loops we need to apply the "other" type mismatches.
         base_internal_loop += gem.internal_other_mismatch[stb][st1b][en1b][enb];
@@ -122,27 +129,29 @@ void ComputeTables3() {
               gem.internal_init[l - 4] + gem.internal_init[l] + base_internal_loop);
 
         // Hairpin loops.
-        mins[DP_P] = std::min(mins[DP_P], FastHairpin(st, en));
+        mins[DP_P] = std::min(mins[DP_P], FastHairpin(st, en) + gcons.Unpaired(st + 1, en - 1));
 
         const auto base_branch_cost = gpc.augubranch[stb][enb] + gem.multiloop_hack_a;
         // (<   ><   >)
         mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 1][en - 1][DP_U2]);
         // (3<   ><   >) 3'
-        mins[DP_P] = std::min(mins[DP_P],
-            base_branch_cost + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb]);
+        mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 2][en - 1][DP_U2] +
+                gem.dangle3[stb][st1b][enb] + gcons.Unpaired(st + 1));
         // (<   ><   >5) 5'
-        mins[DP_P] = std::min(mins[DP_P],
-            base_branch_cost + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb]);
+        mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 1][en - 2][DP_U2] +
+                gem.dangle5[stb][en1b][enb] + gcons.Unpaired(en - 1));
         // (.<   ><   >.) Terminal mismatch
-        mins[DP_P] = std::min(mins[DP_P],
-            base_branch_cost + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb]);
+        mins[DP_P] = std::min(mins[DP_P], base_branch_cost + gdp[st + 2][en - 2][DP_U2] +
+                gem.terminal[stb][st1b][en1b][enb] + gcons.Unpaired(st + 1) +
+                gcons.Unpaired(en - 1));
 
         // (.(   ).   ) Left right coax
         for (auto cand : cand_st[CAND_P_MISMATCH])
           mins[DP_P] = std::min(
               mins[DP_P], base_branch_cost + cand.energy + gdp[cand.idx + 1][en - 1][DP_U]);
         // (.(   )   .) Left outer coax
-        const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb);
+        const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb) +
+            gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1);
         for (auto cand : cand_st[CAND_P_OUTER])
           mins[DP_P] = std::min(mins[DP_P], base_branch_cost + cand.energy - gpc.min_mismatch_coax +
               outer_coax + gdp[cand.idx + 1][en - 2][DP_U]);
@@ -169,11 +178,12 @@ void ComputeTables3() {
       // Update unpaired.
       // Choose |st| to be unpaired.
       if (st + 1 < en) {
-        mins[DP_U] = std::min(mins[DP_U], gdp[st + 1][en][DP_U]);
-        mins[DP_U2] = std::min(mins[DP_U2], gdp[st + 1][en][DP_U2]);
+        mins[DP_U] = std::min(mins[DP_U], gdp[st + 1][en][DP_U] + gcons.Unpaired(st));
+        mins[DP_U2] = std::min(mins[DP_U2], gdp[st + 1][en][DP_U2] + gcons.Unpaired(st));
       }
       for (auto cand : cand_st[CAND_U]) {
-        mins[DP_U] = std::min(mins[DP_U], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U] = std::min(mins[DP_U], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
         mins[DP_U2] = std::min(mins[DP_U2], cand.energy + gdp[cand.idx + 1][en][DP_U]);
       }
       for (auto cand : cand_st[CAND_U_LCOAX]) {
@@ -199,16 +209,16 @@ void ComputeTables3() {
         mins[DP_U2] = std::min(mins[DP_U2], val);
       }
       for (auto cand : cand_st[CAND_U_WC])
-        mins[DP_U_WC] =
-            std::min(mins[DP_U_WC], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U_WC] = std::min(mins[DP_U_WC], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
       for (auto cand : cand_st[CAND_U_GU])
-        mins[DP_U_GU] =
-            std::min(mins[DP_U_GU], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U_GU] = std::min(mins[DP_U_GU], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
       for (auto cand : cand_st[CAND_U_RCOAX]) {
         // (   ).<( * ). > Right coax backward
         assert(st > 0);
-        mins[DP_U_RCOAX] =
-            std::min(mins[DP_U_RCOAX], cand.energy + std::min(gdp[cand.idx + 1][en][DP_U], 0));
+        mins[DP_U_RCOAX] = std::min(mins[DP_U_RCOAX], cand.energy +
+                std::min(gdp[cand.idx + 1][en][DP_U], gcons.Unpaired(cand.idx + 1, en)));
       }
 
       gdp[st][en][DP_U] = mins[DP_U];
@@ -240,33 +250,33 @@ void ComputeTables3() {
       }
 
       // (   ). - 3' - U, U2
-      const auto dangle3_base =
-          gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] + gem.dangle3[en1b][enb][stb];
+      const auto dangle3_base = gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] +
+          gem.dangle3[en1b][enb][stb] + gcons.Unpaired(en);
       if (dangle3_base < gdp[st][en][DP_U] && dangle3_base < cand_st_mins[CAND_U])
         cand_st_mins[CAND_U] = dangle3_base;
       // .(   ) - 5' - U, U2
-      const auto dangle5_base =
-          gdp[st + 1][en][DP_P] + gpc.augubranch[st1b][enb] + gem.dangle5[enb][stb][st1b];
+      const auto dangle5_base = gdp[st + 1][en][DP_P] + gpc.augubranch[st1b][enb] +
+          gem.dangle5[enb][stb][st1b] + gcons.Unpaired(st);
       if (dangle5_base < gdp[st][en][DP_U] && dangle5_base < cand_st_mins[CAND_U])
         cand_st_mins[CAND_U] = dangle5_base;
       // .(   ). - Terminal mismatch - U, U2
       const auto terminal_base = gdp[st + 1][en - 1][DP_P] + gpc.augubranch[st1b][en1b] +
-          gem.terminal[en1b][enb][stb][st1b];
+          gem.terminal[en1b][enb][stb][st1b] + gcons.Unpaired(st) + gcons.Unpaired(en);
       if (terminal_base < gdp[st][en][DP_U] && terminal_base < cand_st_mins[CAND_U])
         cand_st_mins[CAND_U] = terminal_base;
       // .(   ).<(   ) > - Left coax - U, U2
       const auto lcoax_base = gdp[st + 1][en - 1][DP_P] + gpc.augubranch[st1b][en1b] +
-          gem.MismatchCoaxial(en1b, enb, stb, st1b);
+          gem.MismatchCoaxial(en1b, enb, stb, st1b) + gcons.Unpaired(st) + gcons.Unpaired(en);
       if (lcoax_base < gdp[st][en][DP_U]) cand_st[CAND_U_LCOAX].push_back({lcoax_base, en});
       // (   ).<(   ). > Right coax forward - U, U2
-      const auto rcoaxf_base =
-          gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] + gpc.min_mismatch_coax;
+      const auto rcoaxf_base = gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] +
+          gpc.min_mismatch_coax + gcons.Unpaired(en);
       if (rcoaxf_base < gdp[st][en][DP_U]) cand_st[CAND_U_RCOAX_FWD].push_back({rcoaxf_base, en});
 
       // (   ).<( * ). > Right coax backward - RCOAX
       if (st > 0) {
         const auto rcoaxb_base = gdp[st][en - 1][DP_P] + gpc.augubranch[stb][en1b] +
-            gem.MismatchCoaxial(en1b, enb, gr[st - 1], stb);
+            gem.MismatchCoaxial(en1b, enb, gr[st - 1], stb) + gcons.Unpaired(en);
         if (rcoaxb_base < gdp[st][en][DP_U_RCOAX] && rcoaxb_base < cand_st_mins[CAND_U_RCOAX])
           cand_st_mins[CAND_U_RCOAX] = rcoaxb_base;
         // Base case.
@@ -296,22 +306,22 @@ void ComputeTables3() {
 
       // Paired cases
       // (.(   )   .) Left outer coax - P
-      const auto plocoax_base =
-          gdp[st + 2][en][DP_P] + gpc.augubranch[st2b][enb] + gpc.min_mismatch_coax;
+      const auto plocoax_base = gdp[st + 2][en][DP_P] + gpc.augubranch[st2b][enb] +
+          gpc.min_mismatch_coax + gcons.Unpaired(st + 1);
       if (plocoax_base < gdp[st + 1][en][DP_U]) cand_st[CAND_P_OUTER].push_back({plocoax_base, en});
       // (.   (   ).) Right outer coax
-      const auto procoax_base =
-          gdp[st][en - 2][DP_P] + gpc.augubranch[stb][en2b] + gpc.min_mismatch_coax;
+      const auto procoax_base = gdp[st][en - 2][DP_P] + gpc.augubranch[stb][en2b] +
+          gpc.min_mismatch_coax + gcons.Unpaired(en - 1);
       if (procoax_base < gdp[st][en - 1][DP_U])
         p_cand_en[CAND_EN_P_OUTER][en].push_back({procoax_base, st});
       // (.(   ).   ) Left right coax
       const auto plrcoax_base = gdp[st + 2][en - 1][DP_P] + gpc.augubranch[st2b][en1b] +
-          gem.MismatchCoaxial(en1b, enb, st1b, st2b);
+          gem.MismatchCoaxial(en1b, enb, st1b, st2b) + gcons.Unpaired(st + 1) + gcons.Unpaired(en);
       if (plrcoax_base < gdp[st + 1][en][DP_U])
         cand_st[CAND_P_MISMATCH].push_back({plrcoax_base, en});
       // (   .(   ).) Right left coax
       const auto prlcoax_base = gdp[st + 1][en - 2][DP_P] + gpc.augubranch[st1b][en2b] +
-          gem.MismatchCoaxial(en2b, en1b, stb, st1b);
+          gem.MismatchCoaxial(en2b, en1b, stb, st1b) + gcons.Unpaired(st) + gcons.Unpaired(en - 1);
       if (prlcoax_base < gdp[st][en - 1][DP_U])
         p_cand_en[CAND_EN_P_MISMATCH][en].push_back({prlcoax_base, st});
       // ((   )   ) Left flush coax
@@ -327,7 +337,8 @@ void ComputeTables3() {
       // Add potentials to the candidate lists.
       for (int i = 0; i < CAND_SIZE; ++i) {
         if (cand_st_mins[i] < CAP_E &&
-            (cand_st[i].empty() || cand_st_mins[i] < cand_st[i].back().energy))
+            (cand_st[i].empty() || cand_st_mins[i] < cand_st[i].back().energy ||
+                !gcons.CanUnpair(cand_st[i].back().idx + 1, en)))
           cand_st[i].push_back({cand_st_mins[i], en});
       }
     }
@@ -0,0 +1,155 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <fstream>
+#include "fold/fold_cache.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+// Only the options which can change the result of a fold. The suboptimal algorithm doesn't.
+std::string OptionsToString(const context_options_t& options) {
+  std::string s = std::to_string(int(options.table_alg));
+  for (const auto& pair : options.constraints.forced_pairs)
+    s += sfmt(",p%d-%d", pair.first, pair.second);
+  for (auto i : options.constraints.forced_unpaired)
+    s += sfmt(",u%d", i);
+  for (const auto& range : options.constraints.forbidden_ranges)
+    s += sfmt(",r%d-%d", range.first, range.second);
+  return s;
+}
+}
+
+std::size_t FoldCache::key_hash_t::operator()(const key_t& key) const {
+  return Crc32(key.primary) ^ (std::size_t(key.model_checksum) << 1) ^
+      std::hash<std::string>()(key.options);
+}
+
+FoldCache::FoldCache(std::size_t max_entries_)
+    : max_entries(max_entries_), hits(0), misses(0), evictions(0) {
+  verify_expr(max_entries > 0, "fold cache must have at least one entry");
+}
+
+FoldCache::key_t FoldCache::MakeKey(
+    const primary_t& r, uint32_t model_checksum, const context_options_t& options) {
+  return {parsing::PrimaryToString(r), model_checksum, OptionsToString(options)};
+}
+
+computed_t FoldCache::Fold(
+    const primary_t& r, const energy::EnergyModelPtr em, const context_options_t& options) {
+  const auto checksum = em->Checksum();
+  computed_t computed;
+  if (Lookup(r, checksum, options, computed)) return computed;
+  {
+    std::lock_guard<std::mutex> guard(fold_lock);
+    computed = Context(r, em, options).Fold();
+  }
+  Insert(r, checksum, options, computed);
+  return computed;
+}
+
+bool FoldCache::Lookup(const primary_t& r, uint32_t model_checksum,
+    const context_options_t& options, computed_t& computed) {
+  const auto key = MakeKey(r, model_checksum, options);
+  std::lock_guard<std::mutex> guard(lock);
+  auto iter = index.find(key);
+  if (iter == index.end()) {
+    ++misses;
+    return false;
+  }
+  ++hits;
+  lru.splice(lru.begin(), lru, iter->second);
+  computed = computed_t(iter->second->second);
+  return true;
+}
+
+void FoldCache::Insert(const primary_t& r, uint32_t model_checksum,
+    const context_options_t& options, const computed_t& computed) {
+  auto key = MakeKey(r, model_checksum, options);
+  std::lock_guard<std::mutex> guard(lock);
+  InsertLocked(std::move(key), computed);
+}
+
+void FoldCache::InsertLocked(key_t key, const computed_t& computed) {
+  auto iter = index.find(key);
+  if (iter != index.end()) {
+    iter->second->second = computed_t(computed);
+    lru.splice(lru.begin(), lru, iter->second);
+    return;
+  }
+  lru.emplace_front(std::move(key), computed);
+  index.emplace(lru.front().first, lru.begin());
+  if (lru.size() > max_entries) {
+    index.erase(lru.back().first);
+    lru.pop_back();
+    ++evictions;
+  }
+}
+
+void FoldCache::Save(const std::string& filename) const {
+  std::ofstream out(filename);
+  verify_expr(out.good(), "could not open %s for writing", filename.c_str());
+  std::lock_guard<std::mutex> guard(lock);
+  // Format: checksum options energy primary pairs ctds - one entry per line.
+  for (auto iter = lru.rbegin(); iter != lru.rend(); ++iter) {
+    const auto& key = iter->first;
+    const auto& computed = iter->second;
+    std::string ctds(computed.base_ctds.size(), 'a');
+    for (int i = 0; i < int(ctds.size()); ++i)
+      ctds[i] = char('a' + computed.base_ctds[i]);
+    out << key.model_checksum << ' ' << key.options << ' ' << computed.energy << ' '
+        << key.primary << ' ' << parsing::PairsToDotBracket(computed.s.p) << ' ' << ctds << '\n';
+  }
+  verify_expr(out.good(), "failed writing %s", filename.c_str());
+}
+
+bool FoldCache::Load(const std::string& filename) {
+  std::ifstream in(filename);
+  if (!in.good()) return false;
+  key_t key;
+  energy_t energy;
+  std::string pairs, ctds;
+  std::lock_guard<std::mutex> guard(lock);
+  while (in >> key.model_checksum >> key.options >> energy >> key.primary >> pairs >> ctds) {
+    verify_expr(key.primary.size() == pairs.size() && pairs.size() == ctds.size(),
+        "corrupt fold cache file %s", filename.c_str());
+    computed_t computed(parsing::ParseDotBracketSecondary(key.primary, pairs));
+    computed.energy = energy;
+    for (int i = 0; i < int(ctds.size()); ++i) {
+      verify_expr(ctds[i] >= 'a' && ctds[i] < 'a' + CTD_SIZE, "corrupt fold cache file %s",
+          filename.c_str());
+      computed.base_ctds[i] = Ctd(ctds[i] - 'a');
+    }
+    InsertLocked(key, computed);
+  }
+  verify_expr(in.eof(), "corrupt fold cache file %s", filename.c_str());
+  return true;
+}
+
+FoldCache::stats_t FoldCache::Stats() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return {hits, misses, evictions, lru.size()};
+}
+
+void FoldCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock);
+  lru.clear();
+  index.clear();
+  hits = misses = evictions = 0;
+}
+}
+}
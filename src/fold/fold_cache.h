@@ -0,0 +1,92 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_FOLD_CACHE_H
+#define KEKRNA_FOLD_FOLD_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "common.h"
+#include "fold/context.h"
+
+namespace kekrna {
+namespace fold {
+
+// Bounded LRU cache of MFE folds in front of Context::Fold. Entries are keyed by the sequence,
+// the energy model checksum, and the options which affect the result. All methods are thread safe.
+class FoldCache {
+public:
+  struct stats_t {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    std::size_t size;
+  };
+
+  explicit FoldCache(std::size_t max_entries_);
+  FoldCache(const FoldCache&) = delete;
+  FoldCache& operator=(const FoldCache&) = delete;
+
+  // Returns the cached fold if there is one, otherwise folds and caches the result. Folding uses
+  // the global fold state, so concurrent misses on the same cache are serialised.
+  computed_t Fold(
+      const primary_t& r, const energy::EnergyModelPtr em, const context_options_t& options);
+
+  bool Lookup(const primary_t& r, uint32_t model_checksum, const context_options_t& options,
+      computed_t& computed);
+  void Insert(const primary_t& r, uint32_t model_checksum, const context_options_t& options,
+      const computed_t& computed);
+
+  // Writes all entries from least to most recently used, so loading preserves the LRU order.
+  void Save(const std::string& filename) const;
+  // Returns false if |filename| could not be opened, e.g. because it has not been saved yet.
+  bool Load(const std::string& filename);
+
+  stats_t Stats() const;
+  void Clear();
+
+private:
+  struct key_t {
+    std::string primary;
+    uint32_t model_checksum;
+    std::string options;
+
+    bool operator==(const key_t& o) const {
+      return model_checksum == o.model_checksum && primary == o.primary && options == o.options;
+    }
+  };
+
+  struct key_hash_t {
+    std::size_t operator()(const key_t& key) const;
+  };
+
+  typedef std::list<std::pair<key_t, computed_t>> lru_t;
+
+  const std::size_t max_entries;
+  mutable std::mutex lock;
+  std::mutex fold_lock;
+  lru_t lru;  // Most recently used at the front.
+  std::unordered_map<key_t, lru_t::iterator, key_hash_t> index;
+  uint64_t hits, misses, evictions;
+
+  static key_t MakeKey(
+      const primary_t& r, uint32_t model_checksum, const context_options_t& options);
+  // Requires |lock| to be held.
+  void InsertLocked(key_t key, const computed_t& computed);
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_FOLD_CACHE_H
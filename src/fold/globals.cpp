@@ -27,18 +27,28 @@ energy_t genergy;
 energy::EnergyModel gem;
 array3d_t<energy_t, DP_SIZE> gdp;
 array2d_t<energy_t, EXT_SIZE> gext;
+constraint_precomp_t gcons;
 
-void SetGlobalState(const primary_t& r, const energy::EnergyModel& em) {
+void SetGlobalState(
+    const primary_t& r, const energy::EnergyModel& em, const constraints_t& constraints) {
   gr = r;
   gp.resize(gr.size());
   gctd.resize(gr.size());
+  gcons = PrecomputeConstraints(gr, constraints);
+  // Reuse the table allocations if the size hasn't changed.
+  if (gdp.Size() != gr.size() + 1) gdp = array3d_t<energy_t, DP_SIZE>(gr.size() + 1);
+  if (gext.Size() != gr.size() + 1) gext = array2d_t<energy_t, EXT_SIZE>(gr.size() + 1);
+  SetGlobalEnergyModel(em);
+}
+
+void SetGlobalEnergyModel(const energy::EnergyModel& em) {
   genergy = MAX_E;
   gem = em;
   gpc = PrecomputeData(gr, gem);
   std::fill(gp.begin(), gp.end(), -1);
   std::fill(gctd.begin(), gctd.end(), CTD_NA);
-  gdp = array3d_t<energy_t, DP_SIZE>(gr.size() + 1);
-  gext = array2d_t<energy_t, EXT_SIZE>(gr.size() + 1);
+  gdp.Fill();
+  gext.Fill();
 }
 }
 }
@@ -18,6 +18,7 @@
 #include "array.h"
 #include "common.h"
 #include "energy/energy_model.h"
+#include "fold/constraints.h"
 #include "fold/fold_constants.h"
 #include "fold/precomp.h"
 
@@ -34,8 +35,13 @@ extern energy::EnergyModel gem;
 extern precomp_t gpc;
 extern array3d_t<energy_t, DP_SIZE> gdp;
 extern array2d_t<energy_t, EXT_SIZE> gext;
+extern constraint_precomp_t gcons;
 
-void SetGlobalState(const primary_t& r, const energy::EnergyModel& em);
+void SetGlobalState(const primary_t& r, const energy::EnergyModel& em,
+    const constraints_t& constraints = {});
+// Switches the energy model for the current sequence, clearing the tables but keeping the
+// sequence level state and allocations from SetGlobalState.
+void SetGlobalEnergyModel(const energy::EnergyModel& em);
 }
 }
 }
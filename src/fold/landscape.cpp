@@ -0,0 +1,141 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "fold/landscape.h"
+#include <algorithm>
+#include <cstring>
+#include "fold/structure_hash.h"
+
+namespace kekrna {
+namespace fold {
+
+LandscapeBuilder::LandscapeBuilder(const primary_t& r_) : r(r_), last_energy(-CAP_E) {}
+
+int LandscapeBuilder::FindRoot(int minimum) {
+  while (roots[minimum] != minimum) {
+    roots[minimum] = roots[roots[minimum]];
+    minimum = roots[minimum];
+  }
+  return minimum;
+}
+
+int LandscapeBuilder::Find(uint64_t hash, const char* db) const {
+  const auto range = idxs.equal_range(hash);
+  for (auto iter = range.first; iter != range.second; ++iter) {
+    if (!memcmp(&dbs[std::size_t(iter->second) * r.size()], db, r.size())) return iter->second;
+  }
+  return -1;
+}
+
+void LandscapeBuilder::Add(const subopt_view_t& view) {
+  const int N = int(r.size());
+  assert(int(view.p.Size()) == N);
+  verify_expr(view.energy >= last_energy, "structures must be added in order of energy");
+  last_energy = view.energy;
+  const auto& p = view.p;
+  const char* db = view.db.Data();
+  const uint64_t hash = StructureHash(p, {});
+  if (Find(hash, db) != -1) return;
+
+  // Look at every neighbour seen so far. Removing a pair or adding one changes the hash by the key
+  // of that pair. Lonely pairs are rare, so two stacked pairs are also removed or added in one
+  // move.
+  seen_t lowest = {-1, CAP_E};
+  merged.clear();
+  // Visits the structure with the pair of |st| and |en| added or removed, along with the pair
+  // stacked inside it if |stacked|.
+  const auto visit = [this, N, db, &lowest](uint64_t neighbour_hash, int st, int en, bool stacked) {
+    if (!idxs.count(neighbour_hash)) return;
+    neighbour.assign(db, N);
+    for (int i = 0; i <= int(stacked); ++i) {
+      neighbour[st + i] = neighbour[st + i] == '.' ? '(' : '.';
+      neighbour[en - i] = neighbour[en - i] == '.' ? ')' : '.';
+    }
+    const int idx = Find(neighbour_hash, neighbour.data());
+    if (idx == -1) return;
+    if (seen[idx].energy < lowest.energy) lowest = seen[idx];
+    merged.push_back(FindRoot(seen[idx].minimum));
+  };
+  for (int st = 0; st < N; ++st) {
+    if (p[st] > st) {
+      const uint64_t removed = hash ^ PairHash(st, p[st]);
+      visit(removed, st, p[st], false);
+      if (p[st + 1] == p[st] - 1) visit(removed ^ PairHash(st + 1, p[st] - 1), st, p[st], true);
+    }
+    if (p[st] != -1) continue;
+    // Pairs from here can't cross any existing pair, so skip over inner ones and stop at the end of
+    // the enclosing one.
+    for (int en = st + 1; en < N;) {
+      if (p[en] == -1) {
+        if (en - st - 1 >= HAIRPIN_MIN_SZ && CanPair(r[st], r[en])) {
+          const uint64_t added = hash ^ PairHash(st, en);
+          visit(added, st, en, false);
+          if (en - st - 3 >= HAIRPIN_MIN_SZ && p[st + 1] == -1 && p[en - 1] == -1 &&
+              CanPair(r[st + 1], r[en - 1]))
+            visit(added ^ PairHash(st + 1, en - 1), st, en, true);
+        }
+        ++en;
+      } else if (p[en] > en) {
+        en = p[en] + 1;
+      } else {
+        break;
+      }
+    }
+  }
+
+  if (lowest.minimum == -1) {
+    // Nothing lower to descend to, so this is a new local minimum.
+    const int minimum = int(minima.size());
+    minima.push_back({std::string(db, N), view.energy, -1, CAP_E, 1});
+    roots.push_back(minimum);
+    lowest = {minimum, view.energy};
+  } else {
+    ++minima[lowest.minimum].basin_size;
+    lowest.energy = view.energy;
+  }
+  idxs.emplace(hash, int(seen.size()));
+  seen.push_back(lowest);
+  dbs.append(db, N);
+
+  // If this connects several basins, it is their saddle. The basin with the lowest minimum
+  // absorbs the others. Minima are made in order of energy, so that is the lowest index.
+  std::sort(merged.begin(), merged.end());
+  merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+  for (int i = 1; i < int(merged.size()); ++i) {
+    minima[merged[i]].father = merged[0];
+    minima[merged[i]].saddle = view.energy;
+    roots[merged[i]] = merged[0];
+  }
+}
+
+std::vector<landscape_minimum_t> LandscapeBuilder::BarrierTree(energy_t min_height) const {
+  // Fathers always come before their children, so they are placed in the tree first.
+  std::vector<int> tree_idx(minima.size());
+  std::vector<landscape_minimum_t> tree;
+  for (int i = 0; i < int(minima.size()); ++i) {
+    const auto& minimum = minima[i];
+    if (minimum.father == -1 || minimum.saddle - minimum.energy >= min_height) {
+      tree_idx[i] = int(tree.size());
+      tree.push_back(minimum);
+    } else {
+      tree_idx[i] = tree_idx[minimum.father];
+      tree[tree_idx[i]].basin_size += minimum.basin_size;
+    }
+  }
+  for (auto& minimum : tree)
+    if (minimum.father != -1) minimum.father = tree_idx[minimum.father];
+  return tree;
+}
+}
+}
@@ -0,0 +1,89 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_LANDSCAPE_H
+#define KEKRNA_FOLD_LANDSCAPE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "fold/fold.h"
+
+namespace kekrna {
+namespace fold {
+
+struct landscape_minimum_t {
+  std::string db;
+  energy_t energy;
+  // Index of the minimum this one's basin merges into, or -1 if it never merges.
+  int father;
+  // Energy of the saddle where the basins merge, or CAP_E if |father| is -1.
+  energy_t saddle;
+  // Number of structures whose steepest descent ends here.
+  int basin_size;
+};
+
+// Builds the barrier tree of an energy landscape in one pass over its structures. Two structures
+// are neighbours if they differ by one pair, or by two pairs stacked on each other, like the noLP
+// move set of barriers. Structures with lonely pairs are mostly too high in energy to be added, so
+// without the second kind of move most helices wouldn't be connected to anything. Structures
+// must be added in order of energy, as sorted suboptimal folding gives them, and each set of
+// pairs is only used the first time it is seen, so CTD variants of a structure don't matter.
+// Structures are looked up by the StructureHash of their pairs, so each neighbour takes O(1) to
+// find. They are compared in full when the hashes match, so a collision never mixes up two
+// structures. Structures close to the top of the energy range have some of their neighbours
+// missing, so saddles there are upper bounds, and basins may not merge at all if the range is too
+// small.
+class LandscapeBuilder {
+public:
+  explicit LandscapeBuilder(const primary_t& r_);
+  LandscapeBuilder(const LandscapeBuilder&) = delete;
+  LandscapeBuilder& operator=(const LandscapeBuilder&) = delete;
+
+  void Add(const subopt_view_t& view);
+  int NumStructures() const { return int(seen.size()); }
+  // Minima in order of energy. Minima with a barrier less than |min_height| are merged into their
+  // fathers, along with their basins. Minima without a father are always kept.
+  std::vector<landscape_minimum_t> BarrierTree(energy_t min_height = 0) const;
+
+private:
+  struct seen_t {
+    // The minimum the steepest descent from this structure ends at.
+    int minimum;
+    energy_t energy;
+  };
+
+  const primary_t r;
+  std::vector<seen_t> seen;
+  // Dot brackets of the structures in |seen|, one after another.
+  std::string dbs;
+  // Indices into |seen| by the hash of their pairs.
+  std::unordered_multimap<uint64_t, int> idxs;
+  std::vector<landscape_minimum_t> minima;
+  // Union-find over minima, merging basins that are connected below the current energy.
+  std::vector<int> roots;
+  energy_t last_energy;
+  // Reused across calls to Add.
+  std::vector<int> merged;
+  std::string neighbour;
+
+  int FindRoot(int minimum);
+  // Index into |seen| of the structure |db| with pairs hashing to |hash|, or -1 if it is new.
+  int Find(uint64_t hash, const char* db) const;
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_LANDSCAPE_H
@@ -0,0 +1,223 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "fold/partition.h"
+#include <cmath>
+#include <thread>
+#include "fold/expansion_cache.h"
+#include "fold/globals.h"
+#include "fold/suboptimal1.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+// Energies are in tenths of kcal/mol.
+const double RT = 10.0 * R * T;
+// Weights of energies at least this high underflow to zero.
+const int NUM_WEIGHTS = int(750.0 * RT);
+
+// Expansion energies are integers relative to the optimum, so look their weights up instead of
+// calling exp for each one.
+const std::vector<double>& Weights() {
+  static const std::vector<double> weights = [] {
+    std::vector<double> w(NUM_WEIGHTS);
+    for (int i = 0; i < NUM_WEIGHTS; ++i)
+      w[i] = exp(-i / RT);
+    return w;
+  }();
+  return weights;
+}
+
+inline double RelativeWeight(const std::vector<double>& weights, energy_t energy) {
+  assert(energy >= 0);
+  return energy < NUM_WEIGHTS ? weights[energy] : 0.0;
+}
+}
+
+double BoltzmannWeight(energy_t energy) { return exp(-energy / RT); }
+
+namespace internal {
+
+Partition1::Partition1(int num_threads_)
+    : N(int(gr.size())), num_threads(num_threads_), inside(std::size_t(NumIndexSlots(N)), 0.0) {
+  verify_expr(num_threads >= 1, "need at least one thread");
+  verify_expr(N <= MAX_PACKED_N, "sequence too long");
+}
+
+bool Partition1::Possible(const index_t& idx) const {
+  if (idx.en == -1) return gext[idx.st][idx.a] < CAP_E;
+  return gdp[idx.st][idx.en][idx.a] < CAP_E;
+}
+
+void Partition1::ForEachOfLength(int len, const std::function<void(int, int)>& fn) const {
+  const auto worker = [this, len, &fn](int thread) {
+    for (int st = thread; st + len < N; st += num_threads)
+      fn(thread, st);
+  };
+  // Short ranges aren't worth starting threads for.
+  if (num_threads == 1 || N - len < 2 * num_threads) {
+    for (int thread = 0; thread < num_threads; ++thread)
+      worker(thread);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < num_threads; ++thread)
+    threads.emplace_back(worker, thread);
+  for (auto& thread : threads)
+    thread.join();
+}
+
+double Partition1::InsideOf(const index_t& idx) const {
+  if (!Possible(idx)) return 0.0;
+  const auto& weights = Weights();
+  double q = 0.0;
+  for (const auto& exp : GenerateExpansions(idx, CAP_E)) {
+    double weight = RelativeWeight(weights, exp.energy);
+    if (exp.to_expand.st != -1) weight *= inside[IndexSlot(exp.to_expand, N)];
+    if (exp.unexpanded.st != -1) weight *= inside[IndexSlot(exp.unexpanded, N)];
+    q += weight;
+  }
+  return q;
+}
+
+void Partition1::Inside() {
+  // Children of DP indices are in shorter ranges, except for DP_P of the same range, which is
+  // first. Children of exterior loop indices are DP indices or exterior loop indices further right.
+  static_assert(DP_P == 0, "DP_P must come first");
+  for (int len = 0; len < N; ++len) {
+    ForEachOfLength(len, [this, len](int, int st) {
+      for (int a = 0; a < DP_SIZE; ++a) {
+        const index_t idx(st, st + len, a);
+        inside[IndexSlot(idx, N)] = InsideOf(idx);
+      }
+    });
+  }
+  for (int st = N; st >= 0; --st) {
+    for (int a = 0; a < EXT_SIZE; ++a) {
+      const index_t idx(st, -1, a);
+      inside[IndexSlot(idx, N)] = InsideOf(idx);
+    }
+  }
+}
+
+void Partition1::AddOutside(const index_t& idx, std::vector<double>& out) const {
+  const double outer = outside[IndexSlot(idx, N)];
+  if (outer <= 0.0 || !Possible(idx)) return;
+  const auto& weights = Weights();
+  for (const auto& exp : GenerateExpansions(idx, CAP_E)) {
+    if (exp.to_expand.st == -1) continue;
+    const double weight = outer * RelativeWeight(weights, exp.energy);
+    const int slot0 = IndexSlot(exp.to_expand, N);
+    if (exp.unexpanded.st == -1) {
+      out[slot0] += weight;
+      continue;
+    }
+    const int slot1 = IndexSlot(exp.unexpanded, N);
+    out[slot0] += weight * inside[slot1];
+    out[slot1] += weight * inside[slot0];
+  }
+}
+
+partition_t Partition1::Outside() {
+  const int root = IndexSlot({0, -1, EXT}, N);
+  verify_expr(inside[root] > 0.0, "constraints cannot be satisfied");
+  outside.assign(inside.size(), 0.0);
+  outside[root] = 1.0;
+  for (int st = 0; st <= N; ++st)
+    for (int a = 0; a < EXT_SIZE; ++a)
+      AddOutside(index_t(st, -1, a), outside);
+  // The first thread adds to |outside| directly, and the others to their own arrays, which are
+  // summed into |outside| for each range length before it is used. Parents in the same range as
+  // DP_P are done before it, by the same thread, so it only needs that thread's additions.
+  std::vector<std::vector<double>> outs(num_threads - 1, std::vector<double>(inside.size(), 0.0));
+  for (int len = N - 1; len >= 0; --len) {
+    for (int st = 0; st + len < N && !outs.empty(); ++st) {
+      for (int a = 0; a < DP_SIZE; ++a) {
+        const int slot = IndexSlot(index_t(st, st + len, a), N);
+        for (auto& out : outs) {
+          outside[slot] += out[slot];
+          out[slot] = 0.0;
+        }
+      }
+    }
+    ForEachOfLength(len, [this, len, &outs](int thread, int st) {
+      auto& out = thread == 0 ? outside : outs[thread - 1];
+      for (int a = DP_SIZE - 1; a >= 0; --a) {
+        const index_t idx(st, st + len, a);
+        if (a == DP_P && thread != 0) {
+          const int slot = IndexSlot(idx, N);
+          outside[slot] += out[slot];
+          out[slot] = 0.0;
+        }
+        AddOutside(idx, out);
+      }
+    });
+  }
+
+  partition_t part;
+  part.q = inside[root];
+  part.mfe = gext[0][EXT];
+  part.ensemble_energy = part.mfe - RT * log(part.q);
+  part.prob.assign(N, std::vector<double>(N, 0.0));
+  for (int st = 0; st < N; ++st) {
+    for (int en = st + 1; en < N; ++en) {
+      const int slot = IndexSlot(index_t(st, en, DP_P), N);
+      part.prob[st][en] = part.prob[en][st] = inside[slot] * outside[slot] / part.q;
+    }
+  }
+  return part;
+}
+
+computed_t Partition1::Sample(std::mt19937& eng) const {
+  const auto& weights = Weights();
+  computed_t computed(gr);
+  computed.energy = gext[0][EXT];
+  std::vector<index_t> q = {{0, -1, EXT}};
+  while (!q.empty()) {
+    const auto idx = q.back();
+    q.pop_back();
+    const auto exps = GenerateExpansions(idx, CAP_E);
+    // Choose an expansion with probability proportional to the weight of its substructures.
+    double left = std::uniform_real_distribution<double>(0.0, inside[IndexSlot(idx, N)])(eng);
+    int chosen = -1;
+    for (int i = 0; i < int(exps.size()); ++i) {
+      const auto& exp = exps[i];
+      double weight = RelativeWeight(weights, exp.energy);
+      if (exp.to_expand.st != -1) weight *= inside[IndexSlot(exp.to_expand, N)];
+      if (exp.unexpanded.st != -1) weight *= inside[IndexSlot(exp.unexpanded, N)];
+      if (weight <= 0.0) continue;
+      // Rounding may leave a little over at the end, so fall back to the last possible one.
+      chosen = i;
+      left -= weight;
+      if (left < 0.0) break;
+    }
+    assert(chosen != -1);
+    const auto& exp = exps[chosen];
+    if (idx.en != -1 && idx.a == DP_P) {
+      computed.s.p[idx.st] = idx.en;
+      computed.s.p[idx.en] = idx.st;
+    }
+    for (const auto& ctd_idx : {exp.ctd0, exp.ctd1})
+      if (ctd_idx.idx != -1) computed.base_ctds[ctd_idx.idx] = ctd_idx.ctd;
+    computed.energy += exp.energy;
+    if (exp.to_expand.st != -1) q.push_back(exp.to_expand);
+    if (exp.unexpanded.st != -1) q.push_back(exp.unexpanded);
+  }
+  return computed;
+}
+}
+}
+}
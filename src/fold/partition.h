@@ -0,0 +1,80 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_PARTITION_H
+#define KEKRNA_FOLD_PARTITION_H
+
+#include <random>
+#include <vector>
+#include "common.h"
+#include "fold/fold.h"
+
+namespace kekrna {
+namespace fold {
+
+// Boltzmann weights are relative to the MFE, which keeps them in range without further scaling.
+struct partition_t {
+  // The partition function over structures and CTDs, divided by the Boltzmann weight of the MFE,
+  // so it is at least one.
+  double q;
+  energy_t mfe;
+  // -RT ln Q, in the same units as energies.
+  double ensemble_energy;
+  // |prob[st][en]| is the probability that |st| pairs with |en|. Symmetric.
+  std::vector<std::vector<double>> prob;
+};
+
+// The Boltzmann weight of an energy, exp(-|energy| / RT).
+double BoltzmannWeight(energy_t energy);
+
+namespace internal {
+
+// McCaskill's algorithm over the same decomposition that suboptimal folding uses, the expansions
+// of the DP states of the tables, including the CTD states. So each structure is weighted by its
+// energy with its CTDs, exactly as it is folded and enumerated. Uses the global DP tables.
+class Partition1 {
+public:
+  explicit Partition1(int num_threads_ = 1);
+  Partition1(const Partition1&) = delete;
+  Partition1& operator=(const Partition1&) = delete;
+
+  // Computes the inside partition functions. Needed by everything else.
+  void Inside();
+  // Computes the outside partition functions and returns the full results.
+  partition_t Outside();
+  // Samples a structure with its CTDs from the Boltzmann distribution.
+  computed_t Sample(std::mt19937& eng) const;
+
+private:
+  const int N;
+  const int num_threads;
+  // Inside and outside partition functions of each index, relative to the Boltzmann weight of its
+  // optimal energy in the tables, which keeps them at least one for indices that can be formed.
+  std::vector<double> inside;
+  std::vector<double> outside;
+
+  // Whether the tables have a substructure for |idx|.
+  bool Possible(const index_t& idx) const;
+  // Splits the ranges with |en| - |st| == |len| between threads, calling |fn| with the thread
+  // number and |st| of each.
+  void ForEachOfLength(int len, const std::function<void(int, int)>& fn) const;
+  double InsideOf(const index_t& idx) const;
+  // Adds the outside contributions of |idx| to its children in |out|.
+  void AddOutside(const index_t& idx, std::vector<double>& out) const;
+};
+}
+}
+}
+
+#endif  // KEKRNA_FOLD_PARTITION_H
@@ -0,0 +1,63 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "fold/shapes.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+void AppendHelices(const std::vector<int>& p, int level, int st, int en, std::string& shape);
+
+// Appends the shape of the helix starting with the pair at |st|, without its outer brackets.
+void AppendHelixContents(const std::vector<int>& p, int level, int st, std::string& shape) {
+  const int en = p[st];
+  int ist = st + 1;
+  while (ist < en && p[ist] == -1)
+    ++ist;
+  if (ist < en && p[ist] > ist) {
+    const int ien = p[ist];
+    int next = ien + 1;
+    while (next < en && p[next] == -1)
+      ++next;
+    if (next == en && ShapeContinuesHelix(level, st, en, ist, ien)) {
+      AppendHelixContents(p, level, ist, shape);
+      return;
+    }
+  }
+  AppendHelices(p, level, st + 1, en, shape);
+}
+
+// Appends the shapes of the helices in [|st|, |en|).
+void AppendHelices(const std::vector<int>& p, int level, int st, int en, std::string& shape) {
+  for (int i = st; i < en; ++i) {
+    if (p[i] <= i) continue;
+    shape += '[';
+    AppendHelixContents(p, level, i, shape);
+    shape += ']';
+    i = p[i];
+  }
+}
+}
+
+std::string AbstractShape(const std::vector<int>& p, int level) {
+  verify_expr(level >= MIN_SHAPE_LEVEL && level <= MAX_SHAPE_LEVEL,
+      "shape level must be between %d and %d", MIN_SHAPE_LEVEL, MAX_SHAPE_LEVEL);
+  std::string shape;
+  AppendHelices(p, level, 0, int(p.size()), shape);
+  return shape;
+}
+}
+}
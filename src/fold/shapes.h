@@ -0,0 +1,47 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_SHAPES_H
+#define KEKRNA_FOLD_SHAPES_H
+
+#include <string>
+#include <vector>
+#include "common.h"
+
+namespace kekrna {
+namespace fold {
+
+// Abstract shapes describe how helices nest, ignoring unpaired bases. Each helix is a pair of
+// brackets. Which two-loops interrupt a helix depends on the level: at level 5 none do, at level
+// 4 only interior loops do, and at level 3 both interior loops and bulges do.
+constexpr int MIN_SHAPE_LEVEL = 3;
+constexpr int MAX_SHAPE_LEVEL = 5;
+
+// Whether the two-loop closed by (|st|, |en|) with inner pair (|ist|, |ien|) continues the helix.
+inline bool ShapeContinuesHelix(int level, int st, int en, int ist, int ien) {
+  const int unpaired_sides = (ist != st + 1) + (ien != en - 1);
+  return unpaired_sides == 0 || (unpaired_sides == 1 && level >= 4) || level >= 5;
+}
+
+std::string AbstractShape(const std::vector<int>& p, int level);
+
+// The best structure with an abstract shape, or shape representative.
+struct shape_rep_t {
+  std::string shape;
+  computed_t computed;
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_SHAPES_H
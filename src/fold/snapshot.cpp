@@ -0,0 +1,122 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdio>
+#include "fold/globals.h"
+#include "fold/snapshot.h"
+
+namespace kekrna {
+namespace fold {
+namespace internal {
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'K', 'E', 'K', 'D', 'P', 0, 0, 1};
+
+struct snapshot_header_t {
+  char magic[8];
+  uint32_t model_checksum;
+  uint32_t constraints_checksum;
+  int32_t table_alg;
+  int32_t N;
+  uint32_t dp_size;
+  uint32_t ext_size;
+};
+
+// Everything after the header is 8 byte aligned so the tables can be used in place.
+std::size_t Align(std::size_t offset) { return (offset + 7) & ~std::size_t(7); }
+
+std::size_t PrimaryOffset() { return Align(sizeof(snapshot_header_t)); }
+std::size_t DpOffset(std::size_t N) { return Align(PrimaryOffset() + N * sizeof(base_t)); }
+std::size_t DpBytes(std::size_t N) { return (N + 1) * (N + 1) * DP_SIZE * sizeof(energy_t); }
+std::size_t ExtOffset(std::size_t N) { return Align(DpOffset(N) + DpBytes(N)); }
+std::size_t ExtBytes(std::size_t N) { return (N + 1) * EXT_SIZE * sizeof(energy_t); }
+
+uint32_t ConstraintsChecksum() {
+  if (!gcons.active) return 0;
+  std::string data(gcons.allowed.begin(), gcons.allowed.end());
+  data.append(reinterpret_cast<const char*>(gcons.forced.data()),
+      gcons.forced.size() * sizeof(gcons.forced[0]));
+  return Crc32(data);
+}
+
+snapshot_header_t MakeHeader(uint32_t model_checksum, int table_alg) {
+  snapshot_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.model_checksum = model_checksum;
+  header.constraints_checksum = ConstraintsChecksum();
+  header.table_alg = table_alg;
+  header.N = int32_t(gr.size());
+  header.dp_size = DP_SIZE;
+  header.ext_size = EXT_SIZE;
+  return header;
+}
+}
+
+void SaveTables(const std::string& filename, uint32_t model_checksum, int table_alg) {
+  const std::size_t N = gr.size();
+  const auto header = MakeHeader(model_checksum, table_alg);
+  // Write to a temporary file first so a partially written snapshot is never loaded.
+  const std::string tmp_filename = filename + ".tmp";
+  FILE* fp = fopen(tmp_filename.c_str(), "wb");
+  verify_expr(fp != nullptr, "could not open %s", tmp_filename.c_str());
+  const std::pair<const void*, std::size_t> sections[] = {{&header, sizeof(header)},
+      {gr.data(), N * sizeof(base_t)}, {gdp.Data(), DpBytes(N)}, {gext.Data(), ExtBytes(N)}};
+  const char padding[8] = {};
+  std::size_t offset = 0;
+  for (const auto& section : sections) {
+    const std::size_t pad = Align(offset) - offset;
+    bool ok = fwrite(padding, 1, pad, fp) == pad;
+    ok = ok && fwrite(section.first, 1, section.second, fp) == section.second;
+    verify_expr(ok, "could not write %s", tmp_filename.c_str());
+    offset = Align(offset) + section.second;
+  }
+  fclose(fp);
+  verify_expr(rename(tmp_filename.c_str(), filename.c_str()) == 0, "could not write %s",
+      filename.c_str());
+}
+
+bool LoadTables(const std::string& filename, uint32_t model_checksum, int table_alg) {
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  const std::size_t N = gr.size();
+  const std::size_t size = ExtOffset(N) + ExtBytes(N);
+  if (fstat(fd, &st) != 0 || std::size_t(st.st_size) != size) {
+    close(fd);
+    return false;
+  }
+  void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  const char* data = static_cast<const char*>(map);
+  const auto header = MakeHeader(model_checksum, table_alg);
+  const bool ok = memcmp(data, &header, sizeof(header)) == 0 &&
+      memcmp(data + PrimaryOffset(), gr.data(), N * sizeof(base_t)) == 0;
+  if (ok) {
+    memcpy(gdp.Data(), data + DpOffset(N), DpBytes(N));
+    memcpy(gext.Data(), data + ExtOffset(N), ExtBytes(N));
+  }
+  munmap(map, size);
+  return ok;
+}
+}
+}
+}
@@ -0,0 +1,39 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_SNAPSHOT_H
+#define KEKRNA_FOLD_SNAPSHOT_H
+
+#include "common.h"
+
+namespace kekrna {
+namespace fold {
+namespace internal {
+
+// Snapshots of the DP tables for the current global state, so traceback and suboptimal folding
+// can be rerun without recomputing them. The file is a fixed size header followed by the primary
+// sequence and the raw contents of gdp and gext, so loading is a copy out of an mmap of the file
+// with no parsing.
+
+// Writes gdp and gext to |filename|. SetGlobalState must have been called and the tables computed.
+void SaveTables(const std::string& filename, uint32_t model_checksum, int table_alg);
+// Fills gdp and gext from |filename|. SetGlobalState must have been called. Returns false and
+// leaves the tables alone if the file can't be read or was made for a different sequence, energy
+// model, table algorithm, or constraints.
+bool LoadTables(const std::string& filename, uint32_t model_checksum, int table_alg);
+}
+}
+}
+
+#endif  // KEKRNA_FOLD_SNAPSHOT_H
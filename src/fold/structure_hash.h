@@ -0,0 +1,55 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_STRUCTURE_HASH_H
+#define KEKRNA_FOLD_STRUCTURE_HASH_H
+
+#include "array.h"
+#include "common.h"
+
+namespace kekrna {
+namespace fold {
+
+// Zobrist hashing of secondary structures with CTDs. The hash of a structure is the XOR of a key
+// for each pair and for each base with a CTD, so it can be kept up to date in O(1) as they are set
+// and unset. Keys are made by mixing the positions instead of being looked up in random tables,
+// so they need no memory for long sequences.
+inline uint64_t HashMix(uint64_t x) {
+  // The splitmix64 finaliser.
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// |st| must be less than |en|.
+inline uint64_t PairHash(int st, int en) { return HashMix(uint64_t(st) << 32 | uint32_t(en)); }
+
+// Tagged so that CTD keys never coincide with pair keys.
+inline uint64_t CtdHash(int idx, Ctd ctd) {
+  return HashMix(uint64_t(1) << 63 | uint64_t(idx) << 32 | uint32_t(ctd));
+}
+
+// Hashes a structure from scratch. |ctds| may be empty if there is no CTD information.
+inline uint64_t StructureHash(span_t<int> p, span_t<Ctd> ctds) {
+  uint64_t hash = 0;
+  for (int i = 0; i < int(p.Size()); ++i)
+    if (p[i] > i) hash ^= PairHash(i, p[i]);
+  for (int i = 0; i < int(ctds.Size()); ++i)
+    if (ctds[i] != CTD_NA) hash ^= CtdHash(i, ctds[i]);
+  return hash;
+}
+}
+}
+
+#endif  // KEKRNA_FOLD_STRUCTURE_HASH_H
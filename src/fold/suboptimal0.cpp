@@ -20,6 +20,201 @@ namespace internal {
 
 using namespace energy;
 
+void Suboptimal0::Encode(const node_t& node, std::vector<int16_t>& buf) {
+  buf.clear();
+  buf.push_back(int16_t(node.not_yet_expanded.size()));
+  for (const auto& nye : node.not_yet_expanded)
+    buf.insert(buf.end(), {nye.st, nye.en, nye.a});
+  const std::size_t num_pairs = buf.size();
+  buf.push_back(0);
+  for (int i = 0; i < int(node.p.size()); ++i) {
+    if (node.p[i] > i) {
+      buf.insert(buf.end(), {int16_t(i), node.p[i]});
+      ++buf[num_pairs];
+    }
+  }
+  const std::size_t num_ctds = buf.size();
+  buf.push_back(0);
+  for (int i = 0; i < int(node.base_ctds.size()); ++i) {
+    if (node.base_ctds[i] != CTD_NA) {
+      buf.insert(buf.end(), {int16_t(i), int16_t(node.base_ctds[i])});
+      ++buf[num_ctds];
+    }
+  }
+}
+
+void Suboptimal0::Decode(const int16_t* data, node_t& node) {
+  node.not_yet_expanded.clear();
+  node.p.assign(gr.size(), -1);
+  node.base_ctds.assign(gr.size(), CTD_NA);
+  for (int16_t i = *data++; i > 0; --i, data += 3)
+    node.not_yet_expanded.emplace_back(data[0], data[1], data[2]);
+  for (int16_t i = *data++; i > 0; --i, data += 2) {
+    node.p[data[0]] = data[1];
+    node.p[data[1]] = data[0];
+  }
+  for (int16_t i = *data++; i > 0; --i, data += 2)
+    node.base_ctds[data[0]] = Ctd(data[1]);
+}
+
+int Suboptimal0::NewSnapshot(std::vector<int16_t>&& snapshot) {
+  snapshot_bytes += snapshot.size() * sizeof(int16_t);
+  if (free_snapshots.empty()) {
+    snapshots.push_back(std::move(snapshot));
+    return int(snapshots.size()) - 1;
+  }
+  const int idx = free_snapshots.back();
+  free_snapshots.pop_back();
+  snapshots[idx] = std::move(snapshot);
+  return idx;
+}
+
+int Suboptimal0::NewRecord(const record_t& record) {
+  if (record.parent >= 0) ++records[record.parent].refs;
+  if (free_records.empty()) {
+    records.push_back(record);
+    return int(records.size()) - 1;
+  }
+  const int idx = free_records.back();
+  free_records.pop_back();
+  records[idx] = record;
+  return idx;
+}
+
+void Suboptimal0::Release(int record) {
+  while (--records[record].refs == 0) {
+    free_records.push_back(record);
+    const int parent = records[record].parent;
+    if (parent < 0) {
+      snapshot_bytes -= snapshots[-parent - 1].size() * sizeof(int16_t);
+      snapshots[-parent - 1] = std::vector<int16_t>();
+      free_snapshots.push_back(-parent - 1);
+      return;
+    }
+    record = parent;
+  }
+}
+
+void Suboptimal0::Materialize(int record, node_t& node) {
+  chain.clear();
+  while (records[record].parent >= 0) {
+    chain.push_back(record);
+    record = records[record].parent;
+  }
+  Decode(snapshots[-records[record].parent - 1].data(), node);
+  for (auto iter = chain.rbegin(); iter != chain.rend(); ++iter) {
+    const auto& rec = records[*iter];
+    const auto expanded = node.not_yet_expanded.back();
+    node.not_yet_expanded.pop_back();
+    if (expanded.en != -1 && expanded.a == DP_P) {
+      node.p[expanded.st] = expanded.en;
+      node.p[expanded.en] = expanded.st;
+    }
+    for (const auto& nye : rec.nye)
+      if (nye.st != -1) node.not_yet_expanded.push_back(nye);
+    for (const auto& ctd_idx : rec.ctds)
+      if (ctd_idx.idx != -1) node.base_ctds[ctd_idx.idx] = ctd_idx.ctd;
+  }
+}
+
+bool Suboptimal0::PopMin(energy_t& energy, int& record) {
+  if (!spilled.empty() && (q.empty() || spilled.begin()->first < q.begin()->first)) Unspill();
+  if (q.empty()) return false;
+  auto iter = q.begin();
+  energy = iter->first;
+  record = iter->second.back();
+  iter->second.pop_back();
+  if (iter->second.empty()) q.erase(iter);
+  --num_queued;
+  --num_in_memory;
+  return true;
+}
+
+void Suboptimal0::DropMax() {
+  if (!spilled.empty() && (q.empty() || spilled.rbegin()->first >= q.rbegin()->first)) {
+    // Spilled nodes are read back in order, so dropping the last one just means not reading it.
+    auto iter = --spilled.end();
+    if (--iter->second.back().count == 0) iter->second.pop_back();
+    if (iter->second.empty()) spilled.erase(iter);
+  } else {
+    auto iter = --q.end();
+    Release(iter->second.back());
+    iter->second.pop_back();
+    if (iter->second.empty()) q.erase(iter);
+    --num_in_memory;
+  }
+  --num_queued;
+}
+
+void Suboptimal0::Spill() {
+  if (spill_file == nullptr) {
+    spill_file = tmpfile();
+    verify_expr(spill_file != nullptr, "could not create suboptimal spill file");
+  }
+  // Spill down to below the limit so we don't spill again straight away.
+  while (Bytes() > max_bytes / 4 * 3) {
+    auto iter = --q.end();
+    auto& bucket = iter->second;
+    // Nodes are taken from the back of the cheapest bucket next, so keep those in memory.
+    const std::size_t count = q.size() == 1 ? bucket.size() / 2 : bucket.size();
+    if (count == 0) break;
+    verify_expr(fseek(spill_file, 0, SEEK_END) == 0, "could not seek in suboptimal spill file");
+    spilled[iter->first].push_back({ftell(spill_file), int(count)});
+    for (std::size_t i = 0; i < count; ++i) {
+      Materialize(bucket[i], spill_node);
+      Release(bucket[i]);
+      Encode(spill_node, spill_buf);
+      const uint32_t size = uint32_t(spill_buf.size());
+      verify_expr(fwrite(&size, sizeof(size), 1, spill_file) == 1 &&
+              fwrite(spill_buf.data(), sizeof(spill_buf[0]), size, spill_file) == size,
+          "could not write suboptimal spill file");
+    }
+    bucket.erase(bucket.begin(), bucket.begin() + std::ptrdiff_t(count));
+    num_in_memory -= int(count);
+    if (bucket.empty()) q.erase(iter);
+  }
+}
+
+void Suboptimal0::Unspill() {
+  // Only read back one block at a time. Any others with the same energy are read once the nodes
+  // from this one have been expanded.
+  auto iter = spilled.begin();
+  const auto block = iter->second.back();
+  iter->second.pop_back();
+  auto& bucket = q[iter->first];
+  if (iter->second.empty()) spilled.erase(iter);
+  verify_expr(
+      fseek(spill_file, block.offset, SEEK_SET) == 0, "could not seek in suboptimal spill file");
+  for (int i = 0; i < block.count; ++i) {
+    uint32_t size = 0;
+    verify_expr(
+        fread(&size, sizeof(size), 1, spill_file) == 1, "could not read suboptimal spill file");
+    std::vector<int16_t> snapshot(size);
+    verify_expr(fread(snapshot.data(), sizeof(snapshot[0]), size, spill_file) == size,
+        "could not read suboptimal spill file");
+    bucket.push_back(NewRecord({-NewSnapshot(std::move(snapshot)) - 1, 1, {}, {}}));
+  }
+  num_in_memory += block.count;
+}
+
+void Suboptimal0::Insert(
+    energy_t energy, index_t nye0, index_t nye1, ctd_idx_t ctd0, ctd_idx_t ctd1) {
+  if (energy > max_energy) return;
+  if (num_queued >= max_structures) {
+    // Every queued node leads to at least one structure with its energy, so only the best
+    // |max_structures| of them need to be kept.
+    energy_t worst = std::numeric_limits<energy_t>::min();
+    if (!q.empty()) worst = q.rbegin()->first;
+    if (!spilled.empty()) worst = std::max(worst, spilled.rbegin()->first);
+    if (worst <= energy) return;
+    DropMax();
+  }
+  q[energy].push_back(NewRecord({currecord, 1, {nye0, nye1}, {ctd0, ctd1}}));
+  ++num_queued;
+  ++num_in_memory;
+  if (max_bytes != 0 && Bytes() > max_bytes) Spill();
+}
+
 int Suboptimal0::Run(SuboptimalCallback fn) {
   const int N = int(gr.size());
   verify_expr(N < std::numeric_limits<int16_t>::max(), "RNA too long for suboptimal folding");
@@ -29,28 +224,31 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
   // Cull the ones not inside the window or when we have more than |max_structures|.
   // We don't have to check for expanding impossible states indirectly, since they will have MAX_E,
   // be above max_delta, and be instantly culled (callers use CAP_E for no energy limit).
-  q.insert({{{0, -1, EXT}}, {}, std::vector<int16_t>(gr.size(), -1),
-      std::vector<Ctd>(gr.size(), CTD_NA), gext[0][EXT]});
-  while (!q.empty()) {
-    auto node = *q.begin();
-    q.erase(q.begin());
-    // Finished state.
-    if (node.not_yet_expanded.empty()) {
-      PruneInsert(finished, node);
+  Encode({{{0, -1, EXT}}, std::vector<int16_t>(gr.size(), -1),
+      std::vector<Ctd>(gr.size(), CTD_NA)}, spill_buf);
+  const int root = NewSnapshot(std::move(spill_buf));
+  q[gext[0][EXT]].push_back(NewRecord({-root - 1, 1, {}, {}}));
+  num_queued = num_in_memory = 1;
+  int num_structures = 0;
+  energy_t node_energy = 0;
+  int record = -1;
+  while (num_structures < max_structures && PopMin(node_energy, record)) {
+    Materialize(record, curnode);
+    // Finished state. Nodes come out in order of energy, since expanding a node never makes its
+    // energy lower, so it can be reported straight away.
+    if (curnode.not_yet_expanded.empty()) {
+      fn({{gr, {curnode.p.begin(), curnode.p.end()}}, curnode.base_ctds, node_energy});
+      ++num_structures;
+      Release(record);
       continue;
     }
 
-    // If we found a non-finished node, but |finished| is full, and the worst in |finished| is as
-    // good as our current node (which is the best in |q|), then we can exit.
-    if (int(finished.size()) >= max_structures && (--finished.end())->energy <= node.energy) break;
-
-    auto to_expand = node.not_yet_expanded.back();
-    node.not_yet_expanded.pop_back();
-    node.history.push_back(to_expand);  // Add to history.
+    auto to_expand = curnode.not_yet_expanded.back();
+    curnode.not_yet_expanded.pop_back();
     int st = to_expand.st, en = to_expand.en, a = to_expand.a;
 
-    // Initialise - we only make small modifications to it.
-    curnode = node;
+    // New records are made relative to this one.
+    currecord = record;
     // Temporary variable to hold energy calculations.
     energy_t energy = 0;
 
@@ -58,24 +256,26 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
     if (en == -1) {
       // We try replacing what we do at (st, a) with a bunch of different cases, so we use this
       // energy as a base.
-      energy_t base_energy = node.energy - gext[st][a];
+      energy_t base_energy = node_energy - gext[st][a];
       if (a == EXT) {
         // Base case: do nothing.
         if (st == N)
           Expand(base_energy);
         else
           // Case: No pair starting here (for EXT only)
-          Expand(base_energy + gext[st + 1][EXT], {st + 1, -1, EXT});
+          Expand(base_energy + gext[st + 1][EXT] + gcons.Unpaired(st), {st + 1, -1, EXT});
       }
       for (en = st + HAIRPIN_MIN_SZ + 1; en < N; ++en) {
         // .   .   .   (   .   .   .   )   <   >
         //           stb  st1b   en1b  enb   rem
         const auto stb = gr[st], st1b = gr[st + 1], enb = gr[en], en1b = gr[en - 1];
         const auto base00 = gdp[st][en][DP_P] + gem.AuGuPenalty(stb, enb);
-        const auto base01 = gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b);
-        const auto base10 = gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb);
-        const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b);
-        curnode = node;
+        const auto base01 =
+            gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b) + gcons.Unpaired(en);
+        const auto base10 =
+            gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb) + gcons.Unpaired(st);
+        const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b) +
+            gcons.Unpaired(st) + gcons.Unpaired(en);
 
         // (   ).<( * ). > Right coax backward
         if (st > 0 && a == EXT_RCOAX) {
@@ -141,11 +341,12 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
         }
       }
       // Finished exterior loop, don't do anymore.
+      Release(record);
       continue;
     }
 
     // Subtract the minimum energy of the contribution at this node.
-    energy_t base_energy = node.energy - gdp[st][en][a];
+    energy_t base_energy = node_energy - gdp[st][en][a];
     // Declare the usual base aliases.
     const auto stb = gr[st], st1b = gr[st + 1], st2b = gr[st + 2], enb = gr[en], en1b = gr[en - 1],
         en2b = gr[en - 2];
@@ -157,15 +358,17 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
 
       // Two loops.
       int max_inter = std::min(TWOLOOP_MAX_SZ, en - st - HAIRPIN_MIN_SZ - 3);
-      for (int ist = st + 1; ist < st + max_inter + 2; ++ist) {
-        for (int ien = en - max_inter + ist - st - 2; ien < en; ++ien) {
+      const int max_ist = std::min(st + max_inter + 1, gcons.next_must_pair[st + 1]);
+      for (int ist = st + 1; ist <= max_ist; ++ist) {
+        for (int ien = std::max(en - max_inter + ist - st - 2, gcons.prev_must_pair[en - 1]);
+             ien < en; ++ien) {
           energy = base_energy + gem.TwoLoop(gr, st, en, ist, ien) + gdp[ist][ien][DP_P];
           Expand(energy, {ist, ien, DP_P});
         }
       }
 
       // Hairpin loop
-      energy = base_energy + gem.Hairpin(gr, st, en);
+      energy = base_energy + gem.Hairpin(gr, st, en) + gcons.Unpaired(st + 1, en - 1);
       Expand(energy);
 
       auto base_and_branch =
@@ -174,20 +377,24 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
       energy = base_and_branch + gdp[st + 1][en - 1][DP_U2];
       Expand(energy, {st + 1, en - 1, DP_U2}, {en, CTD_UNUSED});
       // (3<   ><   >) 3'
-      energy = base_and_branch + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb];
+      energy = base_and_branch + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb] +
+          gcons.Unpaired(st + 1);
       Expand(energy, {st + 2, en - 1, DP_U2}, {en, CTD_3_DANGLE});
       // (<   ><   >5) 5'
-      energy = base_and_branch + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb];
+      energy = base_and_branch + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb] +
+          gcons.Unpaired(en - 1);
       Expand(energy, {st + 1, en - 2, DP_U2}, {en, CTD_5_DANGLE});
       // (.<   ><   >.) Terminal mismatch
-      energy = base_and_branch + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb];
+      energy = base_and_branch + gdp[st + 2][en - 2][DP_U2] +
+          gem.terminal[stb][st1b][en1b][enb] + gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1);
       Expand(energy, {st + 2, en - 2, DP_U2}, {en, CTD_MISMATCH});
 
       for (int piv = st + HAIRPIN_MIN_SZ + 2; piv < en - HAIRPIN_MIN_SZ - 2; ++piv) {
         base_t pl1b = gr[piv - 1], plb = gr[piv], prb = gr[piv + 1], pr1b = gr[piv + 2];
 
         // (.(   )   .) Left outer coax - P
-        auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb);
+        auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb) + gcons.Unpaired(st + 1) +
+            gcons.Unpaired(en - 1);
         energy = base_and_branch + gdp[st + 2][piv][DP_P] + gem.multiloop_hack_b +
             gem.AuGuPenalty(st2b, plb) + gdp[piv + 1][en - 2][DP_U] + outer_coax;
         Expand(energy, {st + 2, piv, DP_P}, {piv + 1, en - 2, DP_U}, {st + 2, CTD_LCOAX_WITH_PREV},
@@ -202,14 +409,16 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
         // (.(   ).   ) Left right coax
         energy = base_and_branch + gdp[st + 2][piv - 1][DP_P] + gem.multiloop_hack_b +
             gem.AuGuPenalty(st2b, pl1b) + gdp[piv + 1][en - 1][DP_U] +
-            gem.MismatchCoaxial(pl1b, plb, st1b, st2b);
+            gem.MismatchCoaxial(pl1b, plb, st1b, st2b) + gcons.Unpaired(st + 1) +
+            gcons.Unpaired(piv);
         Expand(energy, {st + 2, piv - 1, DP_P}, {piv + 1, en - 1, DP_U},
             {st + 2, CTD_RCOAX_WITH_PREV}, {en, CTD_RCOAX_WITH_NEXT});
 
         // (   .(   ).) Right left coax
         energy = base_and_branch + gdp[st + 1][piv][DP_U] + gem.multiloop_hack_b +
             gem.AuGuPenalty(pr1b, en2b) + gdp[piv + 2][en - 2][DP_P] +
-            gem.MismatchCoaxial(en2b, en1b, prb, pr1b);
+            gem.MismatchCoaxial(en2b, en1b, prb, pr1b) + gcons.Unpaired(piv + 1) +
+            gcons.Unpaired(en - 1);
         Expand(energy, {st + 1, piv, DP_U}, {piv + 2, en - 2, DP_P}, {piv + 2, CTD_LCOAX_WITH_NEXT},
             {en, CTD_LCOAX_WITH_PREV});
 
@@ -230,7 +439,7 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
     } else {
       // Left unpaired. Either DP_U or DP_U2.
       if (st + 1 < en && (a == DP_U || a == DP_U2)) {
-        energy = base_energy + gdp[st + 1][en][a];
+        energy = base_energy + gdp[st + 1][en][a] + gcons.Unpaired(st);
         Expand(energy, {st + 1, en, a});
       }
 
@@ -241,10 +450,14 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
         auto pb = gr[piv], pl1b = gr[piv - 1];
         // baseAB indicates A bases left unpaired on the left, B bases left unpaired on the right.
         auto base00 = gdp[st][piv][DP_P] + gem.AuGuPenalty(stb, pb) + gem.multiloop_hack_b;
-        auto base01 = gdp[st][piv - 1][DP_P] + gem.AuGuPenalty(stb, pl1b) + gem.multiloop_hack_b;
-        auto base10 = gdp[st + 1][piv][DP_P] + gem.AuGuPenalty(st1b, pb) + gem.multiloop_hack_b;
-        auto base11 =
-            gdp[st + 1][piv - 1][DP_P] + gem.AuGuPenalty(st1b, pl1b) + gem.multiloop_hack_b;
+        auto base01 = gdp[st][piv - 1][DP_P] + gem.AuGuPenalty(stb, pl1b) +
+            gem.multiloop_hack_b + gcons.Unpaired(piv);
+        auto base10 = gdp[st + 1][piv][DP_P] + gem.AuGuPenalty(st1b, pb) + gem.multiloop_hack_b +
+            gcons.Unpaired(st);
+        auto base11 = gdp[st + 1][piv - 1][DP_P] + gem.AuGuPenalty(st1b, pl1b) +
+            gem.multiloop_hack_b + gcons.Unpaired(st) + gcons.Unpaired(piv);
+        // Cost of leaving the rest of the range after this branch unpaired.
+        const auto unpaired_right = gcons.Unpaired(piv + 1, en);
 
         // Check a == U_RCOAX:
         // (   ).<( ** ). > Right coax backward
@@ -252,7 +465,7 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
           if (st > 0) {
             energy = base_energy + base01 + gem.MismatchCoaxial(pl1b, pb, gr[st - 1], stb);
             // Our ctds will have already been set by now.
-            Expand(energy, {st, piv - 1, DP_P});
+            Expand(energy + unpaired_right, {st, piv - 1, DP_P});
             Expand(energy + gdp[piv + 1][en][DP_U], {st, piv - 1, DP_P}, {piv + 1, en, DP_U});
           }
           continue;
@@ -262,7 +475,7 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
         // (   )<   > - U, U2, U_WC?, U_GU?
         energy = base_energy + base00;
         if (a == DP_U) {
-          Expand(energy, {st, piv, DP_P}, {st, CTD_UNUSED});
+          Expand(energy + unpaired_right, {st, piv, DP_P}, {st, CTD_UNUSED});
           Expand(energy + gdp[piv + 1][en][DP_U], {st, piv, DP_P}, {piv + 1, en, DP_U},
               {st, CTD_UNUSED});
         }
@@ -272,7 +485,7 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
         if (a == DP_U_WC || a == DP_U_GU) {
           // Make sure we don't form any branches that are not the right type of pair.
           if ((a == DP_U_WC && IsWatsonCrick(stb, pb)) || (a == DP_U_GU && IsGu(stb, pb))) {
-            Expand(energy, {st, piv, DP_P});
+            Expand(energy + unpaired_right, {st, piv, DP_P});
             Expand(energy + gdp[piv + 1][en][DP_U], {st, piv, DP_P}, {piv + 1, en, DP_U});
           }
           continue;
@@ -283,19 +496,21 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
         // (   )3<   > 3' - U, U2
         energy = base_energy + base01 + gem.dangle3[pl1b][pb][stb];
         // Can only let the rest be unpaired if we only need one branch, i.e. DP_U not DP_U2.
-        if (a == DP_U) Expand(energy, {st, piv - 1, DP_P}, {st, CTD_3_DANGLE});
+        if (a == DP_U) Expand(energy + unpaired_right, {st, piv - 1, DP_P}, {st, CTD_3_DANGLE});
         Expand(energy + gdp[piv + 1][en][DP_U], {st, piv - 1, DP_P}, {piv + 1, en, DP_U},
             {st, CTD_3_DANGLE});
 
         // 5(   )<   > 5' - U, U2
         energy = base_energy + base10 + gem.dangle5[pb][stb][st1b];
-        if (a == DP_U) Expand(energy, {st + 1, piv, DP_P}, {st + 1, CTD_5_DANGLE});
+        if (a == DP_U)
+          Expand(energy + unpaired_right, {st + 1, piv, DP_P}, {st + 1, CTD_5_DANGLE});
         Expand(energy + gdp[piv + 1][en][DP_U], {st + 1, piv, DP_P}, {piv + 1, en, DP_U},
             {st + 1, CTD_5_DANGLE});
 
         // .(   ).<   > Terminal mismatch - U, U2
         energy = base_energy + base11 + gem.terminal[pl1b][pb][stb][st1b];
-        if (a == DP_U) Expand(energy, {st + 1, piv - 1, DP_P}, {st + 1, CTD_MISMATCH});
+        if (a == DP_U)
+          Expand(energy + unpaired_right, {st + 1, piv - 1, DP_P}, {st + 1, CTD_MISMATCH});
         Expand(energy + gdp[piv + 1][en][DP_U], {st + 1, piv - 1, DP_P}, {piv + 1, en, DP_U},
             {st + 1, CTD_MISMATCH});
 
@@ -329,12 +544,9 @@ int Suboptimal0::Run(SuboptimalCallback fn) {
         }
       }
     }
+    Release(record);
   }
-  for (const auto& struc : finished) {
-    assert(struc.not_yet_expanded.empty());
-    fn({{gr, {struc.p.begin(), struc.p.end()}}, struc.base_ctds, struc.energy});
-  }
-  return int(finished.size());
+  return num_structures;
 }
 }
 }
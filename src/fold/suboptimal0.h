@@ -15,7 +15,8 @@
 #ifndef KEKRNA_SUBOPTIMAL0_H
 #define KEKRNA_SUBOPTIMAL0_H
 
-#include <set>
+#include <cstdio>
+#include <map>
 #include "common.h"
 #include "energy/structure.h"
 #include "fold/fold.h"
@@ -27,84 +28,109 @@ namespace internal {
 
 class Suboptimal0 {
 public:
-  Suboptimal0(energy_t delta_, int num)
+  // Queued search nodes beyond |max_bytes_| are spilled to a temporary file, most expensive first.
+  // Zero means no limit.
+  Suboptimal0(energy_t delta_, int num, std::size_t max_bytes_ = 0)
       : max_energy(delta_ == -1 ? CAP_E : gext[0][EXT] + delta_),
-        max_structures(num == -1 ? std::numeric_limits<int>::max() / 4 : num) {
+        max_structures(num == -1 ? std::numeric_limits<int>::max() / 4 : num),
+        max_bytes(max_bytes_) {
     verify_expr(max_structures > 0, "must request at least one structure");
   }
+  ~Suboptimal0() {
+    if (spill_file) fclose(spill_file);
+  }
+  Suboptimal0(const Suboptimal0&) = delete;
+  Suboptimal0& operator=(const Suboptimal0&) = delete;
+
   int Run(SuboptimalCallback fn);
 
 private:
   struct node_t {
-    // State should be fully defined by |not_yet_expanded|, |history|, and |base_ctds| which denote
-    // what it has done so far, and what it can do from now.
+    // State should be fully defined by |not_yet_expanded|, |p|, and |base_ctds| which denote what
+    // it has done so far, and what it can do from now.
     std::vector<index_t> not_yet_expanded;
-    std::vector<index_t> history;
     std::vector<int16_t> p;
     std::vector<Ctd> base_ctds;
-    energy_t energy;  // Stores the minimum energy this state could have.
+  };
+
+  // Queued nodes only store what they changed from the node they were expanded from, and share the
+  // rest with it. To get the state of a node, take its parent's state, expand the parent's last
+  // unexpanded range, then push |nye| and set |ctds|.
+  struct record_t {
+    // If negative, the whole state is encoded in |snapshots[-parent - 1]| instead.
+    int parent;
+    // Number of queue entries and records referring to this one.
+    int refs;
+    index_t nye[2];
+    ctd_idx_t ctds[2];
+  };
 
-    bool operator<(const node_t& o) const { return energy < o.energy; }
+  struct spill_block_t {
+    long offset;
+    int count;
   };
 
   const energy_t max_energy;
   const int max_structures;
-  // This node is where we build intermediate results to be pushed onto the queue.
+  const std::size_t max_bytes;
+  // This node is the state of the node being expanded, which new records are made relative to.
   node_t curnode;
-  std::multiset<node_t> finished;
-  std::multiset<node_t> q;
-
-  void PruneInsert(std::multiset<node_t>& prune, const node_t& node) {
-    if (node.energy <= max_energy) {
-      if (int(prune.size()) >= max_structures && (--prune.end())->energy > node.energy)
-        prune.erase(--prune.end());
-      if (int(prune.size()) < max_structures) prune.insert(node);
-    }
+  int currecord = -1;
+  std::vector<record_t> records;
+  std::vector<int> free_records;
+  std::vector<std::vector<int16_t>> snapshots;
+  std::vector<int> free_snapshots;
+  std::size_t snapshot_bytes = 0;
+  // Queued records, bucketed by the minimum energy they could have.
+  std::map<energy_t, std::vector<int>> q;
+  // Blocks of queued nodes that were written out to |spill_file|, bucketed by energy.
+  std::map<energy_t, std::vector<spill_block_t>> spilled;
+  FILE* spill_file = nullptr;
+  // Total number of queued nodes, including spilled ones, and how many of them are in memory.
+  int num_queued = 0;
+  int num_in_memory = 0;
+  std::vector<int> chain;
+  std::vector<int16_t> spill_buf;
+  node_t spill_node;
+
+  std::size_t Bytes() const {
+    return (records.size() - free_records.size()) * sizeof(record_t) +
+        std::size_t(num_in_memory) * sizeof(int) + snapshot_bytes;
   }
 
+  // Nodes are stored on disk and in snapshots as their unexpanded ranges, pairs, and CTDs.
+  static void Encode(const node_t& node, std::vector<int16_t>& buf);
+  static void Decode(const int16_t* data, node_t& node);
+  int NewSnapshot(std::vector<int16_t>&& snapshot);
+  int NewRecord(const record_t& record);
+  void Release(int record);
+  void Materialize(int record, node_t& node);
+  bool PopMin(energy_t& energy, int& record);
+  void DropMax();
+  void Spill();
+  void Unspill();
+  void Insert(energy_t energy, index_t nye0, index_t nye1, ctd_idx_t ctd0, ctd_idx_t ctd1);
+
   // Creates and inserts a new node with energy |energy| that doesn't
   // need to expand any more ranges than it currently has.
-  void Expand(energy_t energy) {
-    curnode.energy = energy;
-    PruneInsert(q, curnode);
-  }
+  void Expand(energy_t energy) { Insert(energy, {}, {}, {}, {}); }
 
   // Creates and inserts a new node with energy |energy| that needs to expand the given ranges.
-  void Expand(energy_t energy, index_t nye) {
-    curnode.not_yet_expanded.push_back(nye);
-    curnode.energy = energy;
-    PruneInsert(q, curnode);
-    curnode.not_yet_expanded.pop_back();
-  }
+  void Expand(energy_t energy, index_t nye) { Insert(energy, nye, {}, {}, {}); }
 
   void Expand(energy_t energy, index_t nye, ctd_idx_t ctd_idx) {
-    curnode.base_ctds[ctd_idx.idx] = ctd_idx.ctd;
-    Expand(energy, nye);
-    curnode.base_ctds[ctd_idx.idx] = CTD_NA;
+    Insert(energy, nye, {}, ctd_idx, {});
   }
 
   // Creates and inserts a new node with energy |energy| that needs to expand the two given ranges.
-  void Expand(energy_t energy, index_t nye0, index_t nye1) {
-    curnode.not_yet_expanded.push_back(nye0);
-    curnode.not_yet_expanded.push_back(nye1);
-    curnode.energy = energy;
-    PruneInsert(q, curnode);
-    curnode.not_yet_expanded.pop_back();
-    curnode.not_yet_expanded.pop_back();
-  }
+  void Expand(energy_t energy, index_t nye0, index_t nye1) { Insert(energy, nye0, nye1, {}, {}); }
 
   void Expand(energy_t energy, index_t nye0, index_t nye1, ctd_idx_t ctd_idx) {
-    curnode.base_ctds[ctd_idx.idx] = ctd_idx.ctd;
-    Expand(energy, nye0, nye1);
-    curnode.base_ctds[ctd_idx.idx] = CTD_NA;
+    Insert(energy, nye0, nye1, ctd_idx, {});
   }
 
   void Expand(energy_t energy, index_t nye0, index_t nye1, ctd_idx_t ctd_idx0, ctd_idx_t ctd_idx1) {
-    curnode.base_ctds[ctd_idx0.idx] = ctd_idx0.ctd;
-    curnode.base_ctds[ctd_idx1.idx] = ctd_idx1.ctd;
-    Expand(energy, nye0, nye1);
-    curnode.base_ctds[ctd_idx0.idx] = CTD_NA;
-    curnode.base_ctds[ctd_idx1.idx] = CTD_NA;
+    Insert(energy, nye0, nye1, ctd_idx0, ctd_idx1);
   }
 };
 }
@@ -12,36 +12,1045 @@
 //
 // You should have received a copy of the GNU General Public License along with kekrna.
 // If not, see <http://www.gnu.org/licenses/>.
-#include <stack>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stack>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include "fold/suboptimal1.h"
 
 namespace kekrna {
 namespace fold {
 namespace internal {
 
+namespace {
+
+// Hands the structure in |d| to |sink| without copying it. |grep| is swapped in for the duration,
+// since callers may print it directly.
+void EmitStructure(const subopt_sink_t& sink, std::vector<int>& p, std::vector<Ctd>& ctd,
+    primary_t& r, std::string& rep, energy_t energy, uint64_t hash) {
+  std::swap(grep, rep);
+  if (sink.view_fn) {
+    sink.view_fn({r, p, ctd, {grep.data(), grep.size()}, energy, hash});
+  } else {
+    computed_t tmp_computed = {{std::move(r), std::move(p)}, std::move(ctd), energy};
+    sink.fn(tmp_computed);
+    // Move everything back
+    r = std::move(tmp_computed.s.r);
+    p = std::move(tmp_computed.s.p);
+    ctd = std::move(tmp_computed.base_ctds);
+  }
+  std::swap(grep, rep);
+}
+
+// Returns the number of pairs and multiloops which choosing |exp| for |idx| adds.
+std::pair<int, int> ExpansionCounts(const index_t& idx, const packed_expand_t& exp) {
+  int num_pairs = 0;
+  for (const auto& child : {exp.to_expand(), exp.unexpanded()})
+    if (child.st != -1 && child.en != -1 && child.a == DP_P) ++num_pairs;
+  // Two-loops and hairpins have at most one child, which is a pair.
+  const bool multiloop = idx.en != -1 && idx.a == DP_P && exp.has_to_expand() &&
+      (exp.has_unexpanded() || exp.to_expand().a != DP_P);
+  return {num_pairs, multiloop ? 1 : 0};
+}
+}
+
 int Suboptimal1::Run(SuboptimalCallback fn, bool sorted) {
-  memset(gp.data(), -1, gp.size());
-  memset(gctd.data(), CTD_NA, gctd.size());
-  q.reserve(gr.size());  // Reasonable reservation.
-  cache.Reserve(gr.size());
+  return Run(subopt_sink_t{fn, nullptr}, sorted);
+}
+
+int Suboptimal1::RunViews(SuboptimalViewCallback fn, bool sorted) {
+  return Run(subopt_sink_t{nullptr, fn}, sorted);
+}
+
+int Suboptimal1::Run(const subopt_sink_t& sink, bool sorted) {
+  for (auto& cache : caches)
+    cache.Reset(int(gr.size()));
+
+  if (unique) {
+    if (!sorted && max_structures == MAX_STRUCTURES)
+      return RunUniquePass(sink, delta, false, MAX_STRUCTURES).first;
+    int num_structures = 0;
+    energy_t cur_delta = 0;
+    while (num_structures < max_structures && cur_delta != MAX_E && cur_delta <= delta) {
+      auto res = RunUniquePass(sink, cur_delta, true, max_structures - num_structures);
+      num_structures += res.first;
+      cur_delta = res.second;
+    }
+    return num_structures;
+  }
 
   // If require sorted output, or limited number of structures (requires sorting).
+  if ((sorted || max_structures != MAX_STRUCTURES) && num_threads == 1 && num_shards == 1)
+    return RunSorted(sink);
+  // Split passes still enumerate each energy level separately.
   if (sorted || max_structures != MAX_STRUCTURES) {
     int num_structures = 0;
     energy_t cur_delta = 0;
     while (num_structures < max_structures && cur_delta != MAX_E && cur_delta <= delta) {
-      auto res = RunInternal(fn, cur_delta, true, max_structures - num_structures);
+      auto res = RunPass(sink, cur_delta, true, max_structures - num_structures);
       num_structures += res.first;
       cur_delta = res.second;
     }
     return num_structures;
   }
-  return RunInternal(fn, delta, false, MAX_STRUCTURES).first;
+  return RunPass(sink, delta, false, MAX_STRUCTURES).first;
 }
 
-std::pair<int, int> Suboptimal1::RunInternal(SuboptimalCallback fn,
+suboptimal_anytime_t Suboptimal1::RunAnytime(SuboptimalViewCallback fn,
+    std::size_t memory_bytes, std::chrono::steady_clock::time_point deadline_) {
+  verify_expr(!unique, "anytime suboptimal folding doesn't support unique structures");
+  for (auto& cache : caches)
+    cache.Reset(int(gr.size()));
+  budgeted = true;
+  budget_cache_bytes =
+      memory_bytes == 0 ? 0 : std::max<std::size_t>(memory_bytes / std::size_t(num_threads), 1);
+  deadline = deadline_;
+  out_of_budget = false;
+
+  // Go through the energy levels like the split passes do. The expansion cache is kept between
+  // passes, so each pass is much cheaper than the first time its part of the tree was expanded.
+  const subopt_sink_t sink = {nullptr, fn};
+  int num_structures = 0;
+  energy_t cur_delta = 0, covered = -1;
+  bool complete = false;
+  while (num_structures < max_structures && !OutOfBudget(caches[0])) {
+    if (cur_delta == MAX_E || cur_delta > delta) {
+      // If there is no delta, the last level had the highest energy structures.
+      if (cur_delta != MAX_E) covered = delta;
+      complete = true;
+      break;
+    }
+    const auto res = RunPass(sink, cur_delta, true, max_structures - num_structures);
+    num_structures += res.first;
+    // The pass stopped early, so this level may not be complete. Split passes don't say whether
+    // they hit the structure limit, so assume the level isn't complete if it was reached.
+    if (res.second == -1 || out_of_budget || num_structures == max_structures) break;
+    covered = cur_delta;
+    cur_delta = res.second;
+  }
+  budgeted = false;
+  return {num_structures, covered + gext[0][EXT], complete};
+}
+
+bool Suboptimal1::OutOfBudget(const ExpansionCache& cache) {
+  if (!budgeted || out_of_budget) return out_of_budget;
+  if ((budget_cache_bytes != 0 && cache.Bytes() > budget_cache_bytes) ||
+      std::chrono::steady_clock::now() >= deadline)
+    out_of_budget = true;
+  return out_of_budget;
+}
+
+void Suboptimal1::StartCursor() {
+  if (has_cursor) return;
+  verify_expr(!unique, "suboptimal cursors don't support unique structures");
+  caches[0].Reset(int(gr.size()));
+  cursor = RootState();
+  // No structures satisfy the constraints.
+  if (gext[0][EXT] >= CAP_E) cursor.q.clear();
+  has_cursor = true;
+}
+
+bool Suboptimal1::Next(SuboptimalViewCallback fn) {
+  StartCursor();
+  if (cursor.q.empty()) return false;
+  const subopt_sink_t sink = {nullptr, fn};
+  const auto emit = [&sink](dfs_t& s) {
+    EmitStructure(sink, s.p, s.ctd, s.r, s.rep, s.energy + gext[0][EXT], s.hash);
+  };
+  // Stopping after one structure leaves the search state as it was when the structure was found,
+  // so the next call carries on from there.
+  return RunInternal(caches[0], cursor, emit, delta, false, 1, 0, nullptr).first == 1;
+}
+
+std::vector<int> Suboptimal1::Position() const {
+  if (!has_cursor) return {};
+  std::vector<int> position = {cursor.energy, cursor.num_pairs, cursor.num_multiloops,
+      int(cursor.q.size())};
+  for (const auto& s : cursor.q) {
+    position.insert(position.end(),
+        {s.idx, s.expand.st, s.expand.en, s.expand.a, s.should_unexpand ? 1 : 0});
+  }
+  position.push_back(int(cursor.unexpanded.size()));
+  for (const auto& idx : cursor.unexpanded)
+    position.insert(position.end(), {idx.st, idx.en, idx.a});
+  return position;
+}
+
+bool Suboptimal1::SetPosition(const std::vector<int>& position) {
+  const int N = int(gr.size());
+  has_cursor = false;
+  StartCursor();
+  if (position.empty()) return true;
+  auto& d = cursor;
+  d.q.clear();
+  // Leaves no cursor, so the next call starts from the beginning again.
+  const auto fail = [this]() {
+    has_cursor = false;
+    return false;
+  };
+  int i = 0;
+  const auto read = [&position, &i](int count) {
+    if (i + count > int(position.size())) return false;
+    i += count;
+    return true;
+  };
+  const auto read_index = [&](index_t& idx) {
+    if (!read(3)) return false;
+    const int st = position[i - 3], en = position[i - 2], a = position[i - 1];
+    if (en == -1 ? (st < 0 || st > N || a < 0 || a >= EXT_SIZE) :
+        (st < 0 || st > en || en >= N || a < 0 || a >= DP_SIZE))
+      return false;
+    idx = index_t(st, en, a);
+    return true;
+  };
+
+  if (!read(4) || position[3] < 0) return fail();
+  d.energy = position[0];
+  d.num_pairs = position[1];
+  d.num_multiloops = position[2];
+  const int q_size = position[3];
+  for (int k = 0; k < q_size; ++k) {
+    dfs_state_t s = {0, {}, false, nullptr, 0, 0};
+    if (!read(1)) return fail();
+    s.idx = position[i - 1];
+    if (!read_index(s.expand) || !read(1)) return fail();
+    s.should_unexpand = position[i - 1] != 0;
+    // Redo what the state and its current child did to the structure.
+    const auto exps = GetExpansion(caches[0], s.expand);
+    if (s.idx < 0 || s.idx > exps.second) return fail();
+    if (s.expand.en != -1 && s.expand.a == DP_P) d.SetPair(s.expand.st, s.expand.en);
+    if (s.idx != 0) {
+      d.SetCtd(exps.first[s.idx - 1].ctd0());
+      d.SetCtd(exps.first[s.idx - 1].ctd1());
+    }
+    d.q.push_back(s);
+  }
+  if (!read(1) || position[i - 1] < 0 || 3 * position[i - 1] != int(position.size()) - i)
+    return fail();
+  d.unexpanded.resize(position[i - 1]);
+  for (auto& idx : d.unexpanded)
+    if (!read_index(idx)) return fail();
+  return true;
+}
+
+Suboptimal1::index_order_t Suboptimal1::OrderIndices(ExpansionCache& cache) {
+  const int N = int(gr.size());
+  // Expansions form a DAG over indices. Number the reachable indices so that children come
+  // before their parents.
+  index_order_t o;
+  o.nums.assign(std::size_t(NumIndexSlots(N)), -1);
+  std::vector<index_t> q = {{0, -1, EXT}};
+  while (!q.empty()) {
+    const auto idx = q.back();
+    const int slot = IndexSlot(idx, N);
+    if (o.nums[slot] != -1) {
+      q.pop_back();
+      continue;
+    }
+    const auto exps = GetExpansion(cache, idx);
+    const int q_size = int(q.size());
+    for (int i = 0; i < exps.second; ++i) {
+      for (const auto& child : {exps.first[i].to_expand(), exps.first[i].unexpanded()}) {
+        if (child.st != -1 && o.nums[IndexSlot(child, N)] == -1) q.push_back(child);
+      }
+    }
+    if (int(q.size()) != q_size) continue;
+    o.nums[slot] = int(o.order.size());
+    o.order.push_back(idx);
+    q.pop_back();
+  }
+
+  const int num_idxs = int(o.order.size());
+  o.dists.assign(num_idxs, delta + 1);
+  o.dists.back() = 0;
+  for (int i = num_idxs - 1; i >= 0; --i) {
+    const auto exps = GetExpansion(cache, o.order[i]);
+    for (int j = 0; j < exps.second; ++j) {
+      const auto& exp = exps.first[j];
+      for (const auto& child : {exp.to_expand(), exp.unexpanded()}) {
+        if (child.st == -1) continue;
+        auto& dist = o.dists[o.nums[IndexSlot(child, N)]];
+        dist = std::min(dist, o.dists[i] + exp.energy);
+      }
+    }
+  }
+  return o;
+}
+
+std::vector<double> Suboptimal1::CountByEnergy() {
+  verify_expr(delta != CAP_E, "counting structures needs a delta");
+  verify_expr(!filter.LimitsCounts(), "counting can't limit the number of pairs or multiloops");
+  const int N = int(gr.size());
+  auto& cache = caches[0];
+  cache.Reset(N);
+  // The structures below an expansion are those of its |to_expand| followed by those of its
+  // |unexpanded|. So the number of structures of each index by energy above its optimum is a sum
+  // of shifted convolutions of those of its children.
+  const auto o = OrderIndices(cache);
+  const auto& nums = o.nums;
+  const auto& order = o.order;
+  const auto& dists = o.dists;
+  const int num_idxs = int(order.size());
+
+  std::vector<std::size_t> offsets(num_idxs + 1, 0);
+  for (int i = 0; i < num_idxs; ++i)
+    offsets[i + 1] = offsets[i] + std::size_t(delta - dists[i] + 1);
+  std::vector<double> counts(offsets.back(), 0.0);
+  std::vector<double> tmp;
+  for (int i = 0; i < num_idxs; ++i) {
+    double* hist = &counts[offsets[i]];
+    const int size = delta - dists[i] + 1;
+    const auto exps = GetExpansion(cache, order[i]);
+    for (int j = 0; j < exps.second && exps.first[j].energy < size; ++j) {
+      const auto& exp = exps.first[j];
+      if (!exp.has_to_expand()) {
+        hist[exp.energy] += 1.0;
+        continue;
+      }
+      const int to_expand = nums[IndexSlot(exp.to_expand(), N)];
+      const double* src = &counts[offsets[to_expand]];
+      const int src_size = std::min(int(offsets[to_expand + 1] - offsets[to_expand]),
+          size - exp.energy);
+      if (!exp.has_unexpanded()) {
+        for (int k = 0; k < src_size; ++k)
+          hist[k + exp.energy] += src[k];
+        continue;
+      }
+      const int unexpanded = nums[IndexSlot(exp.unexpanded(), N)];
+      tmp.assign(&counts[offsets[unexpanded]], &counts[offsets[unexpanded + 1]]);
+      for (int a = 0; a < src_size; ++a) {
+        if (src[a] <= 0.0) continue;  // Skips most of the work for sparse counts.
+        for (int b = 0; b < int(tmp.size()) && a + b + exp.energy < size; ++b)
+          hist[a + b + exp.energy] += src[a] * tmp[b];
+      }
+    }
+  }
+  return std::vector<double>(counts.begin() + offsets[num_idxs - 1], counts.end());
+}
+
+std::vector<shape_rep_t> Suboptimal1::BestShapes(int level) {
+  verify_expr(delta != CAP_E, "finding shapes needs a delta");
+  verify_expr(!filter.LimitsCounts(), "shapes can't limit the number of pairs or multiloops");
+  verify_expr(level >= MIN_SHAPE_LEVEL && level <= MAX_SHAPE_LEVEL,
+      "shape level must be between %d and %d", MIN_SHAPE_LEVEL, MAX_SHAPE_LEVEL);
+  const int N = int(gr.size());
+  auto& cache = caches[0];
+  cache.Reset(N);
+  // The shape of an expansion only depends on the shapes of its children, so keep the best
+  // energy above the optimum of each shape of each index, like CountByEnergy does for each
+  // energy. Shapes are interned so most of the work is on ids.
+  const auto o = OrderIndices(cache);
+  const int num_idxs = int(o.order.size());
+  struct shape_entry_t {
+    int shape;
+    energy_t energy;
+    int exp_idx;
+    int shape0;  // Of |to_expand|.
+    int shape1;  // Of |unexpanded|.
+  };
+  std::vector<std::string> shapes;
+  std::unordered_map<std::string, int> shape_ids;
+  const auto intern = [&shapes, &shape_ids](std::string&& shape) {
+    const auto iter = shape_ids.find(shape);
+    if (iter != shape_ids.end()) return iter->second;
+    const int id = int(shapes.size());
+    shape_ids.emplace(shape, id);
+    shapes.push_back(std::move(shape));
+    return id;
+  };
+  // The shape of the substructures of |idx| from |exp| with children of shapes |shape0| and
+  // |shape1|, or -1 if a child doesn't exist.
+  const auto compose = [&shapes, level](const index_t& idx, const packed_expand_t& exp,
+      int shape0, int shape1) {
+    std::string shape;
+    if (shape0 != -1) shape = shapes[shape0];
+    if (shape1 != -1) {
+      if (exp.unexpanded().st < exp.to_expand().st)
+        shape.insert(0, shapes[shape1]);
+      else
+        shape += shapes[shape1];
+    }
+    if (idx.en == -1 || idx.a != DP_P) return shape;
+    const auto inner = exp.to_expand();
+    if (shape1 == -1 && inner.st != -1 && inner.a == DP_P &&
+        ShapeContinuesHelix(level, idx.st, idx.en, inner.st, inner.en))
+      shape = shape.substr(1, shape.size() - 2);
+    return '[' + shape + ']';
+  };
+
+  std::vector<std::vector<shape_entry_t>> entries(num_idxs);
+  std::unordered_map<int, shape_entry_t> best;
+  const std::vector<shape_entry_t> no_child = {{-1, 0, -1, -1, -1}};
+  for (int i = 0; i < num_idxs; ++i) {
+    const auto& idx = o.order[i];
+    const energy_t limit = delta - o.dists[i];
+    const auto exps = GetExpansion(cache, idx);
+    best.clear();
+    const auto add = [&best](const shape_entry_t& entry) {
+      const auto iter = best.find(entry.shape);
+      if (iter == best.end() || entry.energy < iter->second.energy) best[entry.shape] = entry;
+    };
+    for (int j = 0; j < exps.second && exps.first[j].energy <= limit; ++j) {
+      const auto& exp = exps.first[j];
+      if (!exp.has_to_expand()) {
+        add({intern(compose(idx, exp, -1, -1)), exp.energy, j, -1, -1});
+        continue;
+      }
+      const auto& entries0 = entries[o.nums[IndexSlot(exp.to_expand(), N)]];
+      const auto& entries1 =
+          exp.has_unexpanded() ? entries[o.nums[IndexSlot(exp.unexpanded(), N)]] : no_child;
+      // Entries are sorted by energy, so stop at the first over the limit.
+      for (const auto& entry0 : entries0) {
+        if (exp.energy + entry0.energy > limit) break;
+        for (const auto& entry1 : entries1) {
+          const energy_t energy = exp.energy + entry0.energy + entry1.energy;
+          if (energy > limit) break;
+          add({intern(compose(idx, exp, entry0.shape, entry1.shape)), energy, j, entry0.shape,
+              entry1.shape});
+        }
+      }
+    }
+    for (const auto& shape_entry : best)
+      entries[i].push_back(shape_entry.second);
+    std::sort(entries[i].begin(), entries[i].end(),
+        [&shapes](const shape_entry_t& a, const shape_entry_t& b) {
+          if (a.energy != b.energy) return a.energy < b.energy;
+          return shapes[a.shape] < shapes[b.shape];
+        });
+  }
+
+  // Trace back the best structure of each shape of the root.
+  std::vector<shape_rep_t> reps;
+  const auto& root_entries = entries[num_idxs - 1];
+  for (int i = 0; i < int(root_entries.size()) && i < max_structures; ++i) {
+    const auto& root = root_entries[i];
+    computed_t computed(gr);
+    computed.energy = gext[0][EXT] + root.energy;
+    std::vector<std::pair<index_t, int>> q = {{o.order.back(), root.shape}};
+    while (!q.empty()) {
+      const auto idx = q.back().first;
+      const int shape = q.back().second;
+      q.pop_back();
+      const auto& idx_entries = entries[o.nums[IndexSlot(idx, N)]];
+      const auto entry = std::find_if(idx_entries.begin(), idx_entries.end(),
+          [shape](const shape_entry_t& e) { return e.shape == shape; });
+      assert(entry != idx_entries.end());
+      const auto exp = GetExpansion(cache, idx).first[entry->exp_idx];
+      if (idx.en != -1 && idx.a == DP_P) {
+        computed.s.p[idx.st] = idx.en;
+        computed.s.p[idx.en] = idx.st;
+      }
+      for (const auto& ctd_idx : {exp.ctd0(), exp.ctd1()})
+        if (ctd_idx.idx != -1) computed.base_ctds[ctd_idx.idx] = ctd_idx.ctd;
+      if (exp.has_to_expand()) q.emplace_back(exp.to_expand(), entry->shape0);
+      if (exp.has_unexpanded()) q.emplace_back(exp.unexpanded(), entry->shape1);
+    }
+    reps.push_back({shapes[root.shape], std::move(computed)});
+  }
+  return reps;
+}
+
+Suboptimal1::dfs_t Suboptimal1::RootState() const {
+  const std::size_t N = gr.size();
+  dfs_t d;
+  d.q.reserve(N);  // Reasonable reservation.
+  d.q.push_back({0, {0, -1, EXT}, false, nullptr, 0, 0});
+  d.r = gr;
+  d.p.assign(N, -1);
+  d.ctd.assign(N, CTD_NA);
+  d.rep.assign(N, '.');
+  d.energy = 0;
+  d.num_pairs = 0;
+  d.num_multiloops = 0;
+  d.hash = 0;
+  return d;
+}
+
+int Suboptimal1::RunSorted(const subopt_sink_t& sink) {
+  // Without a delta, the frontier would hold every expansion of every node visited, however
+  // high its energy. Instead, search up to a bound and widen it geometrically until there are
+  // enough structures, only reporting the structures above the previous bound.
+  if (delta != CAP_E) return RunSortedPass(sink, delta, -1, max_structures).first;
+  int num_structures = 0;
+  energy_t bound = 0, prev_bound = -1;
+  while (num_structures < max_structures && bound != MAX_E) {
+    const auto res = RunSortedPass(sink, bound, prev_bound, max_structures - num_structures);
+    num_structures += res.first;
+    prev_bound = bound;
+    bound = res.second == MAX_E ? MAX_E : std::max(res.second, bound + bound / 2 + 1);
+  }
+  return num_structures;
+}
+
+std::pair<int, int> Suboptimal1::RunSortedPass(const subopt_sink_t& sink, energy_t bound,
+    energy_t emit_above, int structure_limit) {
+  // Best first search over partial structures. Expansions are sorted by energy and never
+  // decrease it, so a node's successors are generated lazily: popping the |idx|th expansion of a
+  // node pushes its |idx| + 1th expansion, and the first expansion of the resulting child.
+  std::vector<sorted_node_t> nodes;
+  std::vector<sorted_unexpanded_t> unexpandeds;
+  std::vector<int> free_nodes, free_unexpandeds;
+  // Energies are integers and there are few distinct ones, so a bucket queue is much cheaper
+  // than a heap. Each bucket is a stack, which keeps the search close to depth first.
+  std::map<energy_t, std::vector<sorted_entry_t>> pq;
+  auto& cache = caches[0];
+  auto d = RootState();
+
+  const auto unref_unexpanded = [&](int idx) {
+    while (idx != -1 && --unexpandeds[idx].refs == 0) {
+      free_unexpandeds.push_back(idx);
+      idx = unexpandeds[idx].next;
+    }
+  };
+  const auto unref_node = [&](int idx) {
+    while (idx != -1 && --nodes[idx].refs == 0) {
+      free_nodes.push_back(idx);
+      unref_unexpanded(nodes[idx].unexpanded);
+      idx = nodes[idx].parent;
+    }
+  };
+  // Returns the expansions of a node, which must be looked up again after an eviction.
+  const auto node_exps = [&](int idx) {
+    auto& n = nodes[idx];
+    if (n.generation != cache.Generation()) {
+      std::tie(n.exps, n.num_exps) = GetExpansion(cache, n.expand);
+      n.generation = cache.Generation();
+    }
+    return n.exps;
+  };
+  // Smallest energy above |bound| seen.
+  energy_t next_seen = MAX_E;
+  // Adds a node and returns it, if its first expansion is within |bound|, or -1 otherwise.
+  const auto add_node = [&](int parent, int unexpanded, const index_t& expand, int exp_idx,
+      energy_t energy, int num_pairs, int num_multiloops) {
+    const auto exps = GetExpansion(cache, expand);
+    assert(exps.second == 0 || exps.first[0].energy >= 0);
+    // Nothing below satisfies the filter.
+    if (exps.second == 0) {
+      unref_unexpanded(unexpanded);
+      return -1;
+    }
+    if (energy + exps.first[0].energy > bound) {
+      next_seen = std::min(next_seen, energy + exps.first[0].energy);
+      unref_unexpanded(unexpanded);
+      return -1;
+    }
+    int idx = int(nodes.size());
+    if (!free_nodes.empty()) {
+      idx = free_nodes.back();
+      free_nodes.pop_back();
+    } else {
+      nodes.emplace_back();
+    }
+    const int depth = parent == -1 ? 0 : nodes[parent].depth + 1;
+    nodes[idx] = {parent, depth, 1, unexpanded, exp_idx, cache.Generation(), expand, exps.first,
+        exps.second, energy, num_pairs, num_multiloops};
+    if (parent != -1) ++nodes[parent].refs;
+    return idx;
+  };
+  // Sets or clears the pair and ctds a node adds to the structure.
+  const auto apply_node = [&](int idx, bool set) {
+    const auto n = nodes[idx];
+    if (n.expand.en != -1 && n.expand.a == DP_P) {
+      if (set)
+        d.SetPair(n.expand.st, n.expand.en);
+      else
+        d.UnsetPair(n.expand.st, n.expand.en);
+    }
+    if (n.parent == -1) return;
+    const auto& exp = node_exps(n.parent)[n.exp_idx];
+    for (const auto& ctd_idx : {exp.ctd0(), exp.ctd1()}) {
+      if (set)
+        d.SetCtd(ctd_idx);
+      else
+        d.UnsetCtd(ctd_idx);
+    }
+  };
+  // Sorts |entries| so the last comes first in the depth first order, which compares the
+  // expansion indices on the paths from the root. An entry covers its node's expansions from
+  // |idx| on, so it comes after the nodes already made below it. That is the order of the depth
+  // first finishing times of the nodes on the paths to the entries, with children visited in
+  // order of expansion index. Each node has at most one entry, so this takes linear time.
+  std::vector<int> marks, finish, first_child, num_children, marked, children;
+  std::vector<std::pair<int, int>> dfs;
+  std::vector<sorted_entry_t> by_finish;
+  int mark = 0;
+  const auto sort_dfs_order = [&](std::vector<sorted_entry_t>& entries) {
+    ++mark;
+    marks.resize(nodes.size(), 0);
+    finish.resize(nodes.size());
+    first_child.resize(nodes.size());
+    num_children.resize(nodes.size());
+    marked.clear();
+    int root_node = -1;
+    for (const auto& e : entries) {
+      for (int n = e.node; n != -1 && marks[n] != mark; n = nodes[n].parent) {
+        marks[n] = mark;
+        num_children[n] = 0;
+        marked.push_back(n);
+        if (nodes[n].parent == -1) root_node = n;
+      }
+    }
+    for (int n : marked)
+      if (nodes[n].parent != -1) ++num_children[nodes[n].parent];
+    int pos = 0;
+    for (int n : marked) {
+      first_child[n] = pos;
+      pos += num_children[n];
+      num_children[n] = 0;
+    }
+    children.resize(pos);
+    for (int n : marked) {
+      const int parent = nodes[n].parent;
+      if (parent != -1) children[first_child[parent] + num_children[parent]++] = n;
+    }
+    // Nodes only have a few children.
+    for (int n : marked) {
+      std::sort(children.begin() + first_child[n],
+          children.begin() + first_child[n] + num_children[n],
+          [&nodes](int a, int b) { return nodes[a].exp_idx < nodes[b].exp_idx; });
+    }
+    int time = 0;
+    dfs.assign(1, {root_node, 0});
+    while (!dfs.empty()) {
+      const int n = dfs.back().first, child_idx = dfs.back().second;
+      if (child_idx < num_children[n]) {
+        ++dfs.back().second;
+        dfs.emplace_back(children[first_child[n] + child_idx], 0);
+      } else {
+        finish[n] = time++;
+        dfs.pop_back();
+      }
+    }
+    by_finish.assign(time, {-1, 0});
+    for (const auto& e : entries)
+      by_finish[time - 1 - finish[e.node]] = e;
+    entries.clear();
+    for (const auto& e : by_finish)
+      if (e.node != -1) entries.push_back(e);
+  };
+  const int root = add_node(-1, -1, {0, -1, EXT}, -1, 0, 0, 0);
+  if (root != -1) pq[nodes[root].exps[0].energy].push_back({root, 0});
+
+  // The node whose path is currently applied to |d|. It is kept alive so it can be undone.
+  int applied = -1;
+  std::vector<int> path;
+
+  int num_structures = 0;
+  sorted_entry_t entry = {-1, 0};
+  energy_t energy = -1;
+  while (num_structures < structure_limit) {
+    if (entry.node == -1) {
+      if (pq.empty()) break;
+      auto iter = pq.begin();
+      if (iter->first != energy) {
+        // Starting a new energy level. Report it in the same order as a depth first search, so
+        // ties come out like they do from the split passes. Everything pushed at this level
+        // comes from the first entry and goes before the rest, so sorting once is enough.
+        sort_dfs_order(iter->second);
+      }
+      energy = iter->first;
+      entry = iter->second.back();
+      iter->second.pop_back();
+      if (iter->second.empty()) pq.erase(iter);
+    }
+    // Copy, since adding nodes may reallocate |nodes| or evict the expansions.
+    const auto exps = node_exps(entry.node);
+    const auto node = nodes[entry.node];
+    const auto exp = exps[entry.idx];
+    if (entry.idx + 1 < node.num_exps) {
+      const energy_t sibling_energy = node.energy + exps[entry.idx + 1].energy;
+      if (sibling_energy <= bound) {
+        ++nodes[entry.node].refs;
+        pq[sibling_energy].push_back({entry.node, entry.idx + 1});
+      } else {
+        next_seen = std::min(next_seen, sibling_energy);
+      }
+    }
+
+    int num_pairs = node.num_pairs, num_multiloops = node.num_multiloops;
+    if (filter.LimitsCounts()) {
+      const auto counts = ExpansionCounts(node.expand, exp);
+      num_pairs += counts.first;
+      num_multiloops += counts.second;
+    }
+
+    int child = -1;
+    if (!filter.WithinLimits(num_pairs, num_multiloops)) {
+      // Counts never decrease, so nothing below satisfies the filter.
+    } else if (!exp.has_to_expand() && node.unexpanded == -1 && energy <= emit_above) {
+      // Already reported by an earlier pass.
+    } else if (!exp.has_to_expand() && node.unexpanded == -1) {
+      // At a terminal state. Consecutive structures tend to share most of their path from the
+      // root, so only undo and apply the nodes below their common ancestor.
+      int undo = applied, apply = entry.node;
+      path.clear();
+      while (undo != apply) {
+        if (undo == -1 || (apply != -1 && nodes[apply].depth >= nodes[undo].depth)) {
+          path.push_back(apply);
+          apply = nodes[apply].parent;
+        } else {
+          apply_node(undo, false);
+          undo = nodes[undo].parent;
+        }
+      }
+      for (int idx : path)
+        apply_node(idx, true);
+      ++nodes[entry.node].refs;
+      unref_node(applied);
+      applied = entry.node;
+
+      EmitStructure(sink, d.p, d.ctd, d.r, d.rep, energy + gext[0][EXT], d.hash);
+      ++num_structures;
+    } else if (!exp.has_to_expand()) {
+      // Use an unexpanded now.
+      const auto top = unexpandeds[node.unexpanded];
+      if (top.next != -1) ++unexpandeds[top.next].refs;
+      child = add_node(
+          entry.node, top.next, top.expand, entry.idx, energy, num_pairs, num_multiloops);
+    } else {
+      int unexpanded = node.unexpanded;
+      if (unexpanded != -1) ++unexpandeds[unexpanded].refs;
+      if (exp.has_unexpanded()) {
+        int idx = int(unexpandeds.size());
+        if (!free_unexpandeds.empty()) {
+          idx = free_unexpandeds.back();
+          free_unexpandeds.pop_back();
+        } else {
+          unexpandeds.emplace_back();
+        }
+        unexpandeds[idx] = {exp.unexpanded(), unexpanded, 1};
+        unexpanded = idx;
+      }
+      child = add_node(
+          entry.node, unexpanded, exp.to_expand(), entry.idx, energy, num_pairs, num_multiloops);
+    }
+    unref_node(entry.node);
+
+    // The best expansion of a node usually doesn't increase the energy. In that case it is the
+    // lowest energy entry, so go straight to it rather than through the queue.
+    const energy_t child_energy = child == -1 ? MAX_E : energy + nodes[child].exps[0].energy;
+    if (child_energy == energy) {
+      entry = {child, 0};
+    } else {
+      if (child != -1) pq[child_energy].push_back({child, 0});
+      entry.node = -1;
+    }
+  }
+  return {num_structures, next_seen};
+}
+
+std::pair<int, int> Suboptimal1::RunUniquePass(const subopt_sink_t& sink,
+    energy_t cur_delta, bool exact_energy, int structure_limit) {
+  const int N = int(gr.size());
+  auto d = RootState();
+  int num_structures = 0;
+  energy_t next_seen = MAX_E;
+  std::vector<unique_frame_t> frames;
+  std::vector<std::pair<int, unique_alt_t>> decided;
+  const auto unset_pairs = [&d](const std::vector<int>& sts) {
+    for (int st : sts)
+      d.UnsetPair(st, d.p[st]);
+  };
+  // Partial structures with the same ranges left to expand have the same completions, so only
+  // the best one can give the best CTDs for any of them.
+  const auto remove_dominated = [](std::vector<unique_alt_t>& alts) {
+    // There are only ever a few, so compare each pair.
+    int num_kept = 0;
+    for (int i = 0; i < int(alts.size()); ++i) {
+      int j = 0;
+      while (j < num_kept && alts[j].unexpanded != alts[i].unexpanded) ++j;
+      if (j == num_kept) {
+        if (i != num_kept) alts[num_kept] = std::move(alts[i]);
+        ++num_kept;
+      } else if (alts[i].energy < alts[j].energy)
+        alts[j] = std::move(alts[i]);
+    }
+    alts.resize(num_kept);
+  };
+  // Decides bases from |st| on until there is more than one choice, then pushes a frame for the
+  // choices. Returns true if the structure limit was hit.
+  const auto descend = [&](std::vector<unique_alt_t>&& alts, int st) {
+    std::vector<int> forced;
+    for (; st < N; ++st) {
+      // Bases outside of every range are already decided the same way for every partial
+      // structure, so skip to the next one which isn't.
+      int next = N;
+      for (const auto& alt : alts) {
+        for (const auto& idx : alt.unexpanded)
+          next = std::min(next, idx.en != -1 && idx.a == DP_P && idx.st < st ? idx.st + 1 : idx.st);
+      }
+      if (next == N) {
+        st = N;
+        break;
+      }
+      st = next;
+      decided.clear();
+      bool expanded = false;
+      for (auto& alt : alts)
+        expanded |= DecideUnique(std::move(alt), st, cur_delta, d.p, decided, next_seen);
+      alts.clear();
+      if (decided.empty()) break;
+      const int en = decided[0].first;
+      const bool one_choice = std::all_of(decided.begin(), decided.end(),
+          [en](const std::pair<int, unique_alt_t>& alt) { return alt.first == en; });
+      if (!one_choice) {
+        std::stable_sort(decided.begin(), decided.end(),
+            [](const std::pair<int, unique_alt_t>& a, const std::pair<int, unique_alt_t>& b) {
+              return a.first < b.first;
+            });
+        unique_frame_t frame = {st, std::move(forced), {}, 0};
+        for (auto& alt : decided) {
+          if (frame.children.empty() || frame.children.back().first != alt.first)
+            frame.children.emplace_back(alt.first, std::vector<unique_alt_t>());
+          frame.children.back().second.push_back(std::move(alt.second));
+        }
+        if (expanded) {
+          for (auto& child : frame.children)
+            remove_dominated(child.second);
+        }
+        frames.push_back(std::move(frame));
+        return false;
+      }
+      // Only one choice, so make it without a frame.
+      if (en > st) {
+        d.SetPair(st, en);
+        forced.push_back(st);
+      }
+      for (auto& alt : decided)
+        alts.push_back(std::move(alt.second));
+      if (expanded) remove_dominated(alts);
+    }
+
+    if (st == N) {
+      // Every base is decided. Only the end of the exterior loop can be left, which costs nothing.
+      const unique_alt_t* best = nullptr;
+      for (const auto& alt : alts) {
+        assert(alt.unexpanded.empty() ||
+            (alt.unexpanded.size() == 1 && alt.unexpanded[0] == index_t(N, -1, EXT)));
+        if (best == nullptr || alt.energy < best->energy) best = &alt;
+      }
+      if (!exact_energy || best->energy == cur_delta) {
+        for (const auto& ctd_idx : best->ctds)
+          d.SetCtd(ctd_idx);
+        EmitStructure(sink, d.p, d.ctd, d.r, d.rep, best->energy + gext[0][EXT], d.hash);
+        for (const auto& ctd_idx : best->ctds)
+          d.UnsetCtd(ctd_idx);
+        ++num_structures;
+      }
+    }
+    unset_pairs(forced);
+    return num_structures == structure_limit;
+  };
+
+  if (descend({{{{0, -1, EXT}}, {}, 0}}, 0)) return {num_structures, -1};
+  while (!frames.empty()) {
+    auto& frame = frames.back();
+    const int st = frame.st;
+    // Undo the previous child's pair.
+    if (frame.idx != 0 && frame.children[frame.idx - 1].first > st)
+      unset_pairs({st});
+    if (frame.idx == int(frame.children.size())) {
+      unset_pairs(frame.forced);
+      frames.pop_back();
+      continue;
+    }
+    auto& child = frame.children[frame.idx++];
+    if (child.first > st) d.SetPair(st, child.first);
+    // May add a frame, so |frame| and |child| can't be used after this.
+    if (descend(std::move(child.second), st + 1)) return {num_structures, -1};
+  }
+  return {num_structures, next_seen};
+}
+
+bool Suboptimal1::DecideUnique(unique_alt_t&& alt, int st, energy_t cur_delta,
+    const std::vector<int>& p, std::vector<std::pair<int, unique_alt_t>>& out,
+    energy_t& next_seen) {
+  // Find the range which |st| is in. Everything before |st| is decided, so it starts at |st|.
+  int range = -1;
+  for (int i = 0; i < int(alt.unexpanded.size()); ++i) {
+    const auto& idx = alt.unexpanded[i];
+    if (idx.en == -1) {
+      if (idx.st == st) range = i;
+    } else if (idx.a == DP_P) {
+      if (idx.st == st) {
+        out.emplace_back(idx.en, std::move(alt));
+        return false;
+      }
+      if (idx.st + 1 == st) range = i;
+    } else if (idx.st == st) {
+      range = i;
+    }
+  }
+  if (range == -1) {
+    out.emplace_back(p[st], std::move(alt));
+    return false;
+  }
+
+  const index_t to_expand = alt.unexpanded[range];
+  alt.unexpanded.erase(alt.unexpanded.begin() + range);
+  auto& cache = caches[0];
+  auto exps = GetExpansion(cache, to_expand);
+  uint32_t generation = cache.Generation();
+  for (int i = 0; i < exps.second; ++i) {
+    if (cache.Generation() != generation) {
+      exps = GetExpansion(cache, to_expand);
+      generation = cache.Generation();
+    }
+    const auto exp = exps.first[i];
+    const energy_t energy = alt.energy + exp.energy;
+    if (energy > cur_delta) {
+      next_seen = std::min(next_seen, energy);
+      break;
+    }
+    unique_alt_t next = alt;
+    next.energy = energy;
+    for (const auto& idx : {exp.to_expand(), exp.unexpanded()}) {
+      if (idx.st != -1)
+        next.unexpanded.insert(
+            std::upper_bound(next.unexpanded.begin(), next.unexpanded.end(), idx), idx);
+    }
+    for (const auto& ctd_idx : {exp.ctd0(), exp.ctd1()})
+      if (ctd_idx.idx != -1) next.ctds.push_back(ctd_idx);
+    DecideUnique(std::move(next), st, cur_delta, p, out, next_seen);
+  }
+  return true;
+}
+
+std::pair<int, int> Suboptimal1::RunPass(const subopt_sink_t& sink,
+    energy_t cur_delta, bool exact_energy, int structure_limit) {
+  if (num_threads > 1 || num_shards > 1)
+    return RunSplitPass(sink, cur_delta, exact_energy, structure_limit);
+  auto d = RootState();
+  const auto emit = [&sink](dfs_t& s) {
+    EmitStructure(sink, s.p, s.ctd, s.r, s.rep, s.energy + gext[0][EXT], s.hash);
+  };
+  const auto res =
+      RunInternal(caches[0], d, emit, cur_delta, exact_energy, structure_limit, 0, nullptr);
+  assert(res.second == -1 || (d.unexpanded.empty() && d.energy == 0 &&
+      d.p == std::vector<int>(d.p.size(), -1) &&
+      d.ctd == std::vector<Ctd>(d.ctd.size(), CTD_NA)));
+  return res;
+}
+
+std::pair<int, int> Suboptimal1::RunSplitPass(const subopt_sink_t& sink,
     energy_t cur_delta, bool exact_energy, int structure_limit) {
+  // Split the tree deep enough that there are enough subtrees to keep every thread or shard busy.
+  // The shallow part of the tree is small, so redoing it for each depth is cheap.
+  const int num_tasks =
+      num_shards > 1 ? num_shards * TASKS_PER_SHARD : num_threads * TASKS_PER_THREAD;
+  std::vector<dfs_t> tasks;
+  energy_t next_seen = MAX_E;
+  for (int split_depth = 1; split_depth <= MAX_SPLIT_DEPTH; ++split_depth) {
+    tasks.clear();
+    auto d = RootState();
+    next_seen = RunInternal(caches[0], d, nullptr, cur_delta, exact_energy, MAX_STRUCTURES,
+        split_depth, &tasks).second;
+    const bool has_subtree = std::any_of(
+        tasks.begin(), tasks.end(), [](const dfs_t& task) { return !task.q.empty(); });
+    if (!has_subtree || int(tasks.size()) >= num_tasks) break;
+  }
+  if (num_shards > 1) {
+    // Deal the subtrees out round robin, since nearby subtrees tend to be similar sizes.
+    std::vector<dfs_t> shard_tasks;
+    for (int i = shard; i < int(tasks.size()); i += num_shards)
+      shard_tasks.push_back(std::move(tasks[i]));
+    tasks = std::move(shard_tasks);
+  }
+
+  // Unordered output can't guarantee which structures are reported if there are too many.
+  const bool ordered = deterministic || structure_limit != MAX_STRUCTURES;
+  std::mutex emit_lock;
+  std::atomic<int> next_task(0);
+  std::atomic<bool> stop(false);
+  int num_structures = 0;
+  // In ordered mode, each task's structures are buffered until all earlier tasks are reported.
+  int next_flush = 0;
+  std::vector<char> done(tasks.size(), false);
+  std::vector<std::vector<dfs_t>> buffers(tasks.size());
+
+  // Must be called with |emit_lock| held.
+  const auto emit_locked = [&](dfs_t& s) {
+    if (num_structures == structure_limit) return;
+    EmitStructure(sink, s.p, s.ctd, s.r, s.rep, s.energy + gext[0][EXT], s.hash);
+    if (++num_structures == structure_limit) stop = true;
+  };
+  const auto worker = [&](int thread) {
+    const primary_t r = gr;
+    energy_t worker_next_seen = MAX_E;
+    int task_idx = 0;
+    while (!stop && !out_of_budget && (task_idx = next_task++) < int(tasks.size())) {
+      auto& d = tasks[task_idx];
+      d.r = r;
+      auto& buffer = buffers[task_idx];
+      EmitFn emit;
+      if (ordered) {
+        emit = [&buffer](dfs_t& s) {
+          buffer.push_back(
+              {{}, {}, s.r, s.p, s.ctd, s.rep, s.energy, s.num_pairs, s.num_multiloops, s.hash});
+        };
+      } else {
+        emit = [&emit_lock, &emit_locked](dfs_t& s) {
+          std::lock_guard<std::mutex> guard(emit_lock);
+          emit_locked(s);
+        };
+      }
+
+      if (d.q.empty()) {
+        // A single structure found while splitting.
+        emit(d);
+      } else {
+        const auto res = RunInternal(
+            caches[thread], d, emit, cur_delta, exact_energy, structure_limit, 0, nullptr);
+        if (res.second != -1) worker_next_seen = std::min(worker_next_seen, res.second);
+      }
+      if (!ordered) continue;
+
+      std::lock_guard<std::mutex> guard(emit_lock);
+      done[task_idx] = true;
+      for (; next_flush < int(tasks.size()) && done[next_flush]; ++next_flush) {
+        for (auto& s : buffers[next_flush])
+          emit_locked(s);
+        std::vector<dfs_t>().swap(buffers[next_flush]);
+      }
+    }
+    std::lock_guard<std::mutex> guard(emit_lock);
+    next_seen = std::min(next_seen, worker_next_seen);
+  };
+
+  if (num_threads == 1) {
+    worker(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i)
+      threads.emplace_back(worker, i);
+    for (auto& thread : threads)
+      thread.join();
+  }
+  return {num_structures, next_seen};
+}
+
+std::pair<const packed_expand_t*, int> Suboptimal1::GetExpansion(
+    ExpansionCache& cache, const index_t& to_expand) {
+  const auto cached = cache.Find(to_expand);
+  if (cached.first != nullptr) return cached;
+  // Need to generate the full way to delta so we can properly set |next_seen|.
+  auto exps = GenerateExpansions(to_expand, delta);
+  if (filter.active) {
+    exps.erase(std::remove_if(exps.begin(), exps.end(),
+        [this, &to_expand](const expand_t& exp) { return !filter.Allows(to_expand, exp); }),
+        exps.end());
+  }
+  std::sort(exps.begin(), exps.end());
+  return cache.Insert(to_expand, exps);
+}
+
+std::pair<int, int> Suboptimal1::RunInternal(ExpansionCache& cache, dfs_t& d, const EmitFn& emit,
+    energy_t cur_delta, bool exact_energy, int structure_limit, int split_depth,
+    std::vector<dfs_t>* tasks) {
   // General idea is perform a dfs of the expand tree. Keep track of the current partial structures
   // and energy. Also keep track of what is yet to be expanded. Each node is either a terminal,
   // or leads to one expansion (either from unexpanded, or from expanding itself) - if there is
@@ -54,64 +1063,73 @@ std::pair<int, int> Suboptimal1::RunInternal(SuboptimalCallback fn,
   // finishing, we might not see the smallest one, but it's okay since we won't be called again.
   // Otherwise, we will completely finish, and definitely see it.
   energy_t next_seen = MAX_E;
-  energy_t energy = 0;
-  q.clear();
-  unexpanded.clear();
-  grep.resize(gr.size(), '.');
-  q.push_back({0, {0, -1, EXT}, false});
+  auto& q = d.q;
+  auto& unexpanded = d.unexpanded;
+  auto& energy = d.energy;
+  int steps = 0;
   while (!q.empty()) {
+    if (budgeted && ++steps == BUDGET_CHECK_STEPS) {
+      steps = 0;
+      if (OutOfBudget(cache)) return {num_structures, -1};
+    }
     auto& s = q.back();
     assert(s.expand.st != -1);
 
-    const auto& exps = GetExpansion(s.expand);
-    assert(!exps.empty());  // Must produce at least one expansion: {-1, -1, -1}.
+    if (s.exps == nullptr || s.generation != cache.Generation()) {
+      std::tie(s.exps, s.num_exps) = GetExpansion(cache, s.expand);
+      s.generation = cache.Generation();
+    }
+    const packed_expand_t* exps = s.exps;
+    // Every index has at least one expansion, {-1, -1, -1}, unless the filter removed them all.
+    assert(s.num_exps > 0 || filter.active);
 
     // Undo previous child's ctds and energy. The pairing is undone by the child.
     // Also remove from unexpanded if the previous child added stuff to it.
     if (s.idx != 0) {
       const auto& pexp = exps[s.idx - 1];
-      if (pexp.ctd0.idx != -1) gctd[pexp.ctd0.idx] = CTD_NA;
-      if (pexp.ctd1.idx != -1) gctd[pexp.ctd1.idx] = CTD_NA;
-      if (pexp.unexpanded.st != -1) unexpanded.pop_back();
+      d.UnsetCtd(pexp.ctd0());
+      d.UnsetCtd(pexp.ctd1());
+      if (pexp.has_unexpanded()) unexpanded.pop_back();
       energy -= pexp.energy;
+      if (filter.LimitsCounts()) {
+        const auto counts = ExpansionCounts(s.expand, pexp);
+        d.num_pairs -= counts.first;
+        d.num_multiloops -= counts.second;
+      }
     }
 
     // Update the next best seen variable
-    if (s.idx != int(exps.size()) && exps[s.idx].energy + energy > cur_delta)
+    if (s.idx != s.num_exps && exps[s.idx].energy + energy > cur_delta)
       next_seen = std::min(next_seen, exps[s.idx].energy + energy);
 
     // If we ran out of expansions, or the next expansion would take us over the delta limit
     // we are done with this node.
-    if (s.idx == int(exps.size()) || exps[s.idx].energy + energy > cur_delta) {
+    if (s.idx == s.num_exps || exps[s.idx].energy + energy > cur_delta) {
       // Finished looking at this node, so undo this node's modifications to the global state.
-      if (s.expand.en != -1 && s.expand.a == DP_P) {
-        gp[s.expand.st] = gp[s.expand.en] = -1;
-        grep[s.expand.st] = grep[s.expand.en] = '.';
-      }
+      if (s.expand.en != -1 && s.expand.a == DP_P) d.UnsetPair(s.expand.st, s.expand.en);
       if (s.should_unexpand) unexpanded.push_back(s.expand);
       q.pop_back();
       continue;  // Done.
     }
 
     const auto& exp = exps[s.idx++];
-    dfs_state_t ns = {0, exp.to_expand, false};
+    dfs_state_t ns = {0, exp.to_expand(), false, nullptr, 0, 0};
     energy += exp.energy;
-    if (exp.to_expand.st == -1) {
+    if (ns.expand.st == -1) {
       // Can't have an unexpanded without a to_expand. Also can't set ctds or affect energy.
-      assert(exp.unexpanded.st == -1);
-      assert(exp.ctd0.idx == -1 && exp.ctd1.idx == -1);
+      assert(!exp.has_unexpanded());
+      assert(exp.ctd0().idx == -1 && exp.ctd1().idx == -1);
       // Use an unexpanded now, if one exists.
       if (unexpanded.empty()) {
         // At a terminal state.
         if (!exact_energy || energy == cur_delta) {
-          computed_t tmp_computed = {{
-              std::move(gr), std::move(gp)}, std::move(gctd), energy + gext[0][EXT]};
-          fn(tmp_computed);
+          if (tasks) {
+            tasks->push_back({{}, unexpanded, {}, d.p, d.ctd, d.rep, energy, d.num_pairs,
+                d.num_multiloops, d.hash});
+            continue;
+          }
+          emit(d);
           ++num_structures;
-          // Move everything back
-          gr = std::move(tmp_computed.s.r);
-          gp = std::move(tmp_computed.s.p);
-          gctd = std::move(tmp_computed.base_ctds);
 
           // Hit structure limit.
           if (num_structures == structure_limit)
@@ -126,21 +1144,29 @@ std::pair<int, int> Suboptimal1::RunInternal(SuboptimalCallback fn,
       }
     } else {
       // Apply child's modifications to the global state.
-      if (exp.ctd0.idx != -1) gctd[exp.ctd0.idx] = exp.ctd0.ctd;
-      if (exp.ctd1.idx != -1) gctd[exp.ctd1.idx] = exp.ctd1.ctd;
-      if (exp.unexpanded.st != -1) unexpanded.push_back(exp.unexpanded);
+      d.SetCtd(exp.ctd0());
+      d.SetCtd(exp.ctd1());
+      if (exp.has_unexpanded()) unexpanded.push_back(exp.unexpanded());
+      if (filter.LimitsCounts()) {
+        const auto counts = ExpansionCounts(s.expand, exp);
+        d.num_pairs += counts.first;
+        d.num_multiloops += counts.second;
+        // Counts never decrease, so nothing below satisfies the filter. This expansion is undone
+        // along with the next one.
+        if (!filter.WithinLimits(d.num_pairs, d.num_multiloops)) continue;
+      }
     }
-    if (ns.expand.en != -1 && ns.expand.a == DP_P) {
-      gp[ns.expand.st] = ns.expand.en;
-      gp[ns.expand.en] = ns.expand.st;
-      grep[ns.expand.st] = '(';
-      grep[ns.expand.en] = ')';
+    if (ns.expand.en != -1 && ns.expand.a == DP_P) d.SetPair(ns.expand.st, ns.expand.en);
+    if (tasks && int(q.size()) == split_depth) {
+      // Leave the subtree at |ns| for later, and act as if it has been finished.
+      tasks->push_back(
+          {{ns}, unexpanded, {}, d.p, d.ctd, d.rep, energy, d.num_pairs, d.num_multiloops, d.hash});
+      if (ns.expand.en != -1 && ns.expand.a == DP_P) d.UnsetPair(ns.expand.st, ns.expand.en);
+      if (ns.should_unexpand) unexpanded.push_back(ns.expand);
+      continue;
     }
     q.push_back(ns);
   }
-  assert(unexpanded.empty() && energy == 0 &&
-      gp == std::vector<int>(gp.size(), -1) &&
-      gctd == std::vector<Ctd>(gctd.size(), CTD_NA));
   return {num_structures, next_seen};
 }
 
@@ -158,16 +1184,20 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
         exps.push_back({0});
       else
         // Case: No pair starting here (for EXT only)
-        exps.push_back({gext[st + 1][EXT] - gext[st][a], {st + 1, -1, EXT}});
+        exps.push_back(
+            {gext[st + 1][EXT] + gcons.Unpaired(st) - gext[st][a], {st + 1, -1, EXT}});
     }
     for (en = st + HAIRPIN_MIN_SZ + 1; en < N; ++en) {
       // .   .   .   (   .   .   .   )   <   >
       //           stb  st1b   en1b  enb   rem
       const auto stb = gr[st], st1b = gr[st + 1], enb = gr[en], en1b = gr[en - 1];
       const auto base00 = gdp[st][en][DP_P] + gem.AuGuPenalty(stb, enb) - gext[st][a];
-      const auto base01 = gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b) - gext[st][a];
-      const auto base10 = gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb) - gext[st][a];
-      const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b) - gext[st][a];
+      const auto base01 = gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b) +
+          gcons.Unpaired(en) - gext[st][a];
+      const auto base10 = gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb) +
+          gcons.Unpaired(st) - gext[st][a];
+      const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b) +
+          gcons.Unpaired(st) + gcons.Unpaired(en) - gext[st][a];
 
       // (   ).<( * ). > Right coax backward
       if (st > 0 && a == EXT_RCOAX) {
@@ -253,15 +1283,17 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
   if (a == DP_P) {
     // Two loops.
     int max_inter = std::min(TWOLOOP_MAX_SZ, en - st - HAIRPIN_MIN_SZ - 3);
-    for (int ist = st + 1; ist < st + max_inter + 2; ++ist) {
-      for (int ien = en - max_inter + ist - st - 2; ien < en; ++ien) {
+    const int max_ist = std::min(st + max_inter + 1, gcons.next_must_pair[st + 1]);
+    for (int ist = st + 1; ist <= max_ist; ++ist) {
+      for (int ien = std::max(en - max_inter + ist - st - 2, gcons.prev_must_pair[en - 1]);
+           ien < en; ++ien) {
         energy = FastTwoLoop(st, en, ist, ien) + gdp[ist][ien][DP_P] - gdp[st][en][a];
         if (energy <= delta) exps.push_back({energy, {ist, ien, DP_P}});
       }
     }
 
     // Hairpin loop
-    energy = FastHairpin(st, en) - gdp[st][en][a];
+    energy = FastHairpin(st, en) + gcons.Unpaired(st + 1, en - 1) - gdp[st][en][a];
     if (energy <= delta) exps.push_back({energy});
 
     auto base_and_branch = gpc.augubranch[stb][enb] + gem.multiloop_hack_a - gdp[st][en][a];
@@ -269,20 +1301,24 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
     energy = base_and_branch + gdp[st + 1][en - 1][DP_U2];
     if (energy <= delta) exps.push_back({energy, {st + 1, en - 1, DP_U2}, {en, CTD_UNUSED}});
     // (3<   ><   >) 3'
-    energy = base_and_branch + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb];
+    energy = base_and_branch + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb] +
+        gcons.Unpaired(st + 1);
     if (energy <= delta) exps.push_back({energy, {st + 2, en - 1, DP_U2}, {en, CTD_3_DANGLE}});
     // (<   ><   >5) 5'
-    energy = base_and_branch + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb];
+    energy = base_and_branch + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb] +
+        gcons.Unpaired(en - 1);
     if (energy <= delta) exps.push_back({energy, {st + 1, en - 2, DP_U2}, {en, CTD_5_DANGLE}});
     // (.<   ><   >.) Terminal mismatch
-    energy = base_and_branch + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb];
+    energy = base_and_branch + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb] +
+        gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1);
     if (energy <= delta) exps.push_back({energy, {st + 2, en - 2, DP_U2}, {en, CTD_MISMATCH}});
 
     for (int piv = st + HAIRPIN_MIN_SZ + 2; piv < en - HAIRPIN_MIN_SZ - 2; ++piv) {
       base_t pl1b = gr[piv - 1], plb = gr[piv], prb = gr[piv + 1], pr1b = gr[piv + 2];
 
       // (.(   )   .) Left outer coax - P
-      auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb);
+      auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb) + gcons.Unpaired(st + 1) +
+          gcons.Unpaired(en - 1);
       energy = base_and_branch + gdp[st + 2][piv][DP_P] + gpc.augubranch[st2b][plb] +
           gdp[piv + 1][en - 2][DP_U] + outer_coax;
       if (energy <= delta)
@@ -298,14 +1334,16 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
 
       // (.(   ).   ) Left right coax
       energy = base_and_branch + gdp[st + 2][piv - 1][DP_P] + gpc.augubranch[st2b][pl1b] +
-          gdp[piv + 1][en - 1][DP_U] + gem.MismatchCoaxial(pl1b, plb, st1b, st2b);
+          gdp[piv + 1][en - 1][DP_U] + gem.MismatchCoaxial(pl1b, plb, st1b, st2b) +
+          gcons.Unpaired(st + 1) + gcons.Unpaired(piv);
       if (energy <= delta)
         exps.push_back({energy, {st + 2, piv - 1, DP_P}, {piv + 1, en - 1, DP_U},
             {st + 2, CTD_RCOAX_WITH_PREV}, {en, CTD_RCOAX_WITH_NEXT}});
 
       // (   .(   ).) Right left coax
       energy = base_and_branch + gdp[st + 1][piv][DP_U] + gpc.augubranch[pr1b][en2b] +
-          gdp[piv + 2][en - 2][DP_P] + gem.MismatchCoaxial(en2b, en1b, prb, pr1b);
+          gdp[piv + 2][en - 2][DP_P] + gem.MismatchCoaxial(en2b, en1b, prb, pr1b) +
+          gcons.Unpaired(piv + 1) + gcons.Unpaired(en - 1);
       if (energy <= delta)
         exps.push_back({energy, {st + 1, piv, DP_U}, {piv + 2, en - 2, DP_P},
             {piv + 2, CTD_LCOAX_WITH_NEXT}, {en, CTD_LCOAX_WITH_PREV}});
@@ -329,7 +1367,7 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
 
   // Left unpaired. Either DP_U or DP_U2.
   if (st + 1 < en && (a == DP_U || a == DP_U2)) {
-    energy = gdp[st + 1][en][a] - gdp[st][en][a];
+    energy = gdp[st + 1][en][a] + gcons.Unpaired(st) - gdp[st][en][a];
     if (energy <= delta) exps.push_back({energy, {st + 1, en, a}});
   }
 
@@ -340,9 +1378,14 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
     auto pb = gr[piv], pl1b = gr[piv - 1];
     // baseAB indicates A bases left unpaired on the left, B bases left unpaired on the right.
     auto base00 = gdp[st][piv][DP_P] + gpc.augubranch[stb][pb] - gdp[st][en][a];
-    auto base01 = gdp[st][piv - 1][DP_P] + gpc.augubranch[stb][pl1b] - gdp[st][en][a];
-    auto base10 = gdp[st + 1][piv][DP_P] + gpc.augubranch[st1b][pb] - gdp[st][en][a];
-    auto base11 = gdp[st + 1][piv - 1][DP_P] + gpc.augubranch[st1b][pl1b] - gdp[st][en][a];
+    auto base01 = gdp[st][piv - 1][DP_P] + gpc.augubranch[stb][pl1b] + gcons.Unpaired(piv) -
+        gdp[st][en][a];
+    auto base10 = gdp[st + 1][piv][DP_P] + gpc.augubranch[st1b][pb] + gcons.Unpaired(st) -
+        gdp[st][en][a];
+    auto base11 = gdp[st + 1][piv - 1][DP_P] + gpc.augubranch[st1b][pl1b] + gcons.Unpaired(st) +
+        gcons.Unpaired(piv) - gdp[st][en][a];
+    // Whether the rest of the range after this branch may be left unpaired.
+    const bool can_unpair_right = gcons.CanUnpair(piv + 1, en);
 
     // Check a == U_RCOAX:
     // (   ).<( ** ). > Right coax backward
@@ -350,7 +1393,7 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
       if (st > 0) {
         energy = base01 + gem.MismatchCoaxial(pl1b, pb, gr[st - 1], stb);
         // Our ctds will have already been set by now.
-        if (energy <= delta) exps.push_back({energy, {st, piv - 1, DP_P}});
+        if (energy <= delta && can_unpair_right) exps.push_back({energy, {st, piv - 1, DP_P}});
         if (energy + gdp[piv + 1][en][DP_U] <= delta)
           exps.push_back(
               {energy + gdp[piv + 1][en][DP_U], {st, piv - 1, DP_P}, {piv + 1, en, DP_U}});
@@ -362,7 +1405,8 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
     // (   )<   > - U, U2, U_WC?, U_GU?
     energy = base00;
     if (a == DP_U) {
-      if (energy <= delta) exps.push_back({energy, {st, piv, DP_P}, {st, CTD_UNUSED}});
+      if (energy <= delta && can_unpair_right)
+        exps.push_back({energy, {st, piv, DP_P}, {st, CTD_UNUSED}});
       if (energy + gdp[piv + 1][en][DP_U] <= delta)
         exps.push_back({energy + gdp[piv + 1][en][DP_U], {st, piv, DP_P}, {piv + 1, en, DP_U},
             {st, CTD_UNUSED}});
@@ -373,7 +1417,7 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
     if (a == DP_U_WC || a == DP_U_GU) {
       // Make sure we don't form any branches that are not the right type of pair.
       if ((a == DP_U_WC && IsWatsonCrick(stb, pb)) || (a == DP_U_GU && IsGu(stb, pb))) {
-        if (energy <= delta) exps.push_back({energy, {st, piv, DP_P}});
+        if (energy <= delta && can_unpair_right) exps.push_back({energy, {st, piv, DP_P}});
         if (energy + gdp[piv + 1][en][DP_U] <= delta)
           exps.push_back({energy + gdp[piv + 1][en][DP_U], {st, piv, DP_P}, {piv + 1, en, DP_U}});
       }
@@ -385,7 +1429,7 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
     // (   )3<   > 3' - U, U2
     energy = base01 + gem.dangle3[pl1b][pb][stb];
     // Can only let the rest be unpaired if we only need one branch, i.e. DP_U not DP_U2.
-    if (a == DP_U && energy <= delta)
+    if (a == DP_U && energy <= delta && can_unpair_right)
       exps.push_back({energy, {st, piv - 1, DP_P}, {st, CTD_3_DANGLE}});
     if (energy + gdp[piv + 1][en][DP_U] <= delta)
       exps.push_back({energy + gdp[piv + 1][en][DP_U], {st, piv - 1, DP_P}, {piv + 1, en, DP_U},
@@ -393,7 +1437,7 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
 
     // 5(   )<   > 5' - U, U2
     energy = base10 + gem.dangle5[pb][stb][st1b];
-    if (a == DP_U && energy <= delta)
+    if (a == DP_U && energy <= delta && can_unpair_right)
       exps.push_back({energy, {st + 1, piv, DP_P}, {st + 1, CTD_5_DANGLE}});
     if (energy + gdp[piv + 1][en][DP_U] <= delta)
       exps.push_back({energy + gdp[piv + 1][en][DP_U], {st + 1, piv, DP_P}, {piv + 1, en, DP_U},
@@ -401,7 +1445,7 @@ std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delt
 
     // .(   ).<   > Terminal mismatch - U, U2
     energy = base11 + gem.terminal[pl1b][pb][stb][st1b];
-    if (a == DP_U && energy <= delta)
+    if (a == DP_U && energy <= delta && can_unpair_right)
       exps.push_back({energy, {st + 1, piv - 1, DP_P}, {}, {st + 1, CTD_MISMATCH}});
     if (energy + gdp[piv + 1][en][DP_U] <= delta)
       exps.push_back({energy + gdp[piv + 1][en][DP_U], {st + 1, piv - 1, DP_P}, {piv + 1, en, DP_U},
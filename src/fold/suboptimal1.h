@@ -16,75 +16,271 @@
 #define KEKRNA_SUBOPTIMAL1_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
 #include "common.h"
+#include "fold/expansion_cache.h"
 #include "fold/fold.h"
-#include "splaymap.h"
+#include "fold/shapes.h"
+#include "fold/structure_hash.h"
+#include "fold/suboptimal_filter.h"
 
 namespace kekrna {
 namespace fold {
 namespace internal {
 
-struct expand_t {
-  expand_t() = delete;
-  expand_t(energy_t energy_) : energy(energy_) {}
-  expand_t(energy_t energy_, const index_t& to_expand_) : energy(energy_), to_expand(to_expand_) {}
-  expand_t(energy_t energy_, const index_t& to_expand_, const index_t& unexpanded_)
-      : energy(energy_), to_expand(to_expand_), unexpanded(unexpanded_) {}
-  expand_t(energy_t energy_, const index_t& to_expand_, const ctd_idx_t& ctd0_)
-      : energy(energy_), to_expand(to_expand_), ctd0(ctd0_) {}
-  expand_t(energy_t energy_, const index_t& to_expand_, const index_t& unexpanded_,
-      const ctd_idx_t& ctd0_)
-      : energy(energy_), to_expand(to_expand_), unexpanded(unexpanded_), ctd0(ctd0_) {}
-  expand_t(energy_t energy_, const index_t& to_expand_, const index_t& unexpanded_,
-      const ctd_idx_t& ctd0_, const ctd_idx_t& ctd1_)
-      : energy(energy_), to_expand(to_expand_), unexpanded(unexpanded_), ctd0(ctd0_), ctd1(ctd1_) {}
-  energy_t energy;
-  index_t to_expand, unexpanded;  // st is -1 if this does not exist
-  ctd_idx_t ctd0, ctd1;
-
-  bool operator<(const expand_t& o) const { return energy < o.energy; }
-};
-
 std::vector<expand_t> GenerateExpansions(const index_t& to_expand, energy_t delta);
 
+// Where Suboptimal1 reports structures. Exactly one of these is set.
+struct subopt_sink_t {
+  SuboptimalCallback fn;
+  SuboptimalViewCallback view_fn;
+};
+
 class Suboptimal1 {
 public:
-  Suboptimal1(energy_t delta_, int num) :
+  // With |num_threads_| > 1, the expansion tree is split at a shallow depth into subtrees which
+  // are enumerated in parallel. If |deterministic_|, structures are reported in the same order
+  // as the serial enumeration. Otherwise, they are reported as they are found, which is faster
+  // but only ordered by energy if sorted output is requested. A structure limit always uses the
+  // deterministic order, so the same structures are reported as by the serial enumeration.
+  // Sorted output breaks ties in energy in the order of the unsorted serial enumeration.
+  // With |num_shards_| > 1, only the |shard_|th of |num_shards_| disjoint slices of the structures
+  // is enumerated. The slices only depend on the tables, so separate processes can each run one.
+  // Each thread caches expansions in at most |max_cache_bytes_| / |num_threads_| bytes, or
+  // without limit if it is zero.
+  // If |unique_|, each secondary structure is reported once, with the CTDs which give it the
+  // lowest energy. This only runs on one thread and can't be sharded.
+  // Only structures satisfying |filter_| are enumerated. It must not limit the number of pairs or
+  // multiloops if |unique_|.
+  Suboptimal1(energy_t delta_, int num, int num_threads_ = 1, bool deterministic_ = true,
+      int shard_ = 0, int num_shards_ = 1, std::size_t max_cache_bytes_ = 0,
+      bool unique_ = false, const suboptimal_filter_t& filter_ = {}) :
       delta(delta_ == -1 ? CAP_E : delta_),
-      max_structures(num == -1 ? MAX_STRUCTURES : num) {}
+      max_structures(num == -1 ? MAX_STRUCTURES : num),
+      num_threads(num_threads_), deterministic(deterministic_),
+      shard(shard_), num_shards(num_shards_), unique(unique_),
+      filter(PrecomputeSuboptimalFilter(int(gr.size()), filter_)) {
+    verify_expr(num_threads >= 1, "need at least one thread");
+    verify_expr(num_shards >= 1 && shard >= 0 && shard < num_shards, "invalid shard %d of %d",
+        shard, num_shards);
+    verify_expr(!unique || (num_threads == 1 && num_shards == 1),
+        "unique suboptimal folding only supports one thread and shard");
+    verify_expr(!unique || !filter.LimitsCounts(),
+        "unique suboptimal folding can't limit the number of pairs or multiloops");
+    for (int i = 0; i < num_threads; ++i)
+      caches.emplace_back(max_cache_bytes_ / std::size_t(num_threads));
+  }
 
   int Run(SuboptimalCallback fn, bool sorted);
+  // Reports views of the search state instead, so no structures are copied.
+  int RunViews(SuboptimalViewCallback fn, bool sorted);
+  // Reports structures in nondecreasing energy order, one energy level at a time, until every
+  // level within the delta is done or a budget runs out: the structure limit, |memory_bytes| of
+  // expansion cache including its index table, or |deadline|. Structures of the level being
+  // enumerated when a budget runs out are reported, but that level isn't covered. Zero
+  // |memory_bytes| means no limit.
+  suboptimal_anytime_t RunAnytime(SuboptimalViewCallback fn, std::size_t memory_bytes,
+      std::chrono::steady_clock::time_point deadline_);
+  // Pull style enumeration, in the order of the serial unsorted enumeration. Reports the next
+  // structure through |fn| and returns true, or returns false if there are none left.
+  bool Next(SuboptimalViewCallback fn);
+  // Where Next is up to: the dfs stack and the unexpanded stack. The structure built so far is
+  // derived from them again by SetPosition, on any Suboptimal1 with the same delta and filter
+  // over the same tables. SetPosition returns false if |position| is invalid for the sequence.
+  std::vector<int> Position() const;
+  bool SetPosition(const std::vector<int>& position);
+  // Returns the number of structures of each energy from the MFE up to the MFE plus |delta|,
+  // without enumerating them. Counts beyond 2^53 are approximate. The filter must not limit the
+  // number of pairs or multiloops.
+  std::vector<double> CountByEnergy();
+  // Returns the best structure of each abstract shape at |level| within the delta, in order of
+  // energy, without enumerating the structures. At most the structure limit are returned. The
+  // filter must not limit the number of pairs or multiloops.
+  std::vector<shape_rep_t> BestShapes(int level);
 
 private:
   constexpr static int MAX_STRUCTURES = std::numeric_limits<int>::max() / 4;
+  // Split the tree until there are this many subtrees per thread, to balance the load.
+  constexpr static int TASKS_PER_THREAD = 32;
+  // Shards must split the tree identically whatever the number of threads in each process.
+  constexpr static int TASKS_PER_SHARD = 256;
+  constexpr static int MAX_SPLIT_DEPTH = 64;
+  // Searches check the anytime budgets this often, since reading the clock is slow.
+  constexpr static int BUDGET_CHECK_STEPS = 4096;
 
   struct dfs_state_t {
     int idx;
     index_t expand;
     // Stores whether this node's |expand| was from |unexpanded| and needs to be replaced.
     bool should_unexpand;
+    // Expansions of |expand|, looked up again if the cache has been evicted since |generation|.
+    const packed_expand_t* exps;
+    int num_exps;
+    uint32_t generation;
+  };
+
+  // Everything a depth first search over (part of) the expansion tree modifies. Each thread has
+  // its own. The dfs stack is also used to describe an unexplored subtree: its root, with the
+  // state at the point it was reached. A subtree with an empty stack is a single structure.
+  struct dfs_t {
+    std::vector<dfs_state_t> q;
+    std::vector<index_t> unexpanded;
+    primary_t r;
+    std::vector<int> p;
+    std::vector<Ctd> ctd;
+    std::string rep;
+    energy_t energy;
+    // Only tracked if the filter limits them.
+    int num_pairs;
+    int num_multiloops;
+    // The StructureHash of |p| and |ctd|. Changes to them go through these, to keep it up to date.
+    uint64_t hash;
+
+    void SetPair(int st, int en) {
+      p[st] = en;
+      p[en] = st;
+      rep[st] = '(';
+      rep[en] = ')';
+      hash ^= PairHash(st, en);
+    }
+    void UnsetPair(int st, int en) {
+      p[st] = p[en] = -1;
+      rep[st] = rep[en] = '.';
+      hash ^= PairHash(st, en);
+    }
+    // Both do nothing for ctd_idx_t with no index.
+    void SetCtd(const ctd_idx_t& ctd_idx) {
+      if (ctd_idx.idx == -1) return;
+      ctd[ctd_idx.idx] = ctd_idx.ctd;
+      hash ^= CtdHash(ctd_idx.idx, ctd_idx.ctd);
+    }
+    void UnsetCtd(const ctd_idx_t& ctd_idx) {
+      if (ctd_idx.idx == -1) return;
+      hash ^= CtdHash(ctd_idx.idx, ctd[ctd_idx.idx]);
+      ctd[ctd_idx.idx] = CTD_NA;
+    }
+  };
+
+  typedef std::function<void(dfs_t&)> EmitFn;
+
+  // The search for unique secondary structures decides what each base pairs with from left to
+  // right, so each secondary structure has one path. A node holds every partial structure which
+  // made the same decisions, but with different CTDs and so different ranges left to expand.
+  struct unique_alt_t {
+    std::vector<index_t> unexpanded;  // Sorted.
+    std::vector<ctd_idx_t> ctds;
+    energy_t energy;
+  };
+
+  // The children of the node deciding base |st|, by what it pairs with, or -1 if unpaired. Bases
+  // before it with only one choice are decided without frames, pairing the bases in |forced|.
+  struct unique_frame_t {
+    int st;
+    std::vector<int> forced;
+    std::vector<std::pair<int, std::vector<unique_alt_t>>> children;
+    int idx;
+  };
+
+  // Nodes of the best first search used for sorted output. A node is a partial structure: the
+  // expansions chosen on the path from the root, the unexpanded stack, and what to expand next.
+  // Nodes and unexpanded stack entries are shared persistently and reference counted, so memory
+  // is reclaimed as soon as nothing on the frontier can reach them.
+  struct sorted_node_t {
+    int parent;
+    int depth;
+    int refs;
+    int unexpanded;  // Index of the top of the unexpanded stack, or -1.
+    int exp_idx;  // The expansion of |parent| which led here.
+    uint32_t generation;
+    index_t expand;
+    const packed_expand_t* exps;
+    int num_exps;
+    energy_t energy;
+    // Pairs and multiloops added by the path to this node, if the filter limits them.
+    int num_pairs;
+    int num_multiloops;
+  };
+
+  struct sorted_unexpanded_t {
+    index_t expand;
+    int next;
+    int refs;
+  };
+
+  // Choosing the |idx|th expansion of |node|. Entries are bucketed by the energy they give.
+  struct sorted_entry_t {
+    int node;
+    int idx;
   };
 
   const energy_t delta;
   const int max_structures;
-  // This node is where we build intermediate results to be pushed onto the queue.
-  SplayMap<index_t, std::vector<expand_t>> cache;
-  std::vector<dfs_state_t> q;
-  std::vector<index_t> unexpanded;
+  const int num_threads;
+  const bool deterministic;
+  const int shard;
+  const int num_shards;
+  const bool unique;
+  const suboptimal_filter_precomp_t filter;
+  // One per thread, so lookups never need to lock. The first is also used outside of workers.
+  std::vector<ExpansionCache> caches;
+  // The state of Next, or empty before it is first called.
+  dfs_t cursor;
+  bool has_cursor = false;
+  // Anytime budgets. |budget_cache_bytes| is per thread, and zero for no limit.
+  bool budgeted = false;
+  std::size_t budget_cache_bytes = 0;
+  std::chrono::steady_clock::time_point deadline;
+  std::atomic<bool> out_of_budget{false};
 
-  std::pair<int, int> RunInternal(SuboptimalCallback fn,
+  int Run(const subopt_sink_t& sink, bool sorted);
+  dfs_t RootState() const;
+  void StartCursor();
+  // Reports structures in nondecreasing energy order with a best first search. Structures of
+  // the same energy are in depth first order, like the split passes report them.
+  int RunSorted(const subopt_sink_t& sink);
+  // Reports structures with energy in (|emit_above|, |bound|]. Returns the number of structures
+  // and the smallest energy above |bound| seen.
+  std::pair<int, int> RunSortedPass(const subopt_sink_t& sink, energy_t bound,
+      energy_t emit_above, int structure_limit);
+  // Returns the number of structures and the smallest energy above |cur_delta| seen.
+  std::pair<int, int> RunPass(const subopt_sink_t& sink,
+      energy_t cur_delta, bool exact_energy, int structure_limit);
+  std::pair<int, int> RunSplitPass(const subopt_sink_t& sink,
+      energy_t cur_delta, bool exact_energy, int structure_limit);
+  // Reports each secondary structure with best energy at most |cur_delta|, or exactly |cur_delta|
+  // if |exact_energy|. Returns the number of structures and the smallest energy above
+  // |cur_delta| seen.
+  std::pair<int, int> RunUniquePass(const subopt_sink_t& sink,
       energy_t cur_delta, bool exact_energy, int structure_limit);
+  // Expands |alt| until it decides base |st|, adding each result to |out| with what |st| pairs
+  // with. |p| holds the pairs decided for the bases before |st|. Returns whether |alt| needed
+  // expanding.
+  bool DecideUnique(unique_alt_t&& alt, int st, energy_t cur_delta, const std::vector<int>& p,
+      std::vector<std::pair<int, unique_alt_t>>& out, energy_t& next_seen);
+  // Runs until the dfs stack of |d| is empty. If |tasks| is given, nodes at depth |split_depth|
+  // and structures are added to it instead of being explored or emitted.
+  std::pair<int, int> RunInternal(ExpansionCache& cache, dfs_t& d, const EmitFn& emit,
+      energy_t cur_delta, bool exact_energy, int structure_limit, int split_depth,
+      std::vector<dfs_t>* tasks);
 
-  const std::vector<expand_t>& GetExpansion(const index_t& to_expand) {
-    if (!cache.Find(to_expand)) {
-      // Need to generate the full way to delta so we can properly set |next_seen|.
-      auto exps = GenerateExpansions(to_expand, delta);
-      std::sort(exps.begin(), exps.end());
-      auto res = cache.Insert(to_expand, std::move(exps));
-      assert(res);
-    }
-    return cache.Get();
-  }
+  // The indices reachable from the root, numbered by |nums| in an order with children before
+  // their parents. An index reached with at least |dists| energy above the MFE only needs
+  // results up to |delta| - |dists|, which is much less for most indices.
+  struct index_order_t {
+    std::vector<int> nums;
+    std::vector<index_t> order;
+    std::vector<energy_t> dists;
+  };
+  index_order_t OrderIndices(ExpansionCache& cache);
+
+  // Returns whether a budget has run out, checking |cache| against the memory budget.
+  bool OutOfBudget(const ExpansionCache& cache);
+  // Returns the expansions of |to_expand| allowed by the filter, sorted by energy, and how many
+  // there are. Looking up expansions which aren't cached may evict the ones returned before.
+  std::pair<const packed_expand_t*, int> GetExpansion(
+      ExpansionCache& cache, const index_t& to_expand);
 };
 }
 }
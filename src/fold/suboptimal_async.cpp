@@ -0,0 +1,91 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include "fold/suboptimal_async.h"
+
+namespace kekrna {
+namespace fold {
+
+AsyncSuboptimalCallback::AsyncSuboptimalCallback(
+    SuboptimalViewCallback fn_, const primary_t& r_, int capacity_)
+    : fn(fn_), r(r_), capacity(std::size_t(capacity_)), ps(capacity * r.size()),
+      ctds(capacity * r.size()), dbs(capacity * (r.size() + 1)), energies(capacity),
+      hashes(capacity), batch(std::max<std::size_t>(capacity / 4, 1)), head(0),
+      tail(0), done(false), producer_waiting(false), consumer_waiting(false) {
+  verify_expr(capacity_ > 0, "need space for at least one structure");
+  writer = std::thread(&AsyncSuboptimalCallback::Run, this);
+}
+
+AsyncSuboptimalCallback::~AsyncSuboptimalCallback() { Finish(); }
+
+void AsyncSuboptimalCallback::Push(const subopt_view_t& view) {
+  const std::size_t N = r.size();
+  assert(view.p.Size() == N && view.base_ctds.Size() == N && view.db.Size() == N);
+  const uint64_t idx = head.load(std::memory_order_relaxed);
+  if (idx - tail.load(std::memory_order_acquire) == capacity) {
+    // Full, so wait for the writer to catch up.
+    std::unique_lock<std::mutex> guard(lock);
+    producer_waiting = true;
+    cv.wait(guard, [this, idx] { return idx - tail.load() + batch <= capacity; });
+    producer_waiting = false;
+  }
+  const std::size_t slot = idx % capacity;
+  std::copy(view.p.begin(), view.p.end(), &ps[slot * N]);
+  std::copy(view.base_ctds.begin(), view.base_ctds.end(), &ctds[slot * N]);
+  std::copy(view.db.begin(), view.db.end(), &dbs[slot * (N + 1)]);
+  dbs[slot * (N + 1) + N] = '\0';
+  energies[slot] = view.energy;
+  hashes[slot] = view.hash;
+  head.store(idx + 1);
+  if (consumer_waiting && idx + 1 - tail.load() >= batch) {
+    std::lock_guard<std::mutex> guard(lock);
+    cv.notify_all();
+  }
+}
+
+void AsyncSuboptimalCallback::Finish() {
+  if (!writer.joinable()) return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    done = true;
+    cv.notify_all();
+  }
+  writer.join();
+}
+
+void AsyncSuboptimalCallback::Run() {
+  const std::size_t N = r.size();
+  while (true) {
+    const uint64_t idx = tail.load(std::memory_order_relaxed);
+    if (idx == head.load(std::memory_order_acquire)) {
+      // Empty, so wait for more structures or the end.
+      std::unique_lock<std::mutex> guard(lock);
+      consumer_waiting = true;
+      cv.wait(guard, [this, idx] { return head.load() - idx >= batch || done; });
+      consumer_waiting = false;
+      if (idx == head.load()) return;
+    }
+    const std::size_t slot = idx % capacity;
+    fn({r, {&ps[slot * N], N}, {&ctds[slot * N], N}, {&dbs[slot * (N + 1)], N}, energies[slot],
+        hashes[slot]});
+    tail.store(idx + 1);
+    if (producer_waiting && head.load() - (idx + 1) + batch <= capacity) {
+      std::lock_guard<std::mutex> guard(lock);
+      cv.notify_all();
+    }
+  }
+}
+}
+}
@@ -0,0 +1,70 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_SUBOPTIMAL_ASYNC_H
+#define KEKRNA_FOLD_SUBOPTIMAL_ASYNC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "common.h"
+#include "fold/fold.h"
+
+namespace kekrna {
+namespace fold {
+
+// Runs a view callback on its own thread, e.g. to format and write structures while the
+// enumeration carries on. Views are copied into a bounded ring buffer, and Push blocks while it
+// is full. Push must only be called from one thread at a time.
+class AsyncSuboptimalCallback {
+public:
+  AsyncSuboptimalCallback(SuboptimalViewCallback fn_, const primary_t& r_, int capacity_ = 4096);
+  ~AsyncSuboptimalCallback();
+  AsyncSuboptimalCallback(const AsyncSuboptimalCallback&) = delete;
+  AsyncSuboptimalCallback& operator=(const AsyncSuboptimalCallback&) = delete;
+
+  void Push(const subopt_view_t& view);
+  // Waits for every structure pushed so far to be handled. No more may be pushed after this.
+  void Finish();
+
+private:
+  const SuboptimalViewCallback fn;
+  const primary_t r;
+  const std::size_t capacity;
+  // Slot i of the ring holds the |i|th structure modulo |capacity|.
+  std::vector<int> ps;
+  std::vector<Ctd> ctds;
+  std::vector<char> dbs;  // Each is null terminated.
+  std::vector<energy_t> energies;
+  std::vector<uint64_t> hashes;
+  // A sleeping side is only woken once it can handle this many structures, so that it does not
+  // wake for every single one.
+  const std::size_t batch;
+  // Only written by the pushing thread and the writer thread, respectively.
+  std::atomic<uint64_t> head, tail;
+  std::atomic<bool> done;
+  // Only used to sleep when the ring is full or empty. Each side only notifies if the other is
+  // waiting, so there are no lock operations while both keep up.
+  std::mutex lock;
+  std::condition_variable cv;
+  std::atomic<bool> producer_waiting, consumer_waiting;
+  std::thread writer;
+
+  void Run();
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_SUBOPTIMAL_ASYNC_H
@@ -0,0 +1,174 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include "fold/suboptimal_binary.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+const char SUBOPT_MAGIC[8] = {'K', 'E', 'K', 'S', 'U', 'B', 0, 1};
+
+uint64_t ZigZag(int64_t value) { return (uint64_t(value) << 1) ^ uint64_t(value >> 63); }
+int64_t UnZigZag(uint64_t value) { return int64_t(value >> 1) ^ -int64_t(value & 1); }
+
+// Calls |fn| with each index where |a| and |b| differ, in order. They usually only differ in a few
+// places, so equal blocks are skipped with memcmp.
+template <typename T, typename Fn>
+void ForEachDifference(const T* a, const T* b, int n, Fn fn) {
+  const int BLOCK_SIZE = 64;
+  for (int st = 0; st < n; st += BLOCK_SIZE) {
+    const int en = std::min(st + BLOCK_SIZE, n);
+    if (memcmp(a + st, b + st, std::size_t(en - st) * sizeof(T)) == 0) continue;
+    for (int i = st; i < en; ++i) {
+      if (a[i] != b[i]) fn(i);
+    }
+  }
+}
+}
+
+SuboptimalBinaryWriter::SuboptimalBinaryWriter(FILE* fp_, const primary_t& r)
+    : fp(fp_), prev_p(r.size(), -1), prev_ctds(r.size(), CTD_NA), prev_energy(0) {
+  buf.reserve(BUFFER_SIZE);
+  buf.insert(buf.end(), SUBOPT_MAGIC, SUBOPT_MAGIC + sizeof(SUBOPT_MAGIC));
+  WriteVarint(r.size());
+  buf.insert(buf.end(), r.begin(), r.end());
+}
+
+SuboptimalBinaryWriter::~SuboptimalBinaryWriter() { Flush(); }
+
+void SuboptimalBinaryWriter::Write(const subopt_view_t& view) {
+  const int N = int(prev_p.size());
+  assert(int(view.p.Size()) == N && int(view.base_ctds.Size()) == N);
+  removed.clear();
+  added.clear();
+  ctd_changes.clear();
+  ForEachDifference(view.p.Data(), prev_p.data(), N, [&](int i) {
+    if (prev_p[i] > i) removed.push_back(i);
+    if (view.p[i] > i) added.push_back(i);
+    prev_p[i] = view.p[i];
+  });
+  ForEachDifference(view.base_ctds.Data(), prev_ctds.data(), N, [&](int i) {
+    ctd_changes.push_back(i);
+    prev_ctds[i] = view.base_ctds[i];
+  });
+
+  WriteVarint(ZigZag(int64_t(view.energy) - prev_energy));
+  prev_energy = view.energy;
+  // Positions are increasing, so store the gaps between them.
+  WriteVarint(removed.size());
+  int prev = 0;
+  for (int st : removed) {
+    WriteVarint(uint64_t(st - prev));
+    prev = st;
+  }
+  WriteVarint(added.size());
+  prev = 0;
+  for (int st : added) {
+    WriteVarint(uint64_t(st - prev));
+    WriteVarint(uint64_t(view.p[st] - st));
+    prev = st;
+  }
+  WriteVarint(ctd_changes.size());
+  prev = 0;
+  for (int i : ctd_changes) {
+    WriteVarint(uint64_t(i - prev));
+    buf.push_back(uint8_t(view.base_ctds[i]));
+    prev = i;
+  }
+  if (buf.size() >= BUFFER_SIZE) Flush();
+}
+
+void SuboptimalBinaryWriter::Flush() {
+  if (buf.empty()) return;
+  verify_expr(fwrite(buf.data(), 1, buf.size(), fp) == buf.size(), "failed to write structures");
+  buf.clear();
+}
+
+void SuboptimalBinaryWriter::WriteVarint(uint64_t value) {
+  while (value >= 0x80) {
+    buf.push_back(uint8_t(value | 0x80));
+    value >>= 7;
+  }
+  buf.push_back(uint8_t(value));
+}
+
+SuboptimalBinaryReader::SuboptimalBinaryReader(FILE* fp_) : fp(fp_), buf_pos(0) {
+  char magic[sizeof(SUBOPT_MAGIC)];
+  for (auto& c : magic)
+    c = char(ReadByte());
+  verify_expr(memcmp(magic, SUBOPT_MAGIC, sizeof(magic)) == 0, "not a binary subopt file");
+  const int N = int(ReadVarint());
+  primary_t r(std::size_t(N), 0);
+  for (auto& b : r)
+    b = base_t(ReadByte());
+  computed = computed_t(r);
+  computed.energy = 0;
+}
+
+bool SuboptimalBinaryReader::Next() {
+  if (buf_pos == buf.size() && !Refill()) return false;
+  const int N = int(computed.s.r.size());
+  auto& p = computed.s.p;
+  computed.energy = energy_t(computed.energy + UnZigZag(ReadVarint()));
+  int st = 0;
+  for (int i = int(ReadVarint()); i > 0; --i) {
+    st += int(ReadVarint());
+    verify_expr(st < N && p[st] > st, "corrupt binary subopt file");
+    p[p[st]] = -1;
+    p[st] = -1;
+  }
+  st = 0;
+  for (int i = int(ReadVarint()); i > 0; --i) {
+    st += int(ReadVarint());
+    const int en = st + int(ReadVarint());
+    verify_expr(en < N && p[st] == -1 && p[en] == -1, "corrupt binary subopt file");
+    p[st] = en;
+    p[en] = st;
+  }
+  int idx = 0;
+  for (int i = int(ReadVarint()); i > 0; --i) {
+    idx += int(ReadVarint());
+    const auto ctd = Ctd(ReadByte());
+    verify_expr(idx < N && ctd < CTD_SIZE, "corrupt binary subopt file");
+    computed.base_ctds[idx] = ctd;
+  }
+  return true;
+}
+
+bool SuboptimalBinaryReader::Refill() {
+  buf.resize(BUFFER_SIZE);
+  buf.resize(fread(buf.data(), 1, BUFFER_SIZE, fp));
+  buf_pos = 0;
+  return !buf.empty();
+}
+
+uint8_t SuboptimalBinaryReader::ReadByte() {
+  verify_expr(buf_pos < buf.size() || Refill(), "truncated binary subopt file");
+  return buf[buf_pos++];
+}
+
+uint64_t SuboptimalBinaryReader::ReadVarint() {
+  uint64_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    verify_expr(shift < 64, "corrupt binary subopt file");
+    const uint8_t byte = ReadByte();
+    value |= uint64_t(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return value;
+  }
+}
+}
+}
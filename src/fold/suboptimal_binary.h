@@ -0,0 +1,82 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_SUBOPTIMAL_BINARY_H
+#define KEKRNA_FOLD_SUBOPTIMAL_BINARY_H
+
+#include <cstdio>
+#include "common.h"
+#include "fold/fold.h"
+
+namespace kekrna {
+namespace fold {
+
+// Compact binary format for suboptimal structures. After a header holding the primary sequence,
+// each structure is stored as its energy and the pairs and CTDs which changed since the previous
+// structure, as varints. Consecutive structures from the enumeration share most of their pairs,
+// so this is usually a few bytes per structure.
+class SuboptimalBinaryWriter {
+public:
+  // |fp| must stay open until the writer is destroyed.
+  SuboptimalBinaryWriter(FILE* fp_, const primary_t& r);
+  ~SuboptimalBinaryWriter();
+  SuboptimalBinaryWriter(const SuboptimalBinaryWriter&) = delete;
+  SuboptimalBinaryWriter& operator=(const SuboptimalBinaryWriter&) = delete;
+
+  void Write(const subopt_view_t& view);
+  void Flush();
+
+private:
+  constexpr static std::size_t BUFFER_SIZE = 1 << 20;
+
+  FILE* fp;
+  std::vector<uint8_t> buf;
+  std::vector<int> prev_p;
+  std::vector<Ctd> prev_ctds;
+  energy_t prev_energy;
+  // Scratch space for the changes of the current structure.
+  std::vector<int> removed, added, ctd_changes;
+
+  void WriteVarint(uint64_t value);
+};
+
+class SuboptimalBinaryReader {
+public:
+  // Reads the header from |fp|, which must stay open until the reader is destroyed.
+  explicit SuboptimalBinaryReader(FILE* fp_);
+  SuboptimalBinaryReader(const SuboptimalBinaryReader&) = delete;
+  SuboptimalBinaryReader& operator=(const SuboptimalBinaryReader&) = delete;
+
+  // Decodes the next structure into Current(). Returns false at the end of the file.
+  bool Next();
+  const computed_t& Current() const { return computed; }
+  const primary_t& Primary() const { return computed.s.r; }
+
+private:
+  constexpr static std::size_t BUFFER_SIZE = 1 << 20;
+
+  FILE* fp;
+  std::vector<uint8_t> buf;
+  std::size_t buf_pos;
+  computed_t computed;
+
+  // Returns false at the end of the file.
+  bool Refill();
+  uint8_t ReadByte();
+  uint64_t ReadVarint();
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_SUBOPTIMAL_BINARY_H
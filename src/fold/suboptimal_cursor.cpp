@@ -0,0 +1,71 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <sstream>
+#include "fold/suboptimal_cursor.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+const char CURSOR_MAGIC[] = "kekcursor1";
+}
+
+bool SuboptimalCursor::Next(SuboptimalViewCallback fn) {
+  if (!subopt.Next(fn)) return false;
+  ++num_reported;
+  return true;
+}
+
+bool SuboptimalCursor::Next(computed_t& computed) {
+  return Next([&computed](const subopt_view_t& view) {
+    computed.s.r.assign(view.r.begin(), view.r.end());
+    computed.s.p.assign(view.p.begin(), view.p.end());
+    computed.base_ctds.assign(view.base_ctds.begin(), view.base_ctds.end());
+    computed.energy = view.energy;
+  });
+}
+
+std::string SuboptimalCursor::Position() const {
+  std::ostringstream out;
+  out << CURSOR_MAGIC << ' ' << key << ' ' << internal::gr.size() << ' ' << delta << ' '
+      << num_reported;
+  const auto position = subopt.Position();
+  out << ' ' << position.size();
+  for (int value : position)
+    out << ' ' << value;
+  return out.str();
+}
+
+bool SuboptimalCursor::Restore(const std::string& position_str) {
+  std::istringstream in(position_str);
+  std::string magic;
+  uint32_t position_key = 0;
+  std::size_t N = 0, size = 0;
+  energy_t position_delta = 0;
+  int position_num_reported = 0;
+  in >> magic >> position_key >> N >> position_delta >> position_num_reported >> size;
+  bool ok = in && magic == CURSOR_MAGIC && position_key == key && N == internal::gr.size() &&
+      position_delta == delta && position_num_reported >= 0 && size <= position_str.size();
+  std::vector<int> position(ok ? size : 0);
+  for (auto& value : position)
+    in >> value;
+  ok = ok && in && (in >> std::ws).eof() && subopt.SetPosition(position);
+  if (!ok) subopt.SetPosition({});
+  num_reported = ok ? position_num_reported : 0;
+  return ok;
+}
+}
+}
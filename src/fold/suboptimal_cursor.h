@@ -0,0 +1,59 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_SUBOPTIMAL_CURSOR_H
+#define KEKRNA_FOLD_SUBOPTIMAL_CURSOR_H
+
+#include "common.h"
+#include "fold/suboptimal1.h"
+
+namespace kekrna {
+namespace fold {
+
+// Pulls suboptimal structures one at a time, in the order of the serial unsorted enumeration.
+// Where it is up to can be saved as a string and resumed later, possibly in another process,
+// without walking the tree from the start. It uses the global DP tables, so nothing else may fold
+// while it is in use. Get one from Context::OpenSuboptimalCursor.
+class SuboptimalCursor {
+public:
+  // |key_| identifies the sequence, energy model and options, so positions saved for anything
+  // else are rejected.
+  SuboptimalCursor(energy_t delta_, const suboptimal_filter_t& filter,
+      std::size_t max_cache_bytes, uint32_t key_)
+      : delta(delta_), key(key_), num_reported(0),
+        subopt(delta_, -1, 1, true, 0, 1, max_cache_bytes, false, filter) {}
+  SuboptimalCursor(const SuboptimalCursor&) = delete;
+  SuboptimalCursor& operator=(const SuboptimalCursor&) = delete;
+
+  // Reports the next structure to |fn| and returns true, or returns false if there are no more.
+  bool Next(SuboptimalViewCallback fn);
+  bool Next(computed_t& computed);
+  // The number of structures reported before the current position.
+  int NumReported() const { return num_reported; }
+  // Serialises the current position as a single line of text.
+  std::string Position() const;
+  // Moves to a position returned by Position. Returns false and goes back to the start if it is
+  // malformed or was saved for a different sequence, energy model, delta or options.
+  bool Restore(const std::string& position);
+
+private:
+  const energy_t delta;
+  const uint32_t key;
+  int num_reported;
+  internal::Suboptimal1 subopt;
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_SUBOPTIMAL_CURSOR_H
@@ -0,0 +1,98 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include "fold/suboptimal_filter.h"
+
+namespace kekrna {
+namespace fold {
+namespace internal {
+
+namespace {
+
+// Whether the pair (st, en) can still be formed in the structures below |idx|.
+bool Contains(const index_t& idx, int st, int en) {
+  if (idx.en == -1) return idx.st <= st;
+  if (idx.a == DP_P) return (idx.st == st && idx.en == en) || (idx.st < st && en < idx.en);
+  return idx.st <= st && en <= idx.en;
+}
+}
+
+bool suboptimal_filter_precomp_t::CanPair(int st, int en) const {
+  if (unpaired[st] || unpaired[en]) return false;
+  const auto& avoided = avoid[st];
+  return std::find(avoided.begin(), avoided.end(), en) == avoided.end();
+}
+
+bool suboptimal_filter_precomp_t::Allows(const index_t& idx, const expand_t& exp) const {
+  for (const auto& child : {exp.to_expand, exp.unexpanded}) {
+    if (child.st != -1 && child.en != -1 && child.a == DP_P && !CanPair(child.st, child.en))
+      return false;
+  }
+  // Every required pair inside |idx| must be formed below one of the children. The pair of a
+  // DP_P index itself was already required of the expansion which added it.
+  int lo = idx.st, hi = idx.en;
+  if (idx.en == -1) {
+    hi = N - 1;
+  } else if (idx.a == DP_P) {
+    ++lo;
+    --hi;
+  }
+  for (const auto& pair : contain) {
+    if (pair.first < lo) continue;
+    if (pair.first > hi) break;
+    if (pair.second > hi) continue;
+    if ((exp.to_expand.st == -1 || !Contains(exp.to_expand, pair.first, pair.second)) &&
+        (exp.unexpanded.st == -1 || !Contains(exp.unexpanded, pair.first, pair.second)))
+      return false;
+  }
+  return true;
+}
+
+suboptimal_filter_precomp_t PrecomputeSuboptimalFilter(int N, const suboptimal_filter_t& filter) {
+  suboptimal_filter_precomp_t fp;
+  fp.active = !filter.must_contain.empty() || !filter.must_avoid.empty() ||
+      !filter.must_unpaired.empty();
+  fp.N = N;
+  fp.contain = filter.must_contain;
+  fp.unpaired.assign(N, 0);
+  fp.avoid.resize(N);
+  fp.max_pairs = filter.max_pairs;
+  fp.max_multiloops = filter.max_multiloops;
+  verify_expr(fp.max_pairs >= -1 && fp.max_multiloops >= -1, "invalid suboptimal filter limit");
+
+  std::vector<int> partner(N, -1);
+  for (const auto& pair : fp.contain) {
+    const int st = pair.first, en = pair.second;
+    verify_expr(st >= 0 && st < en && en < N, "required pair (%d, %d) out of range", st, en);
+    verify_expr(partner[st] == -1 && partner[en] == -1,
+        "base in more than one required pair (%d, %d)", st, en);
+    partner[st] = en;
+    partner[en] = st;
+  }
+  std::sort(fp.contain.begin(), fp.contain.end());
+  for (auto i : filter.must_unpaired) {
+    verify_expr(i >= 0 && i < N, "unpaired base %d out of range", i);
+    fp.unpaired[i] = 1;
+  }
+  for (const auto& pair : filter.must_avoid) {
+    verify_expr(pair.first >= 0 && pair.first < pair.second && pair.second < N,
+        "avoided pair (%d, %d) out of range", pair.first, pair.second);
+    fp.avoid[pair.first].push_back(pair.second);
+  }
+  return fp;
+}
+}
+}
+}
@@ -0,0 +1,76 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_SUBOPTIMAL_FILTER_H
+#define KEKRNA_FOLD_SUBOPTIMAL_FILTER_H
+
+#include "common.h"
+#include "fold/expansion_cache.h"
+
+namespace kekrna {
+namespace fold {
+
+// Predicates on the structures reported by suboptimal folding. Unlike hard constraints, these
+// don't change the MFE or the energies which the delta is measured from. They are all monotone,
+// so they can be checked on partial structures, and subtrees which can't satisfy them are never
+// explored. All indices are 0 indexed.
+struct suboptimal_filter_t {
+  // Pairs (st, en) which every reported structure must contain.
+  std::vector<std::pair<int, int>> must_contain;
+  // Pairs which no reported structure may contain.
+  std::vector<std::pair<int, int>> must_avoid;
+  // Bases which must be left unpaired, e.g. a ribosome binding site.
+  std::vector<int> must_unpaired;
+  // Limits on the number of pairs and multiloops, or -1 for no limit.
+  int max_pairs = -1;
+  int max_multiloops = -1;
+
+  bool Empty() const {
+    return must_contain.empty() && must_avoid.empty() && must_unpaired.empty() &&
+        max_pairs == -1 && max_multiloops == -1;
+  }
+};
+
+namespace internal {
+
+struct suboptimal_filter_precomp_t {
+  // Whether any of the pair predicates are set. These only depend on single expansions, so they
+  // are applied to expansions as they are generated.
+  bool active;
+  int N;
+  // Sorted by |st|.
+  std::vector<std::pair<int, int>> contain;
+  // Bases which can't pair, and for each base the bases after it it can't pair with.
+  std::vector<uint8_t> unpaired;
+  std::vector<std::vector<int>> avoid;
+  int max_pairs;
+  int max_multiloops;
+
+  bool CanPair(int st, int en) const;
+  // Whether choosing |exp| for |idx| keeps every predicate satisfiable.
+  bool Allows(const index_t& idx, const expand_t& exp) const;
+  // The counts depend on the whole path, so the search checks them itself.
+  bool LimitsCounts() const { return max_pairs != -1 || max_multiloops != -1; }
+  bool WithinLimits(int num_pairs, int num_multiloops) const {
+    return (max_pairs == -1 || num_pairs <= max_pairs) &&
+        (max_multiloops == -1 || num_multiloops <= max_multiloops);
+  }
+};
+
+suboptimal_filter_precomp_t PrecomputeSuboptimalFilter(int N, const suboptimal_filter_t& filter);
+}
+}
+}
+
+#endif  // KEKRNA_FOLD_SUBOPTIMAL_FILTER_H
@@ -0,0 +1,40 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include "fold/suboptimal_results.h"
+
+namespace kekrna {
+namespace fold {
+
+void SuboptimalResults::Add(const subopt_view_t& view) {
+  assert(view.p.Size() == r.size() && view.base_ctds.Size() == r.size());
+  for (int pair : view.p)
+    ps.push_back(int16_t(pair));
+  ctds.insert(ctds.end(), view.base_ctds.begin(), view.base_ctds.end());
+  energies.push_back(view.energy);
+}
+
+void SuboptimalResults::Reserve(int num) {
+  ps.reserve(num * r.size());
+  ctds.reserve(num * r.size());
+  energies.reserve(std::size_t(num));
+}
+
+computed_t SuboptimalResults::Computed(int idx) const {
+  const auto p = Pairs(idx);
+  const auto base_ctds = Ctds(idx);
+  return {{r, {p.begin(), p.end()}}, {base_ctds.begin(), base_ctds.end()}, energies[idx]};
+}
+}
+}
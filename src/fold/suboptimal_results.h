@@ -0,0 +1,52 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#ifndef KEKRNA_FOLD_SUBOPTIMAL_RESULTS_H
+#define KEKRNA_FOLD_SUBOPTIMAL_RESULTS_H
+
+#include "array.h"
+#include "common.h"
+#include "fold/fold.h"
+
+namespace kekrna {
+namespace fold {
+
+// Suboptimal structures of one sequence. The primary sequence is shared, and pairs and CTDs are
+// kept in flat arrays, so adding a structure doesn't allocate once there is enough capacity.
+class SuboptimalResults {
+public:
+  SuboptimalResults() = default;
+  explicit SuboptimalResults(const primary_t& r_) : r(r_) {}
+
+  void Add(const subopt_view_t& view);
+  void Reserve(int num);
+
+  int Size() const { return int(energies.size()); }
+  const primary_t& Primary() const { return r; }
+  energy_t Energy(int idx) const { return energies[idx]; }
+  span_t<int16_t> Pairs(int idx) const { return {&ps[idx * r.size()], r.size()}; }
+  span_t<Ctd> Ctds(int idx) const { return {&ctds[idx * r.size()], r.size()}; }
+  // Copies the |idx|th structure out.
+  computed_t Computed(int idx) const;
+
+private:
+  primary_t r;
+  std::vector<int16_t> ps;
+  std::vector<Ctd> ctds;
+  std::vector<energy_t> energies;
+};
+}
+}
+
+#endif  // KEKRNA_FOLD_SUBOPTIMAL_RESULTS_H
@@ -34,15 +34,18 @@ void ComputeExterior() {
   gext[N][EXT] = 0;
   for (int st = N - 1; st >= 0; --st) {
     // Case: No pair starting here
-    gext[st][EXT] = gext[st + 1][EXT];
+    gext[st][EXT] = gext[st + 1][EXT] + gcons.Unpaired(st);
     for (int en = st + HAIRPIN_MIN_SZ + 1; en < N; ++en) {
       // .   .   .   (   .   .   .   )   <   >
       //           stb  st1b   en1b  enb   rem
       const auto stb = gr[st], st1b = gr[st + 1], enb = gr[en], en1b = gr[en - 1];
       const auto base00 = gdp[st][en][DP_P] + gem.AuGuPenalty(stb, enb);
-      const auto base01 = gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b);
-      const auto base10 = gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb);
-      const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b);
+      const auto base01 =
+          gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b) + gcons.Unpaired(en);
+      const auto base10 =
+          gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb) + gcons.Unpaired(st);
+      const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b) +
+          gcons.Unpaired(st) + gcons.Unpaired(en);
 
       // (   )<   >
       UPDATE_EXT(EXT, EXT, base00);
@@ -82,17 +85,21 @@ void ComputeExterior() {
 #undef UPDATE_EXT
 
 void Traceback() {
-  const int N = int(gr.size());
   genergy = gext[0][EXT];
+  TracebackFrom(index_t(0, -1, EXT));
+}
+
+void TracebackFrom(const index_t& idx) {
+  const int N = int(gr.size());
   std::stack<index_t> q;
-  q.emplace(0, -1, EXT);
+  q.push(idx);
   while (!q.empty()) {
     int st = q.top().st, en = q.top().en, a = q.top().a;
     q.pop();
 
     if (en == -1) {
       // Case: No pair starting here
-      if (a == EXT && st + 1 < N && gext[st + 1][EXT] == gext[st][EXT]) {
+      if (a == EXT && st + 1 < N && gext[st + 1][EXT] + gcons.Unpaired(st) == gext[st][EXT]) {
         q.emplace(st + 1, -1, EXT);
         goto loopend;
       }
@@ -101,9 +108,12 @@ void Traceback() {
         //           stb  st1b   en1b  enb   rem
         const auto stb = gr[st], st1b = gr[st + 1], enb = gr[en], en1b = gr[en - 1];
         const auto base00 = gdp[st][en][DP_P] + gem.AuGuPenalty(stb, enb);
-        const auto base01 = gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b);
-        const auto base10 = gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb);
-        const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b);
+        const auto base01 =
+            gdp[st][en - 1][DP_P] + gem.AuGuPenalty(stb, en1b) + gcons.Unpaired(en);
+        const auto base10 =
+            gdp[st + 1][en][DP_P] + gem.AuGuPenalty(st1b, enb) + gcons.Unpaired(st);
+        const auto base11 = gdp[st + 1][en - 1][DP_P] + gem.AuGuPenalty(st1b, en1b) +
+            gcons.Unpaired(st) + gcons.Unpaired(en);
 
         // (   ).<( * ). > Right coax backward
         if (a == EXT_RCOAX) {
@@ -212,8 +222,10 @@ void Traceback() {
 
         // Following largely matches the above DP so look up there for comments.
         const int max_inter = std::min(TWOLOOP_MAX_SZ, en - st - HAIRPIN_MIN_SZ - 3);
-        for (int ist = st + 1; ist < st + max_inter + 2; ++ist) {
-          for (int ien = en - max_inter + ist - st - 2; ien < en; ++ien) {
+        const int max_ist = std::min(st + max_inter + 1, gcons.next_must_pair[st + 1]);
+        for (int ist = st + 1; ist <= max_ist; ++ist) {
+          for (int ien = std::max(en - max_inter + ist - st - 2, gcons.prev_must_pair[en - 1]);
+               ien < en; ++ien) {
             if (gdp[ist][ien][DP_P] < CAP_E) {
               const auto val = gem.TwoLoop(gr, st, en, ist, ien) + gdp[ist][ien][DP_P];
               if (val == gdp[st][en][DP_P]) {
@@ -233,21 +245,24 @@ void Traceback() {
           goto loopend;
         }
         // (3<   ><   >) 3'
-        if (base_branch_cost + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb] ==
+        if (base_branch_cost + gdp[st + 2][en - 1][DP_U2] + gem.dangle3[stb][st1b][enb] +
+                gcons.Unpaired(st + 1) ==
             gdp[st][en][DP_P]) {
           gctd[en] = CTD_3_DANGLE;
           q.emplace(st + 2, en - 1, DP_U2);
           goto loopend;
         }
         // (<   ><   >5) 5'
-        if (base_branch_cost + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb] ==
+        if (base_branch_cost + gdp[st + 1][en - 2][DP_U2] + gem.dangle5[stb][en1b][enb] +
+                gcons.Unpaired(en - 1) ==
             gdp[st][en][DP_P]) {
           gctd[en] = CTD_5_DANGLE;
           q.emplace(st + 1, en - 2, DP_U2);
           goto loopend;
         }
         // (.<   ><   >.) Terminal mismatch
-        if (base_branch_cost + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb] ==
+        if (base_branch_cost + gdp[st + 2][en - 2][DP_U2] + gem.terminal[stb][st1b][en1b][enb] +
+                gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1) ==
             gdp[st][en][DP_P]) {
           gctd[en] = CTD_MISMATCH;
           q.emplace(st + 2, en - 2, DP_U2);
@@ -258,7 +273,8 @@ void Traceback() {
           const base_t pl1b = gr[piv - 1], plb = gr[piv], prb = gr[piv + 1], pr1b = gr[piv + 2];
 
           // (.(   )   .) Left outer coax - P
-          const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb);
+          const auto outer_coax = gem.MismatchCoaxial(stb, st1b, en1b, enb) +
+              gcons.Unpaired(st + 1) + gcons.Unpaired(en - 1);
           if (base_branch_cost + gdp[st + 2][piv][DP_P] + gem.multiloop_hack_b +
               gem.AuGuPenalty(st2b, plb) + gdp[piv + 1][en - 2][DP_U] + outer_coax ==
               gdp[st][en][DP_P]) {
@@ -282,7 +298,8 @@ void Traceback() {
           // (.(   ).   ) Left right coax
           if (base_branch_cost + gdp[st + 2][piv - 1][DP_P] + gem.multiloop_hack_b +
               gem.AuGuPenalty(st2b, pl1b) + gdp[piv + 1][en - 1][DP_U] +
-              gem.MismatchCoaxial(pl1b, plb, st1b, st2b) ==
+              gem.MismatchCoaxial(pl1b, plb, st1b, st2b) + gcons.Unpaired(st + 1) +
+                  gcons.Unpaired(piv) ==
               gdp[st][en][DP_P]) {
             gctd[en] = CTD_RCOAX_WITH_NEXT;
             gctd[st + 2] = CTD_RCOAX_WITH_PREV;
@@ -293,7 +310,8 @@ void Traceback() {
           // (   .(   ).) Right left coax
           if (base_branch_cost + gdp[st + 1][piv][DP_U] + gem.multiloop_hack_b +
               gem.AuGuPenalty(pr1b, en2b) + gdp[piv + 2][en - 2][DP_P] +
-              gem.MismatchCoaxial(en2b, en1b, prb, pr1b) ==
+              gem.MismatchCoaxial(en2b, en1b, prb, pr1b) + gcons.Unpaired(piv + 1) +
+                  gcons.Unpaired(en - 1) ==
               gdp[st][en][DP_P]) {
             gctd[en] = CTD_LCOAX_WITH_PREV;
             gctd[piv + 2] = CTD_LCOAX_WITH_NEXT;
@@ -332,7 +350,8 @@ void Traceback() {
 
       // Deal with the rest of the cases:
       // Left unpaired. Either DP_U or DP_U2.
-      if (st + 1 < en && (a == DP_U || a == DP_U2) && gdp[st + 1][en][a] == gdp[st][en][a]) {
+      if (st + 1 < en && (a == DP_U || a == DP_U2) &&
+          gdp[st + 1][en][a] + gcons.Unpaired(st) == gdp[st][en][a]) {
         q.emplace(st + 1, en, a);
         goto loopend;
       }
@@ -344,17 +363,20 @@ void Traceback() {
         const auto pb = gr[piv], pl1b = gr[piv - 1];
         // baseAB indicates A bases left unpaired on the left, B bases left unpaired on the right.
         const auto base00 = gdp[st][piv][DP_P] + gem.AuGuPenalty(stb, pb) + gem.multiloop_hack_b;
-        const auto base01 =
-            gdp[st][piv - 1][DP_P] + gem.AuGuPenalty(stb, pl1b) + gem.multiloop_hack_b;
-        const auto base10 =
-            gdp[st + 1][piv][DP_P] + gem.AuGuPenalty(st1b, pb) + gem.multiloop_hack_b;
-        const auto base11 =
-            gdp[st + 1][piv - 1][DP_P] + gem.AuGuPenalty(st1b, pl1b) + gem.multiloop_hack_b;
+        const auto base01 = gdp[st][piv - 1][DP_P] + gem.AuGuPenalty(stb, pl1b) +
+            gem.multiloop_hack_b + gcons.Unpaired(piv);
+        const auto base10 = gdp[st + 1][piv][DP_P] + gem.AuGuPenalty(st1b, pb) +
+            gem.multiloop_hack_b + gcons.Unpaired(st);
+        const auto base11 = gdp[st + 1][piv - 1][DP_P] + gem.AuGuPenalty(st1b, pl1b) +
+            gem.multiloop_hack_b + gcons.Unpaired(st) + gcons.Unpaired(piv);
 
         // Min is for either placing another unpaired or leaving it as nothing.
         // If we're at U2, don't allow leaving as nothing.
         auto right_unpaired = gdp[piv + 1][en][DP_U];
-        if (a != DP_U2) right_unpaired = std::min(right_unpaired, 0);
+        if (a != DP_U2) right_unpaired = std::min(right_unpaired, gcons.Unpaired(piv + 1, en));
+        // If the right side can't be left as nothing, we have to expand it even if it costs 0.
+        const bool expand_right =
+            a == DP_U2 || right_unpaired || !gcons.CanUnpair(piv + 1, en);
 
         // Check a == U_RCOAX:
         // (   ).<( ** ). > Right coax backward
@@ -364,7 +386,7 @@ void Traceback() {
                   gdp[st][en][DP_U_RCOAX]) {
             // Ctds were already set from the recurrence that called this.
             q.emplace(st, piv - 1, DP_P);
-            if (right_unpaired) q.emplace(piv + 1, en, DP_U);
+            if (expand_right) q.emplace(piv + 1, en, DP_U);
             goto loopend;
           }
           continue;
@@ -377,7 +399,7 @@ void Traceback() {
           // already set.
           if (a != DP_U_WC && a != DP_U_GU) gctd[st] = CTD_UNUSED;
           q.emplace(st, piv, DP_P);
-          if (a == DP_U2 || right_unpaired) q.emplace(piv + 1, en, DP_U);
+          if (expand_right) q.emplace(piv + 1, en, DP_U);
           goto loopend;
         }
 
@@ -388,21 +410,21 @@ void Traceback() {
         if (base01 + gem.dangle3[pl1b][pb][stb] + right_unpaired == gdp[st][en][a]) {
           gctd[st] = CTD_3_DANGLE;
           q.emplace(st, piv - 1, DP_P);
-          if (a == DP_U2 || right_unpaired) q.emplace(piv + 1, en, DP_U);
+          if (expand_right) q.emplace(piv + 1, en, DP_U);
           goto loopend;
         }
         // 5(   )<   > 5' - U, U2
         if (base10 + gem.dangle5[pb][stb][st1b] + right_unpaired == gdp[st][en][a]) {
           gctd[st + 1] = CTD_5_DANGLE;
           q.emplace(st + 1, piv, DP_P);
-          if (a == DP_U2 || right_unpaired) q.emplace(piv + 1, en, DP_U);
+          if (expand_right) q.emplace(piv + 1, en, DP_U);
           goto loopend;
         }
         // .(   ).<   > Terminal mismatch - U, U2
         if (base11 + gem.terminal[pl1b][pb][stb][st1b] + right_unpaired == gdp[st][en][a]) {
           gctd[st + 1] = CTD_MISMATCH;
           q.emplace(st + 1, piv - 1, DP_P);
-          if (a == DP_U2 || right_unpaired) q.emplace(piv + 1, en, DP_U);
+          if (expand_right) q.emplace(piv + 1, en, DP_U);
           goto loopend;
         }
         // .(   ).<(   ) > Left coax - U, U2
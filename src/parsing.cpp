@@ -232,5 +232,45 @@ bool IsCtdString(const std::string& pairs_str) {
     if (c == '(') return false;
   return true;
 }
+
+alignment_t ParseAlignment(std::istream& in) {
+  alignment_t alignment;
+  std::string line;
+  bool stockholm = false;
+  // Stockholm alignments can be split into blocks, which continue the rows with the same names.
+  std::unordered_map<std::string, int> row_idxs;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.compare(0, 11, "# STOCKHOLM") == 0) {
+      stockholm = true;
+      continue;
+    }
+    if (stockholm) {
+      if (line.compare(0, 2, "//") == 0) break;
+      if (line.empty() || line[0] == '#') continue;
+      const auto name_en = line.find_first_of(" \t");
+      verify_expr(name_en != std::string::npos, "invalid Stockholm line: %s", line.c_str());
+      const auto name = line.substr(0, name_en);
+      const auto seq_st = line.find_first_not_of(" \t", name_en);
+      const auto seq = seq_st == std::string::npos ? "" : line.substr(seq_st);
+      auto iter = row_idxs.find(name);
+      if (iter == row_idxs.end()) {
+        iter = row_idxs.emplace(name, int(alignment.rows.size())).first;
+        alignment.names.push_back(name);
+        alignment.rows.emplace_back();
+      }
+      alignment.rows[iter->second] += seq;
+    } else if (!line.empty() && line[0] == '>') {
+      alignment.names.push_back(line.substr(1, line.find_first_of(" \t") - 1));
+      alignment.rows.emplace_back();
+    } else if (!line.empty()) {
+      verify_expr(!alignment.rows.empty(), "sequence before the first FASTA header");
+      alignment.rows.back() += line;
+    }
+  }
+  for (const auto& row : alignment.rows)
+    verify_expr(row.size() == alignment.rows.front().size(), "alignment rows differ in length");
+  return alignment;
+}
 }
 }
@@ -15,6 +15,7 @@
 #ifndef KEKRNA_PARSING_H
 #define KEKRNA_PARSING_H
 
+#include <istream>
 #include <stack>
 #include <string>
 #include <unordered_map>
@@ -32,6 +33,15 @@ std::string PairsToDotBracket(const std::vector<int>& pairs);
 computed_t ParseCtdComputed(const std::string& prim_str, const std::string& pairs_str);
 std::string ComputedToCtdString(const computed_t& computed);
 bool IsCtdString(const std::string& pairs_str);
+
+// Rows of a multiple sequence alignment, with gaps.
+struct alignment_t {
+  std::vector<std::string> names;
+  std::vector<std::string> rows;
+};
+
+// Reads an alignment in aligned FASTA or Stockholm format.
+alignment_t ParseAlignment(std::istream& in);
 }
 }
 
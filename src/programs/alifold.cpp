@@ -0,0 +1,36 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include <fstream>
+#include "energy/load_model.h"
+#include "fold/alifold.h"
+#include "parsing.h"
+
+using namespace kekrna;
+
+int main(int argc, char* argv[]) {
+  ArgParse argparse(energy::ENERGY_OPTIONS);
+  argparse.ParseOrExit(argc, argv);
+  const auto pos = argparse.GetPositional();
+  verify_expr(pos.size() == 1, "need an aligned FASTA or Stockholm file");
+
+  std::ifstream in(pos.front());
+  verify_expr(in.good(), "could not open %s", pos.front().c_str());
+  const auto alignment = parsing::ParseAlignment(in);
+  const auto em = energy::LoadEnergyModelFromArgParse(argparse);
+  const auto alifold = fold::Alifold(alignment.rows, *em);
+  printf("Energy: %.2f\nCovariation: %.2f\n%s\n", alifold.energy, alifold.covariation,
+      parsing::PairsToDotBracket(alifold.p).c_str());
+}
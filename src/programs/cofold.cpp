@@ -0,0 +1,40 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include "energy/load_model.h"
+#include "fold/context.h"
+#include "parsing.h"
+
+using namespace kekrna;
+
+int main(int argc, char* argv[]) {
+  ArgParse argparse(energy::ENERGY_OPTIONS);
+  argparse.AddOptions(fold::FOLD_OPTIONS);
+  argparse.ParseOrExit(argc, argv);
+  const auto pos = argparse.GetPositional();
+  verify_expr(pos.size() >= 2, "need a primary sequence and at least one partner to cofold");
+
+  std::vector<primary_t> partners;
+  for (int i = 1; i < int(pos.size()); ++i)
+    partners.push_back(parsing::StringToPrimary(pos[i]));
+  const auto cofolds = fold::CofoldBatch(parsing::StringToPrimary(pos.front()), partners,
+      energy::LoadEnergyModelFromArgParse(argparse), fold::ContextOptionsFromArgParse(argparse));
+  for (const auto& cofold : cofolds) {
+    auto db = parsing::PairsToDotBracket(cofold.computed.s.p);
+    db.insert(db.begin() + cofold.split, '&');
+    printf("Energy: %d\nSeparate: %d\n%s\n", cofold.computed.energy, cofold.separate_energy,
+        db.c_str());
+  }
+}
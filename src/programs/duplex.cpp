@@ -0,0 +1,100 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include "energy/load_model.h"
+#include "fold/duplex.h"
+#include "parsing.h"
+
+using namespace kekrna;
+
+namespace {
+
+struct hit_t {
+  fold::duplex_t duplex;
+  int offset;
+};
+
+// Targets can have bases other than ACGU, e.g. N, which nothing pairs with. Each run of ACGU is
+// searched separately.
+hit_t SearchTarget(fold::DuplexSearch& search, const std::string& seq) {
+  hit_t best{{MAX_E, {}}, 0};
+  int st = 0;
+  while (st < int(seq.size())) {
+    int en = st;
+    primary_t target;
+    for (; en < int(seq.size()); ++en) {
+      char c = char(toupper(seq[en]));
+      if (c == 'T') c = 'U';
+      const auto b = CharToBase(c);
+      if (b == -1) break;
+      target.push_back(b);
+    }
+    if (!target.empty()) {
+      auto duplex = search.Best(target);
+      if (duplex.energy < best.duplex.energy) best = {std::move(duplex), st};
+    }
+    st = en + 1;
+  }
+  return best;
+}
+
+void PrintHit(const std::string& name, const hit_t& hit) {
+  if (hit.duplex.pairs.empty()) {
+    printf("%s\tnone\n", name.c_str());
+    return;
+  }
+  const auto& pairs = hit.duplex.pairs;
+  const int pst = pairs.front().first, pen = pairs.back().first;
+  const int tst = pairs.back().second, ten = pairs.front().second;
+  std::string probe_db(pen - pst + 1, '.'), target_db(ten - tst + 1, '.');
+  for (const auto& pair : pairs) {
+    probe_db[pair.first - pst] = '(';
+    target_db[pair.second - tst] = ')';
+  }
+  printf("%s\t%d\t%d-%d\t%d-%d\t%s&%s\n", name.c_str(), hit.duplex.energy, pst, pen,
+      hit.offset + tst, hit.offset + ten, probe_db.c_str(), target_db.c_str());
+}
+}
+
+int main(int argc, char* argv[]) {
+  ArgParse argparse(energy::ENERGY_OPTIONS);
+  argparse.ParseOrExit(argc, argv);
+  const auto pos = argparse.GetPositional();
+  verify_expr(pos.size() == 2, "need a probe sequence and a FASTA file of targets");
+
+  const auto probe = parsing::StringToPrimary(pos[0]);
+  fold::DuplexSearch search(probe, energy::LoadEnergyModelFromArgParse(argparse));
+  std::ifstream in(pos[1]);
+  verify_expr(in.good(), "could not open %s", pos[1].c_str());
+  // Targets are searched as they are read, so only one is in memory at a time.
+  std::string line, name, seq;
+  bool have_target = false;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (!line.empty() && line[0] == '>') {
+      if (have_target) PrintHit(name, SearchTarget(search, seq));
+      // The name is up to the first whitespace.
+      name = line.substr(1);
+      name = name.substr(0, name.find_first_of(" \t"));
+      seq.clear();
+      have_target = true;
+    } else {
+      seq += line;
+    }
+  }
+  if (have_target) PrintHit(name, SearchTarget(search, seq));
+}
@@ -13,23 +13,65 @@
 // You should have received a copy of the GNU General Public License along with kekrna.
 // If not, see <http://www.gnu.org/licenses/>.
 #include <cstdio>
+#include <cstdlib>
 #include "energy/load_model.h"
 #include "fold/context.h"
+#include "fold/fold_cache.h"
 #include "parsing.h"
 
 using namespace kekrna;
 
+namespace {
+const std::size_t FOLD_CACHE_SIZE = 100000;
+}
+
 int main(int argc, char* argv[]) {
   ArgParse argparse(energy::ENERGY_OPTIONS);
   argparse.AddOptions(fold::FOLD_OPTIONS);
+  argparse.AddOptions({{"cache", ArgParse::option_t("file to persist fold results in").Arg()},
+      {"sweep", ArgParse::option_t("fold under this many random models, starting at seed").Arg()}});
   argparse.ParseOrExit(argc, argv);
   const auto pos = argparse.GetPositional();
-  verify_expr(pos.size() == 1, "need primary sequence to fold");
+  verify_expr(!pos.empty(), "need primary sequence to fold");
+
+  std::vector<primary_t> rs;
+  for (const auto& seq : pos)
+    rs.push_back(parsing::StringToPrimary(seq));
+  const auto options = fold::ContextOptionsFromArgParse(argparse);
+  if (argparse.HasFlag("sweep")) {
+    verify_expr(rs.size() == 1, "sweep needs exactly one primary sequence");
+    const int num_models = atoi(argparse.GetOption("sweep").c_str());
+    const uint_fast32_t seed = argparse.HasFlag("seed")
+        ? uint_fast32_t(atoi(argparse.GetOption("seed").c_str()))
+        : 0;
+    std::vector<energy::EnergyModelPtr> ems;
+    for (int i = 0; i < num_models; ++i)
+      ems.push_back(energy::LoadRandomEnergyModel(seed + uint_fast32_t(i)));
+    const auto computeds = fold::FoldModels(rs.front(), ems, options);
+    for (int i = 0; i < num_models; ++i)
+      printf("%lu %d %s\n", static_cast<unsigned long>(seed + uint_fast32_t(i)),
+          computeds[i].energy, parsing::PairsToDotBracket(computeds[i].s.p).c_str());
+    return 0;
+  }
 
-  fold::Context ctx(parsing::StringToPrimary(pos.front()),
-      energy::LoadEnergyModelFromArgParse(argparse), fold::ContextOptionsFromArgParse(argparse));
-  const auto computed = ctx.Fold();
+  const auto em = energy::LoadEnergyModelFromArgParse(argparse);
+  std::vector<computed_t> computeds;
+  if (argparse.HasFlag("cache")) {
+    const auto filename = argparse.GetOption("cache");
+    fold::FoldCache cache(FOLD_CACHE_SIZE);
+    cache.Load(filename);
+    for (const auto& r : rs)
+      computeds.push_back(cache.Fold(r, em, options));
+    if (cache.Stats().misses) cache.Save(filename);
+  } else if (rs.size() > 1) {
+    // Multiple sequences can share work between each other.
+    computeds = fold::FoldBatch(rs, em, options);
+  } else {
+    computeds.push_back(fold::Context(rs.front(), em, options).Fold());
+  }
 
-  printf("Energy: %d\n%s\n%s\n", computed.energy, parsing::PairsToDotBracket(computed.s.p).c_str(),
-      parsing::ComputedToCtdString(computed).c_str());
+  for (const auto& computed : computeds)
+    printf("Energy: %d\n%s\n%s\n", computed.energy,
+        parsing::PairsToDotBracket(computed.s.p).c_str(),
+        parsing::ComputedToCtdString(computed).c_str());
 }
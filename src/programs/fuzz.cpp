@@ -16,7 +16,7 @@
 #include <cinttypes>
 #include <cstdio>
 #include <random>
-#include <set>
+#include <unordered_map>
 #include "bridge/bridge.h"
 #include "bridge/kekrna.h"
 #include "bridge/rnastructure.h"
@@ -24,6 +24,7 @@
 #include "energy/structure.h"
 #include "fold/brute_fold.h"
 #include "fold/globals.h"
+#include "fold/structure_hash.h"
 #include "parsing.h"
 
 using namespace kekrna;
@@ -104,11 +105,18 @@ private:
 
   bool HasDuplicates(const std::vector<computed_t>& computeds) {
     // If energies are different but everything else is the same, it is still a bug.
-    std::set<std::pair<secondary_t, std::vector<Ctd>>> suboptimal_set;
-    for (const auto& computed : computeds) {
-      auto val = std::make_pair(computed.s, computed.base_ctds);
-      if (suboptimal_set.count(val)) return true;
-      suboptimal_set.insert(val);
+    // Bucket by StructureHash, and only compare structures in full when the hashes collide.
+    std::unordered_multimap<uint64_t, int> seen;
+    seen.reserve(computeds.size());
+    for (int i = 0; i < int(computeds.size()); ++i) {
+      const auto& computed = computeds[i];
+      const uint64_t hash = StructureHash(computed.s.p, computed.base_ctds);
+      const auto range = seen.equal_range(hash);
+      for (auto iter = range.first; iter != range.second; ++iter) {
+        const auto& other = computeds[iter->second];
+        if (other.s == computed.s && other.base_ctds == computed.base_ctds) return true;
+      }
+      seen.emplace(hash, i);
     }
     return false;
   }
@@ -0,0 +1,63 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include "energy/load_model.h"
+#include "fold/context.h"
+#include "fold/landscape.h"
+#include "parsing.h"
+
+using namespace kekrna;
+
+int main(int argc, char* argv[]) {
+  ArgParse argparse(energy::ENERGY_OPTIONS);
+  argparse.AddOptions(fold::FOLD_OPTIONS);
+  argparse.AddOptions({
+      {"delta", ArgParse::option_t("maximum energy delta from minimum").Arg("-1")},
+      {"num", ArgParse::option_t("maximum number of structures to use").Arg("-1")},
+      {"min-height", ArgParse::option_t("merge minima with barriers lower than this").Arg("0")},
+      {"q", ArgParse::option_t("quiet")}
+  });
+  argparse.ParseOrExit(argc, argv);
+  const auto pos = argparse.GetPositional();
+  verify_expr(pos.size() == 1, "need primary sequence to fold");
+
+  auto opt = fold::ContextOptionsFromArgParse(argparse);
+  opt.table_alg = fold::context_options_t::TableAlg::TWO;
+  // The landscape is over sets of pairs, so only the best CTDs of each are needed.
+  opt.suboptimal_alg = fold::context_options_t::SuboptimalAlg::ONE;
+  opt.suboptimal_unique = true;
+  const primary_t r = parsing::StringToPrimary(pos.front());
+  fold::Context ctx(r, energy::LoadEnergyModelFromArgParse(argparse), opt);
+
+  const energy_t delta = atoi(argparse.GetOption("delta").c_str());
+  const int num = atoi(argparse.GetOption("num").c_str());
+  const energy_t min_height = atoi(argparse.GetOption("min-height").c_str());
+  verify_expr(delta >= 0, "need a delta");
+  fold::LandscapeBuilder builder(r);
+  ctx.SuboptimalViews(
+      [&builder](const fold::subopt_view_t& view) { builder.Add(view); }, true, delta, num);
+
+  const auto tree = builder.BarrierTree(min_height);
+  if (!argparse.HasFlag("q")) {
+    printf("     %s\n", pos.front().c_str());
+    for (int i = 0; i < int(tree.size()); ++i) {
+      const auto& minimum = tree[i];
+      const energy_t barrier = minimum.father == -1 ? 0 : minimum.saddle - minimum.energy;
+      printf("%4d %s %6d %4d %6d %d\n", i + 1, minimum.db.c_str(), minimum.energy,
+          minimum.father + 1, barrier, minimum.basin_size);
+    }
+  }
+  printf("%d local minima in %d structures\n", int(tree.size()), builder.NumStructures());
+}
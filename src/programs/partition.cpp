@@ -0,0 +1,54 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include <cstdlib>
+#include "energy/load_model.h"
+#include "fold/context.h"
+#include "parsing.h"
+
+using namespace kekrna;
+
+int main(int argc, char* argv[]) {
+  ArgParse argparse(energy::ENERGY_OPTIONS);
+  argparse.AddOptions(fold::FOLD_OPTIONS);
+  argparse.AddOptions({
+      {"min-prob", ArgParse::option_t("only print pairs with at least this probability")
+          .Arg("0.01")},
+      {"sample", ArgParse::option_t("sample this many structures instead").Arg()},
+      {"sample-seed", ArgParse::option_t("seed for sampling").Arg("0")}
+  });
+  argparse.ParseOrExit(argc, argv);
+  const auto pos = argparse.GetPositional();
+  verify_expr(pos.size() == 1, "need primary sequence to fold");
+
+  fold::Context ctx(parsing::StringToPrimary(pos.front()),
+      energy::LoadEnergyModelFromArgParse(argparse), fold::ContextOptionsFromArgParse(argparse));
+  if (argparse.HasFlag("sample")) {
+    std::mt19937 eng(uint_fast32_t(atoi(argparse.GetOption("sample-seed").c_str())));
+    for (const auto& computed :
+        ctx.StochasticSample(atoi(argparse.GetOption("sample").c_str()), eng)) {
+      printf("%d ", computed.energy);
+      puts(parsing::ComputedToCtdString(computed).c_str());
+    }
+    return 0;
+  }
+
+  const auto part = ctx.Partition();
+  const double min_prob = atof(argparse.GetOption("min-prob").c_str());
+  printf("MFE: %d\nEnsemble energy: %.2f\n", part.mfe, part.ensemble_energy);
+  for (int st = 0; st < int(part.prob.size()); ++st)
+    for (int en = st + 1; en < int(part.prob.size()); ++en)
+      if (part.prob[st][en] >= min_prob) printf("%d %d %.6f\n", st, en, part.prob[st][en]);
+}
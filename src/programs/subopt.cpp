@@ -12,9 +12,13 @@
 //
 // You should have received a copy of the GNU General Public License along with kekrna.
 // If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
 #include <cstdio>
+#include <memory>
 #include "energy/load_model.h"
 #include "fold/context.h"
+#include "fold/suboptimal_async.h"
+#include "fold/suboptimal_binary.h"
 #include "parsing.h"
 
 using namespace kekrna;
@@ -27,7 +31,20 @@ int main(int argc, char* argv[]) {
       {"num", ArgParse::option_t("maximum number of reported structures").Arg("-1")},
       {"q", ArgParse::option_t("quiet")},
       {"sorted", ArgParse::option_t("if the structures should be sorted")},
-      {"ctd-output", ArgParse::option_t("if we should output CTD data")}
+      {"ctd-output", ArgParse::option_t("if we should output CTD data")},
+      {"shard", ArgParse::option_t("only enumerate shard i of k, given as i/k").Arg()},
+      {"count", ArgParse::option_t("count structures by energy instead of enumerating them")},
+      {"shapes", ArgParse::option_t(
+          "report the best structure of each abstract shape at this level instead").Arg()},
+      {"binary", ArgParse::option_t("write structures to this file in the binary format").Arg()},
+      {"async", ArgParse::option_t("format and write structures on a separate thread")},
+      {"budget-ms", ArgParse::option_t(
+          "report structures by energy until this many milliseconds pass, 0 for no limit")
+          .Arg("0")},
+      {"budget-mb", ArgParse::option_t(
+          "report structures by energy until the expansion cache uses this many MB, 0 for no "
+          "limit; must be less than -subopt-cache-mb if that is set")
+          .Arg("0")}
   });
   argparse.ParseOrExit(argc, argv);
   const auto pos = argparse.GetPositional();
@@ -35,6 +52,13 @@ int main(int argc, char* argv[]) {
 
   auto opt = fold::ContextOptionsFromArgParse(argparse);
   opt.table_alg = fold::context_options_t::TableAlg::TWO;
+  if (argparse.HasFlag("shard")) {
+    const auto shard = argparse.GetOption("shard");
+    verify_expr(sscanf(shard.c_str(), "%d/%d", &opt.suboptimal_shard,
+        &opt.suboptimal_num_shards) == 2, "shard must be given as i/k");
+    verify_expr(opt.suboptimal_alg == fold::context_options_t::SuboptimalAlg::ONE,
+        "sharding is only supported by suboptimal algorithm 1");
+  }
   fold::Context ctx(
       parsing::StringToPrimary(pos.front()), energy::LoadEnergyModelFromArgParse(argparse), opt);
 
@@ -43,22 +67,86 @@ int main(int argc, char* argv[]) {
   const bool should_print = !argparse.HasFlag("q");
   const bool sorted = argparse.HasFlag("sorted");
   const bool ctd_data = argparse.HasFlag("ctd-output");
-  verify_expr(subopt_delta >= 0 || subopt_num > 0, "nothing to do");
+  fold::suboptimal_budget_t budget;
+  budget.time_ms = atoi(argparse.GetOption("budget-ms").c_str());
+  budget.memory_bytes = std::size_t(atoi(argparse.GetOption("budget-mb").c_str())) << 20;
+  const bool anytime = budget.time_ms != 0 || budget.memory_bytes != 0;
+  verify_expr(subopt_delta >= 0 || subopt_num > 0 || anytime, "nothing to do");
+
+  if (argparse.HasFlag("count")) {
+    verify_expr(subopt_delta >= 0, "counting structures needs a delta");
+    double total = 0.0;
+    for (const auto& count : ctx.SuboptimalHistogram(subopt_delta)) {
+      if (should_print) printf("%d %.17g\n", count.first, count.second);
+      total += count.second;
+    }
+    printf("%.17g suboptimal structures\n", total);
+    return 0;
+  }
 
-  fold::SuboptimalCallback fn = [](const computed_t&) {};
-  if (should_print) {
-    if (ctd_data) {
-      fn = [](const computed_t& c) {
-        printf("%d ", c.energy);
-        puts(parsing::ComputedToCtdString(c).c_str());
-      };
-    } else {
-      fn = [](const computed_t& c) {
-        printf("%d ", c.energy);
-        puts(fold::internal::grep.c_str());  // kek
-      };
+  if (argparse.HasFlag("shapes")) {
+    const int level = atoi(argparse.GetOption("shapes").c_str());
+    const auto reps = ctx.SuboptimalShapes(level, subopt_delta, subopt_num);
+    if (should_print) {
+      for (const auto& rep : reps) {
+        printf("%d %s ", rep.computed.energy, rep.shape.empty() ? "_" : rep.shape.c_str());
+        puts(ctd_data ? parsing::ComputedToCtdString(rep.computed).c_str() :
+            parsing::PairsToDotBracket(rep.computed.s.p).c_str());
+      }
     }
+    printf("%d shapes\n", int(reps.size()));
+    return 0;
+  }
+
+  const primary_t r = parsing::StringToPrimary(pos.front());
+  FILE* fp = nullptr;
+  std::unique_ptr<fold::SuboptimalBinaryWriter> writer;
+  fold::SuboptimalViewCallback fn = [](const fold::subopt_view_t&) {};
+  if (argparse.HasFlag("binary")) {
+    const auto filename = argparse.GetOption("binary");
+    fp = fopen(filename.c_str(), "wb");
+    verify_expr(fp != nullptr, "could not open %s", filename.c_str());
+    writer = std::make_unique<fold::SuboptimalBinaryWriter>(fp, r);
+    fn = [&writer](const fold::subopt_view_t& view) { writer->Write(view); };
+  } else if (should_print && ctd_data) {
+    fn = [](const fold::subopt_view_t& view) {
+      computed_t computed(
+          secondary_t(primary_t(view.r.begin(), view.r.end()),
+              std::vector<int>(view.p.begin(), view.p.end())),
+          std::vector<Ctd>(view.base_ctds.begin(), view.base_ctds.end()), view.energy);
+      printf("%d ", computed.energy);
+      puts(parsing::ComputedToCtdString(computed).c_str());
+    };
+  } else if (should_print) {
+    fn = [](const fold::subopt_view_t& view) {
+      printf("%d ", view.energy);
+      puts(view.db.Data());
+    };
+  }
+
+  int num_structures = 0;
+  fold::suboptimal_anytime_t anytime_res = {};
+  std::unique_ptr<fold::AsyncSuboptimalCallback> async;
+  if (argparse.HasFlag("async")) {
+    async = std::make_unique<fold::AsyncSuboptimalCallback>(fn, r);
+    fn = [&async](const fold::subopt_view_t& view) { async->Push(view); };
+  }
+  if (anytime) {
+    // Anytime output is always by energy, and the structure budget is the number asked for.
+    budget.num_structures = std::max(subopt_num, 0);
+    anytime_res = ctx.SuboptimalAnytime(fn, budget, subopt_delta);
+    num_structures = anytime_res.num_structures;
+  } else {
+    num_structures = ctx.SuboptimalViews(fn, sorted, subopt_delta, subopt_num);
+  }
+  async.reset();
+  if (writer) {
+    writer.reset();
+    verify_expr(fclose(fp) == 0, "could not write %s", argparse.GetOption("binary").c_str());
   }
-  int num_structures = ctx.Suboptimal(fn, sorted, subopt_delta, subopt_num);
   printf("%d suboptimal structures\n", num_structures);
+  if (anytime) {
+    printf("%s up to energy %d\n", anytime_res.complete ? "complete" : "budget ran out, complete",
+        anytime_res.covered_energy);
+  }
 }
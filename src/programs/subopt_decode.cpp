@@ -0,0 +1,50 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include "argparse.h"
+#include "fold/suboptimal_binary.h"
+#include "parsing.h"
+
+using namespace kekrna;
+
+int main(int argc, char* argv[]) {
+  ArgParse argparse({
+      {"q", ArgParse::option_t("quiet")},
+      {"ctd-output", ArgParse::option_t("if we should output CTD data")}});
+  argparse.ParseOrExit(argc, argv);
+  const auto pos = argparse.GetPositional();
+  verify_expr(pos.size() == 1, "need binary subopt file to decode");
+  const bool should_print = !argparse.HasFlag("q");
+  const bool ctd_data = argparse.HasFlag("ctd-output");
+
+  FILE* fp = fopen(pos.front().c_str(), "rb");
+  verify_expr(fp != nullptr, "could not open %s", pos.front().c_str());
+  int num_structures = 0;
+  {
+    fold::SuboptimalBinaryReader reader(fp);
+    while (reader.Next()) {
+      ++num_structures;
+      if (!should_print) continue;
+      const auto& computed = reader.Current();
+      printf("%d ", computed.energy);
+      if (ctd_data)
+        puts(parsing::ComputedToCtdString(computed).c_str());
+      else
+        puts(parsing::PairsToDotBracket(computed.s.p).c_str());
+    }
+  }
+  fclose(fp);
+  printf("%d suboptimal structures\n", num_structures);
+}
@@ -0,0 +1,91 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include "argparse.h"
+#include "common.h"
+
+using namespace kekrna;
+
+namespace {
+
+const char* SUMMARY_SUFFIX = " suboptimal structures";
+
+// One sorted output of subopt -sorted -shard i/k.
+struct shard_t {
+  std::unique_ptr<std::ifstream> in;
+  std::string filename;
+  std::string line;
+  energy_t energy;
+  int num_structures;
+};
+
+bool IsSummary(const std::string& line) {
+  const std::string suffix = SUMMARY_SUFFIX;
+  return line.size() >= suffix.size() &&
+      line.compare(line.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Reads the next structure of |shard|. Returns false at the end of the shard.
+bool Advance(shard_t& shard) {
+  while (std::getline(*shard.in, shard.line)) {
+    if (IsSummary(shard.line)) continue;
+    const energy_t prev_energy = shard.energy;
+    shard.energy = atoi(shard.line.c_str());
+    verify_expr(shard.energy >= prev_energy, "%s is not sorted by energy - use subopt -sorted",
+        shard.filename.c_str());
+    ++shard.num_structures;
+    return true;
+  }
+  return false;
+}
+}
+
+int main(int argc, char* argv[]) {
+  ArgParse argparse({
+      {"num", ArgParse::option_t("maximum number of reported structures").Arg("-1")},
+      {"q", ArgParse::option_t("quiet")}});
+  argparse.ParseOrExit(argc, argv);
+  const auto pos = argparse.GetPositional();
+  verify_expr(!pos.empty(), "need shard outputs to merge");
+  const int max_structures = atoi(argparse.GetOption("num").c_str());
+  const bool should_print = !argparse.HasFlag("q");
+
+  std::vector<shard_t> shards;
+  for (const auto& filename : pos) {
+    shards.push_back({std::unique_ptr<std::ifstream>(new std::ifstream(filename)), filename, "",
+        std::numeric_limits<energy_t>::min(), 0});
+    verify_expr(shards.back().in->is_open(), "could not open %s", filename.c_str());
+  }
+
+  // K-way merge by energy. Ties go to the earlier shard, so the output is deterministic.
+  typedef std::pair<energy_t, int> entry_t;
+  std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>> pq;
+  for (int i = 0; i < int(shards.size()); ++i)
+    if (Advance(shards[i])) pq.push({shards[i].energy, i});
+  int num_structures = 0;
+  while (!pq.empty() && num_structures != max_structures) {
+    const int idx = pq.top().second;
+    pq.pop();
+    if (should_print) puts(shards[idx].line.c_str());
+    ++num_structures;
+    if (Advance(shards[idx])) pq.push({shards[idx].energy, idx});
+  }
+  printf("%d%s\n", num_structures, SUMMARY_SUFFIX);
+}
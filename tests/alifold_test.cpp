@@ -0,0 +1,71 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <random>
+#include "common_test.h"
+#include "energy/energy.h"
+#include "fold/alifold.h"
+#include "fold/context.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+// Energy of |p| without any CTDs, which is what alignment folding scores structures with.
+energy_t EnergyWithoutCtds(const primary_t& r, const std::vector<int>& p,
+    const energy::EnergyModel& em) {
+  computed_t computed({r, p});
+  for (int i = 0; i < int(p.size()); ++i)
+    if (p[i] != -1) computed.base_ctds[i] = CTD_UNUSED;
+  return energy::ComputeEnergyWithCtds(computed, em).energy;
+}
+}
+
+TEST(AlifoldTest, SingleSequence) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    for (int i = 0; i < 5; ++i) {
+      const auto r = GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 60)(eng), eng);
+      const auto alifold = Alifold({parsing::PrimaryToString(r)}, *em);
+      EXPECT_DOUBLE_EQ(0.0, alifold.covariation);
+      EXPECT_DOUBLE_EQ(double(EnergyWithoutCtds(r, alifold.p, *em)), alifold.energy);
+      // It's the best structure without CTDs, so it's no worse than the MFE structure without
+      // its CTDs, and no better than the MFE.
+      const auto computed = Context(r, em).Fold();
+      EXPECT_LE(alifold.energy, double(EnergyWithoutCtds(r, computed.s.p, *em)));
+      EXPECT_GE(alifold.energy, double(computed.energy));
+    }
+  }
+}
+
+TEST(AlifoldTest, IdenticalSequences) {
+  std::mt19937 eng(0);
+  const auto row = parsing::PrimaryToString(GenerateRandomPrimary(50, eng));
+  const auto single = Alifold({row}, *g_em);
+  const auto triple = Alifold({row, row, row}, *g_em);
+  EXPECT_EQ(single.p, triple.p);
+  EXPECT_DOUBLE_EQ(single.energy, triple.energy);
+  EXPECT_DOUBLE_EQ(0.0, triple.covariation);
+}
+
+TEST(AlifoldTest, CompensatoryMutations) {
+  // The same hairpin, with its stem made of different pairs.
+  const auto alifold = Alifold({"GGGGAAACCCC", "CCCCAAAGGGG", "GA-GAAACUUC"}, *g_em);
+  EXPECT_EQ(parsing::DotBracketToPairs("((((...))))"), alifold.p);
+  EXPECT_LT(alifold.covariation, 0.0);
+}
+}
+}
@@ -0,0 +1,408 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <random>
+#include "common_test.h"
+#include "energy/energy.h"
+#include "energy/energy_internal.h"
+#include "fold/context.h"
+#include "fold/fold.h"
+#include "fold/globals.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+void ExpectValidCofold(const cofold_t& cofold, const primary_t& a, const primary_t& b) {
+  const auto& s = cofold.computed.s;
+  ASSERT_EQ(a.size() + b.size(), s.r.size());
+  EXPECT_EQ(int(a.size()), cofold.split);
+  EXPECT_LE(cofold.computed.energy, cofold.separate_energy);
+  std::vector<int> stk;
+  for (int i = 0; i < int(s.p.size()); ++i) {
+    if (s.p[i] == -1) continue;
+    ASSERT_EQ(i, s.p[s.p[i]]);
+    EXPECT_TRUE(CanPair(s.r[i], s.r[s.p[i]]));
+    if (s.p[i] > i) {
+      stk.push_back(i);
+    } else {
+      ASSERT_FALSE(stk.empty());
+      EXPECT_EQ(s.p[i], stk.back());
+      stk.pop_back();
+    }
+  }
+}
+
+// Evaluates a cofolded structure one loop at a time from its pairs and CTDs. Loops closed by
+// intramolecular pairs are evaluated as in folding.
+energy_t CofoldEnergy(const cofold_t& cofold, const energy::EnergyModel& em) {
+  const auto& c = cofold.computed;
+  const auto& r = c.s.r;
+  const auto& p = c.s.p;
+  const int N = int(r.size()), split = cofold.split;
+  // Evaluates bases [st, en) as a structure of their own.
+  const auto part_energy = [&](int st, int en) {
+    std::vector<int> part_p(p.begin() + st, p.begin() + en);
+    for (auto& pair : part_p)
+      if (pair != -1) pair -= st;
+    const computed_t part({primary_t(r.begin() + st, r.begin() + en), part_p},
+        std::vector<Ctd>(c.base_ctds.begin() + st, c.base_ctds.begin() + en), MAX_E);
+    return energy::ComputeEnergyWithCtds(part, em).energy;
+  };
+  int outer = 0;
+  while (outer < split && p[outer] < split)
+    ++outer;
+  if (outer == split) return part_energy(0, split) + part_energy(split, N);
+
+  // CTDs and AU/GU penalties of |branches| in |lc|, which is the structure rotated left by |rot|,
+  // and everything inside the intramolecular ones.
+  const auto branch_energy = [&](const computed_t& lc, int rot, const std::deque<int>& branches) {
+    energy::internal::branch_ctd_t branch_ctds;
+    energy_t energy = energy::internal::GetBranchCtdsFromComputed(lc, em, branches, branch_ctds);
+    for (int branch : branches) {
+      const int st = (branch + rot) % N, en = p[st];
+      energy += em.AuGuPenalty(r[st], r[en]);
+      if ((st < split) == (en < split))
+        energy += part_energy(st, en + 1) - em.AuGuPenalty(r[st], r[en]);
+    }
+    return energy;
+  };
+  std::deque<int> branches;
+  const auto add_branches = [&](int st, int en) {
+    for (int i = st; i < en; ++i) {
+      if (p[i] == -1) continue;
+      branches.push_back(i);
+      i = p[i];
+    }
+  };
+
+  // The exterior loop containing the ends.
+  add_branches(0, outer);
+  branches.push_back(outer);
+  add_branches(p[outer] + 1, N);
+  energy_t energy = INTERMOLECULAR_INIT + branch_energy(c, 0, branches);
+  // Loops between intermolecular pairs.
+  int i = outer;
+  while (true) {
+    int ist = i + 1;
+    while (ist < split && p[ist] < split)
+      ist = p[ist] == -1 ? ist + 1 : p[ist] + 1;
+    if (ist == split) break;
+    branches = {p[i]};
+    add_branches(i + 1, ist);
+    branches.push_back(ist);
+    add_branches(p[ist] + 1, p[i]);
+    if (branches.size() == 2)
+      energy += em.TwoLoop(r, i, p[i], ist, p[ist]);
+    else
+      energy += em.MultiloopInitiation(int(branches.size())) + branch_energy(c, 0, branches);
+    i = ist;
+  }
+  // The loop containing the break is the exterior loop of the structure starting at the second
+  // strand.
+  computed_t rotated(c);
+  for (int idx = 0; idx < N; ++idx) {
+    const int orig = (idx + split) % N;
+    rotated.s.r[idx] = r[orig];
+    rotated.s.p[idx] = p[orig] == -1 ? -1 : (p[orig] - split + N) % N;
+    rotated.base_ctds[idx] = c.base_ctds[orig];
+  }
+  branches.clear();
+  for (int idx = 0; idx < N; ++idx) {
+    if (rotated.s.p[idx] == -1) continue;
+    branches.push_back(idx);
+    idx = rotated.s.p[idx];
+  }
+  return energy + branch_energy(rotated, split, branches);
+}
+
+// Finds the minimum free energy of cofolding by trying every structure and every way of forming
+// the CTDs that cofolding allows in the loops with intermolecular pairs, and scoring each with
+// |CofoldEnergy|. Loops closed by intramolecular pairs take their optimal CTDs as in folding.
+class CofoldBruteForcer {
+public:
+  CofoldBruteForcer(const primary_t& a, const primary_t& b, const energy::EnergyModel& em_)
+      : em(em_), NA(int(a.size())), N(int(a.size() + b.size())) {
+    primary_t r(a);
+    r.insert(r.end(), b.begin(), b.end());
+    cofold = {computed_t({r, std::vector<int>(N, -1)}), NA, MAX_E};
+    for (int i = 0; i < NA; ++i)
+      for (int k = NA; k < N; ++k)
+        if (CanPair(r[i], r[k])) pairs.emplace_back(i, k);
+    AddStrandPairs(a, 0);
+    AddStrandPairs(b, NA);
+    // Take pairs in order of increasing st, so a pair can only be taken if nothing in its range is.
+    std::sort(pairs.begin(), pairs.end());
+  }
+
+  energy_t Run() {
+    best = MAX_E;
+    AddAllStructures(0);
+    return best;
+  }
+
+private:
+  // A branch of one of the loops with intermolecular pairs. Its CTD is stored at |idx|, and its
+  // first and last bases in the order of the loop are |left| and |right|. |lu| and |ru| are the
+  // unpaired bases next to it that it can dangle on, or -1. Neighbouring branches can coaxially
+  // stack only if they have the same |group|, which is -1 for branches that can't stack.
+  struct branch_t {
+    int idx, left, right, lu, ru, group;
+  };
+
+  const energy::EnergyModel& em;
+  const int NA, N;
+  cofold_t cofold;
+  std::vector<std::pair<int, int>> pairs;
+  std::vector<branch_t> branches;
+  std::vector<bool> used;
+  energy_t best;
+
+  void AddStrandPairs(const primary_t& s, int offset) {
+    internal::SetGlobalState(s, em);
+    for (int st = 0; st < int(s.size()); ++st)
+      for (int en = st + HAIRPIN_MIN_SZ + 1; en < int(s.size()); ++en)
+        if (internal::ViableFoldingPair(st, en)) pairs.emplace_back(offset + st, offset + en);
+  }
+
+  void AddAllStructures(int idx) {
+    auto& p = cofold.computed.s.p;
+    if (idx == int(pairs.size())) {
+      ScoreStructure();
+      return;
+    }
+    AddAllStructures(idx + 1);
+    const auto& pair = pairs[idx];
+    for (int i = pair.first; i <= pair.second; ++i)
+      if (p[i] != -1) return;
+    p[pair.first] = pair.second;
+    p[pair.second] = pair.first;
+    AddAllStructures(idx + 1);
+    p[pair.first] = -1;
+    p[pair.second] = -1;
+  }
+
+  // Folds bases [|st|, |en|) with their pairs as a structure of their own, with optimal CTDs.
+  computed_t Part(int st, int en) const {
+    const auto& s = cofold.computed.s;
+    std::vector<int> part_p(s.p.begin() + st, s.p.begin() + en);
+    for (auto& pair : part_p)
+      if (pair != -1) pair -= st;
+    return energy::ComputeEnergy({primary_t(s.r.begin() + st, s.r.begin() + en), part_p}, em);
+  }
+
+  // Adds the branches in bases [|st|, |en|) of one strand, which are all unpaired bases or
+  // intramolecular branches of the same loop.
+  void AddBranches(int st, int en, int group) {
+    const auto& p = cofold.computed.s.p;
+    for (int i = st; i < en; ++i) {
+      if (p[i] == -1) continue;
+      branches.push_back({i, i, p[i], Unpaired(i - 1, st, en), Unpaired(p[i] + 1, st, en), group});
+      // The CTD of the branch itself is in this loop, so only the ones inside it are set.
+      const auto part = Part(i, p[i] + 1);
+      std::copy(part.base_ctds.begin() + 1, part.base_ctds.end(),
+          cofold.computed.base_ctds.begin() + i + 1);
+      i = p[i];
+    }
+  }
+
+  int Unpaired(int i, int st, int en) const {
+    return i >= st && i < en && cofold.computed.s.p[i] == -1 ? i : -1;
+  }
+
+  void ScoreStructure() {
+    const auto& p = cofold.computed.s.p;
+    auto& ctds = cofold.computed.base_ctds;
+    ctds.assign(N, CTD_NA);
+    std::vector<int> inter;
+    for (int i = 0; i < NA; ++i)
+      if (p[i] >= NA) inter.push_back(i);
+    if (inter.empty()) {
+      for (int st : {0, NA}) {
+        const int en = st == 0 ? NA : N;
+        const auto part = Part(st, en);
+        std::copy(part.base_ctds.begin(), part.base_ctds.end(), ctds.begin() + st);
+      }
+      best = std::min(best, CofoldEnergy(cofold, em));
+      return;
+    }
+
+    branches.clear();
+    int group = 0;
+    // The exterior loop containing the ends. The pair can dangle, and the branches of the second
+    // strand can coaxially stack with each other.
+    const int outer = inter.front(), outer_en = p[outer];
+    AddBranches(0, outer, -1);
+    branches.push_back({outer, outer, outer_en, Unpaired(outer - 1, 0, outer),
+        Unpaired(outer_en + 1, outer_en + 1, N), -1});
+    AddBranches(outer_en + 1, N, group++);
+    // Loops between intermolecular pairs. Multiloops take no CTDs on the intermolecular pairs,
+    // and branches only stack with others on the same side.
+    for (int idx = 0; idx + 1 < int(inter.size()); ++idx) {
+      const int i = inter[idx], ist = inter[idx + 1];
+      const auto num_branches = branches.size();
+      AddBranches(i + 1, ist, group++);
+      AddBranches(p[ist] + 1, p[i], group++);
+      if (branches.size() == num_branches && ist - i + p[i] - p[ist] - 2 > TWOLOOP_MAX_SZ) return;
+      ctds[p[i]] = CTD_UNUSED;
+      ctds[ist] = CTD_UNUSED;
+    }
+    // The exterior loop containing the break, which goes from the second strand to the first.
+    const int inner = inter.back(), inner_en = p[inner];
+    AddBranches(NA, inner_en, -1);
+    branches.push_back({inner_en, inner_en, inner, Unpaired(inner_en - 1, NA, inner_en),
+        Unpaired(inner + 1, inner + 1, NA), -1});
+    AddBranches(inner + 1, NA, group++);
+    used.assign(N, false);
+    AddAllCtds(0);
+  }
+
+  void AddAllCtds(int idx) {
+    if (idx == int(branches.size())) {
+      best = std::min(best, CofoldEnergy(cofold, em));
+      return;
+    }
+    auto& ctds = cofold.computed.base_ctds;
+    const auto& branch = branches[idx];
+    // Already set by coaxial stacking with the previous branch.
+    if (ctds[branch.idx] != CTD_NA) {
+      AddAllCtds(idx + 1);
+      return;
+    }
+    const auto stacks_with = [&](int other) {
+      return branch.group != -1 && other >= 0 && other < int(branches.size()) &&
+          branches[other].group == branch.group;
+    };
+    const bool lu_usable = branch.lu != -1 && !used[branch.lu];
+    const bool ru_usable = branch.ru != -1 && !used[branch.ru];
+    const auto add = [&](Ctd ctd, bool use_lu, bool use_ru, int other, Ctd other_ctd) {
+      ctds[branch.idx] = ctd;
+      Ctd prev_other_ctd = CTD_NA;
+      if (other != -1) {
+        prev_other_ctd = ctds[branches[other].idx];
+        ctds[branches[other].idx] = other_ctd;
+      }
+      if (use_lu) used[branch.lu] = true;
+      if (use_ru) used[branch.ru] = true;
+      AddAllCtds(idx + 1);
+      if (use_lu) used[branch.lu] = false;
+      if (use_ru) used[branch.ru] = false;
+      if (other != -1) ctds[branches[other].idx] = prev_other_ctd;
+      ctds[branch.idx] = CTD_NA;
+    };
+
+    add(CTD_UNUSED, false, false, -1, CTD_NA);
+    if (ru_usable) add(CTD_3_DANGLE, false, true, -1, CTD_NA);
+    if (lu_usable) add(CTD_5_DANGLE, true, false, -1, CTD_NA);
+    if (lu_usable && ru_usable) add(CTD_MISMATCH, true, true, -1, CTD_NA);
+    if (stacks_with(idx + 1) && branches[idx + 1].left == branch.right + 1)
+      add(CTD_FCOAX_WITH_NEXT, false, false, idx + 1, CTD_FCOAX_WITH_PREV);
+    if (stacks_with(idx + 1) && lu_usable && ru_usable && branches[idx + 1].lu == branch.ru)
+      add(CTD_LCOAX_WITH_NEXT, true, true, idx + 1, CTD_LCOAX_WITH_PREV);
+    if (stacks_with(idx - 1) && lu_usable && ru_usable && branches[idx - 1].ru == branch.lu &&
+        ctds[branches[idx - 1].idx] == CTD_UNUSED)
+      add(CTD_RCOAX_WITH_PREV, true, true, idx - 1, CTD_RCOAX_WITH_NEXT);
+  }
+};
+}
+
+TEST(CofoldTest, NoIntermolecularPairs) {
+  const auto a = parsing::StringToPrimary("GGGAAAUCCCAAAAAA");
+  const auto b = parsing::StringToPrimary("AAAAAAAA");
+  context_options_t options(context_options_t::TableAlg::TWO);
+  const auto cofold = CofoldBatch(a, {b}, g_em, options)[0];
+  ExpectValidCofold(cofold, a, b);
+  EXPECT_EQ(Context(a, g_em, options).Fold().energy + Context(b, g_em, options).Fold().energy,
+      cofold.computed.energy);
+  EXPECT_EQ(cofold.separate_energy, cofold.computed.energy);
+  for (int i = cofold.split; i < int(cofold.computed.s.p.size()); ++i)
+    EXPECT_EQ(-1, cofold.computed.s.p[i]);
+}
+
+TEST(CofoldTest, Duplex) {
+  ONLY_FOR_THIS_MODEL(g_em, T04_MODEL_HASH);
+  const auto a = parsing::StringToPrimary("GGGGG");
+  const auto b = parsing::StringToPrimary("CCCCC");
+  const auto cofold = CofoldBatch(a, {b}, g_em, {})[0];
+  ExpectValidCofold(cofold, a, b);
+  EXPECT_EQ(INTERMOLECULAR_INIT + 4 * g_em->stack[G][G][C][C], cofold.computed.energy);
+  EXPECT_EQ(parsing::DotBracketToPairs("((((()))))"),
+      cofold.computed.s.p);
+}
+
+// The loaded parameters are symmetric under rotating loops, unlike random models.
+TEST(CofoldTest, SymmetricInStrandOrder) {
+  ONLY_FOR_THIS_MODEL(g_em, T04_MODEL_HASH);
+  std::mt19937 eng(0);
+  for (int i = 0; i < 20; ++i) {
+    const auto a = GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 30)(eng), eng);
+    const auto b = GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 30)(eng), eng);
+    EXPECT_EQ(CofoldBatch(a, {b}, g_em, {})[0].computed.energy,
+        CofoldBatch(b, {a}, g_em, {})[0].computed.energy);
+  }
+}
+
+TEST(CofoldTest, TracebackMatchesEnergy) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    for (int i = 0; i < 10; ++i) {
+      const auto a = GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 30)(eng), eng);
+      const auto b = GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 30)(eng), eng);
+      const auto cofold = CofoldBatch(a, {b}, em, {})[0];
+      ExpectValidCofold(cofold, a, b);
+      EXPECT_EQ(cofold.computed.energy, CofoldEnergy(cofold, *em));
+    }
+  }
+}
+
+TEST(CofoldTest, MatchesBruteForce) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    for (int i = 0; i < 100; ++i) {
+      const auto a = GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 10)(eng), eng);
+      const auto b = GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 10)(eng), eng);
+      const auto brute = CofoldBruteForcer(a, b, *em).Run();
+      EXPECT_EQ(brute, CofoldBatch(a, {b}, em, {})[0].computed.energy)
+          << parsing::PrimaryToString(a) << " " << parsing::PrimaryToString(b);
+    }
+  }
+}
+
+TEST(CofoldTest, BatchMatchesSingle) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto a = GenerateRandomPrimary(20, eng);
+    std::vector<primary_t> partners;
+    for (int i = 0; i < 5; ++i)
+      partners.push_back(
+          GenerateRandomPrimary(std::uniform_int_distribution<int>(1, 40)(eng), eng));
+    std::vector<cofold_t> expected;
+    for (const auto& partner : partners)
+      expected.push_back(CofoldBatch(a, {partner}, em, {})[0]);
+    for (auto table_alg : context_options_t::TABLE_ALGS) {
+      const auto cofolds = CofoldBatch(a, partners, em, context_options_t(table_alg));
+      ASSERT_EQ(partners.size(), cofolds.size());
+      for (int i = 0; i < int(partners.size()); ++i) {
+        ExpectValidCofold(cofolds[i], a, partners[i]);
+        EXPECT_EQ(expected[i].computed.energy, cofolds[i].computed.energy);
+        EXPECT_EQ(expected[i].separate_energy, cofolds[i].separate_energy);
+      }
+    }
+  }
+}
+}
+}
@@ -0,0 +1,126 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <random>
+#include "common_test.h"
+#include "fold/brute_fold.h"
+#include "fold/context.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+bool SatisfiesConstraints(const computed_t& computed, const constraints_t& constraints) {
+  const auto& p = computed.s.p;
+  for (const auto& pair : constraints.forced_pairs)
+    if (p[pair.first] != pair.second) return false;
+  for (auto i : constraints.forced_unpaired)
+    if (p[i] != -1) return false;
+  for (const auto& range : constraints.forbidden_ranges)
+    for (int i = range.first; i <= range.second; ++i)
+      if (p[i] != -1) return false;
+  return true;
+}
+
+constraints_t GenerateRandomConstraints(const primary_t& r, std::mt19937& eng) {
+  const int N = int(r.size());
+  constraints_t constraints;
+  std::uniform_int_distribution<int> idx_dist(0, N - 1);
+  int st = -1, en = -1;
+  if (eng() % 2) {
+    st = idx_dist(eng);
+    en = idx_dist(eng);
+    if (st > en) std::swap(st, en);
+    if (en - st - 1 >= HAIRPIN_MIN_SZ && CanPair(r[st], r[en]))
+      constraints.forced_pairs.emplace_back(st, en);
+  }
+  const auto not_forced = [st, en](int i) { return i != st && i != en; };
+  for (int i = 0; i < 2; ++i) {
+    const int idx = idx_dist(eng);
+    if (not_forced(idx)) constraints.forced_unpaired.push_back(idx);
+  }
+  if (eng() % 2) {
+    const int range_st = idx_dist(eng);
+    const int range_en = std::min(N - 1, range_st + int(eng() % 3));
+    if ((st < range_st || st > range_en) && (en < range_st || en > range_en))
+      constraints.forbidden_ranges.emplace_back(range_st, range_en);
+  }
+  return constraints;
+}
+}
+
+TEST(ConstraintsTest, ParseConstraintString) {
+  auto constraints = ParseConstraintString("((x..)).x");
+  EXPECT_EQ((std::vector<std::pair<int, int>>{{1, 5}, {0, 6}}), constraints.forced_pairs);
+  EXPECT_EQ((std::vector<int>{2, 8}), constraints.forced_unpaired);
+  EXPECT_TRUE(constraints.forbidden_ranges.empty());
+  EXPECT_TRUE(ParseConstraintString("....").Empty());
+}
+
+TEST(ConstraintsTest, Precompute) {
+  constraints_t constraints;
+  constraints.forced_pairs = {{2, 9}};
+  constraints.forbidden_ranges = {{5, 6}};
+  const auto cp =
+      internal::PrecomputeConstraints(parsing::StringToPrimary("GGGGAAACCCCA"), constraints);
+  EXPECT_TRUE(cp.CanPair(2, 9));
+  EXPECT_FALSE(cp.CanPair(2, 8));
+  EXPECT_FALSE(cp.CanPair(1, 5));
+  EXPECT_FALSE(cp.CanPair(0, 4));  // Crosses (2, 9).
+  EXPECT_TRUE(cp.CanPair(0, 11));
+  EXPECT_TRUE(cp.CanPair(3, 8));
+  EXPECT_TRUE(cp.CanUnpair(3, 8));
+  EXPECT_FALSE(cp.CanUnpair(0, 2));
+  EXPECT_TRUE(cp.CanUnpair(10, 11));
+  EXPECT_EQ(MAX_E, cp.Unpaired(9));
+  EXPECT_EQ(0, cp.Unpaired(4, 3));
+}
+
+class ConstraintsAlgTest : public testing::TestWithParam<context_options_t::TableAlg> {};
+
+TEST_P(ConstraintsAlgTest, MatchesBruteForce) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    for (int i = 0; i < 30; ++i) {
+      const auto r = GenerateRandomPrimary(16, eng);
+      const auto constraints = GenerateRandomConstraints(r, eng);
+      const auto brute = FoldBruteForce(r, *em, 10, constraints);
+
+      context_options_t options(GetParam(), context_options_t::SuboptimalAlg::ONE);
+      options.constraints = constraints;
+      if (!brute.empty()) {
+        const auto computed = Context(r, em, options).Fold();
+        EXPECT_EQ(brute[0].energy, computed.energy) << parsing::PrimaryToString(r);
+        EXPECT_TRUE(SatisfiesConstraints(computed, constraints));
+      }
+
+      for (auto subopt_alg : context_options_t::SUBOPTIMAL_ALGS) {
+        options.suboptimal_alg = subopt_alg;
+        const auto subopts = Context(r, em, options).SuboptimalIntoVector(true, -1, 10);
+        ASSERT_EQ(brute.size(), subopts.size()) << parsing::PrimaryToString(r);
+        for (int j = 0; j < int(subopts.size()); ++j) {
+          EXPECT_EQ(brute[j].energy, subopts[j].energy) << parsing::PrimaryToString(r);
+          EXPECT_TRUE(SatisfiesConstraints(subopts[j], constraints));
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    ConstraintsAlgTest, ConstraintsAlgTest, testing::ValuesIn(context_options_t::TABLE_ALGS));
+}
+}
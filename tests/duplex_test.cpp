@@ -0,0 +1,95 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <random>
+#include "common_test.h"
+#include "fold/context.h"
+#include "fold/duplex.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+primary_t RandomFrom(const std::vector<base_t>& bases, int length, std::mt19937& eng) {
+  primary_t r(length);
+  for (auto& b : r)
+    b = bases[std::uniform_int_distribution<std::size_t>(0, bases.size() - 1)(eng)];
+  return r;
+}
+
+// Recomputes the energy of a duplex from its pairs.
+energy_t DuplexEnergy(const duplex_t& duplex, const primary_t& probe, const primary_t& target,
+    const energy::EnergyModel& em) {
+  primary_t r = probe;
+  r.insert(r.end(), target.begin(), target.end());
+  const int M = int(probe.size()), N = int(target.size());
+  energy_t energy = INTERMOLECULAR_INIT;
+  for (int i = 0; i + 1 < int(duplex.pairs.size()); ++i) {
+    const auto& outer = duplex.pairs[i];
+    const auto& inner = duplex.pairs[i + 1];
+    EXPECT_LT(outer.first, inner.first);
+    EXPECT_GT(outer.second, inner.second);
+    energy += em.TwoLoop(r, outer.first, M + outer.second, inner.first, M + inner.second);
+  }
+
+  const int oi = duplex.pairs.front().first, oj = M + duplex.pairs.front().second;
+  energy_t outer = 0;
+  if (oi > 0) outer = std::min(outer, em.dangle5[r[oj]][r[oi - 1]][r[oi]]);
+  if (oj + 1 < M + N) outer = std::min(outer, em.dangle3[r[oj]][r[oj + 1]][r[oi]]);
+  if (oi > 0 && oj + 1 < M + N)
+    outer = std::min(outer, em.terminal[r[oj]][r[oj + 1]][r[oi - 1]][r[oi]]);
+  const int ii = duplex.pairs.back().first, ij = M + duplex.pairs.back().second;
+  energy_t inner = 0;
+  if (ii + 1 < M) inner = std::min(inner, em.dangle3[r[ii]][r[ii + 1]][r[ij]]);
+  if (ij > M) inner = std::min(inner, em.dangle5[r[ii]][r[ij - 1]][r[ij]]);
+  if (ii + 1 < M && ij > M)
+    inner = std::min(inner, em.terminal[r[ii]][r[ii + 1]][r[ij - 1]][r[ij]]);
+  return energy + outer + inner + em.AuGuPenalty(r[oi], r[oj]) + em.AuGuPenalty(r[ii], r[ij]);
+}
+}
+
+// Neither strand can fold on its own here, so cofolding can only form a duplex.
+TEST(DuplexTest, MatchesCofold) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto probe = RandomFrom({A, G}, std::uniform_int_distribution<int>(1, 20)(eng), eng);
+    DuplexSearch search(probe, em);
+    for (int i = 0; i < 10; ++i) {
+      const auto target =
+          RandomFrom({C, U}, std::uniform_int_distribution<int>(1, 40)(eng), eng);
+      const auto duplex = search.Best(target);
+      const auto cofold = CofoldBatch(probe, {target}, em, {})[0];
+      EXPECT_EQ(cofold.computed.energy, std::min(energy_t(0), duplex.energy));
+      if (duplex.energy >= CAP_E) {
+        EXPECT_TRUE(duplex.pairs.empty());
+        continue;
+      }
+      ASSERT_FALSE(duplex.pairs.empty());
+      EXPECT_EQ(duplex.energy, DuplexEnergy(duplex, probe, target, *em));
+    }
+  }
+}
+
+TEST(DuplexTest, FindsComplement) {
+  const auto probe = parsing::StringToPrimary("GGACUUCAGG");
+  const auto target = parsing::StringToPrimary("AAAAAACCUGAAGUCCAAAAAA");
+  const auto duplex = DuplexSearch(probe, g_em).Best(target);
+  ASSERT_EQ(10u, duplex.pairs.size());
+  for (int i = 0; i < 10; ++i)
+    EXPECT_EQ(std::make_pair(i, 15 - i), duplex.pairs[i]);
+}
+}
+}
@@ -0,0 +1,79 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include "common_test.h"
+#include "fold/fold_cache.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+const char* CACHE_FILENAME = "fold_cache_test.tmp";
+}
+
+TEST(FoldCacheTest, HitsMissesEvictions) {
+  FoldCache cache(2);
+  const context_options_t options;
+  const auto a = parsing::StringToPrimary("GGGGAAACCCC");
+  const auto b = parsing::StringToPrimary("CCUCCGGG");
+  const auto c = parsing::StringToPrimary("CGGAAACGG");
+
+  EXPECT_EQ(Context(a, g_em, options).Fold(), cache.Fold(a, g_em, options));
+  EXPECT_EQ(Context(a, g_em, options).Fold(), cache.Fold(a, g_em, options));
+  cache.Fold(b, g_em, options);
+  auto stats = cache.Stats();
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_EQ(2u, stats.misses);
+  EXPECT_EQ(0u, stats.evictions);
+  EXPECT_EQ(2u, stats.size);
+
+  // |a| is least recently used, so it gets evicted.
+  cache.Fold(c, g_em, options);
+  computed_t computed;
+  EXPECT_FALSE(cache.Lookup(a, g_em->Checksum(), options, computed));
+  EXPECT_TRUE(cache.Lookup(b, g_em->Checksum(), options, computed));
+  EXPECT_EQ(1u, cache.Stats().evictions);
+
+  // Different models and constraints are different entries.
+  EXPECT_FALSE(cache.Lookup(b, g_em->Checksum() + 1, options, computed));
+  context_options_t constrained;
+  constrained.constraints.forced_unpaired.push_back(0);
+  EXPECT_FALSE(cache.Lookup(b, g_em->Checksum(), constrained, computed));
+}
+
+TEST(FoldCacheTest, SaveLoad) {
+  const context_options_t options;
+  FoldCache cache(10);
+  std::vector<primary_t> rs;
+  for (const auto& s : {"GGGGAAACCCC", "CCUCCGGG", "UGCAAAGCAA", "GCCAAGGCCCCACCCGGA"}) {
+    rs.push_back(parsing::StringToPrimary(s));
+    cache.Fold(rs.back(), g_em, options);
+  }
+  cache.Save(CACHE_FILENAME);
+
+  FoldCache loaded(10);
+  EXPECT_TRUE(loaded.Load(CACHE_FILENAME));
+  EXPECT_EQ(rs.size(), loaded.Stats().size);
+  for (const auto& r : rs) {
+    computed_t computed;
+    EXPECT_TRUE(loaded.Lookup(r, g_em->Checksum(), options, computed));
+    EXPECT_EQ(Context(r, g_em, options).Fold(), computed);
+  }
+  std::remove(CACHE_FILENAME);
+  EXPECT_FALSE(loaded.Load(CACHE_FILENAME));
+}
+}
+}
@@ -13,6 +13,7 @@
 // You should have received a copy of the GNU General Public License along with kekrna.
 // If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
+#include <random>
 #include "common_test.h"
 #include "fold/context.h"
 #include "fold/precomp.h"
@@ -69,6 +70,46 @@ TEST_P(FoldAlgTest, T04) {
   EXPECT_EQ(-208, FoldEnergy("UGGGGAAGUGCCGAUGCGGUACUAUUAUCCACUGUCUAUGGAUAAGUCCCCCGACCU"));
 }
 
+TEST_P(FoldAlgTest, Batch) {
+  std::mt19937 eng(0);
+  std::uniform_int_distribution<int> len_dist(1, 12);
+  for (const auto& em : g_ems) {
+    // Variants of a few suffixes with differing prefixes, so that rows are reused.
+    std::vector<primary_t> rs;
+    for (int suffix = 0; suffix < 3; ++suffix) {
+      const auto shared_r = GenerateRandomPrimary(len_dist(eng), eng);
+      for (int i = 0; i < 10; ++i) {
+        auto r = GenerateRandomPrimary(len_dist(eng), eng);
+        r.insert(r.end(), shared_r.begin(), shared_r.end());
+        rs.push_back(r);
+      }
+      rs.push_back(shared_r);
+    }
+    const auto computeds = FoldBatch(rs, em, fold::context_options_t(GetParam()));
+    ASSERT_EQ(rs.size(), computeds.size());
+    for (int i = 0; i < int(rs.size()); ++i) {
+      const auto computed = Context(rs[i], em, fold::context_options_t(GetParam())).Fold();
+      EXPECT_EQ(computed.energy, computeds[i].energy);
+      EXPECT_EQ(computed.s.r, computeds[i].s.r);
+    }
+  }
+}
+
+TEST_P(FoldAlgTest, Models) {
+  std::mt19937 eng(0);
+  for (int i = 0; i < 10; ++i) {
+    const auto r = GenerateRandomPrimary(20, eng);
+    const auto computeds = FoldModels(r, g_ems, fold::context_options_t(GetParam()));
+    ASSERT_EQ(g_ems.size(), computeds.size());
+    for (int j = 0; j < int(g_ems.size()); ++j) {
+      const auto computed = Context(r, g_ems[j], fold::context_options_t(GetParam())).Fold();
+      EXPECT_EQ(computed.energy, computeds[j].energy);
+      EXPECT_EQ(computed.s.p, computeds[j].s.p);
+      EXPECT_EQ(computed.base_ctds, computeds[j].base_ctds);
+    }
+  }
+}
+
 INSTANTIATE_TEST_CASE_P(
     FoldAlgTest, FoldAlgTest, testing::ValuesIn(fold::context_options_t::TABLE_ALGS));
 
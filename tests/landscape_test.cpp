@@ -0,0 +1,153 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <map>
+#include <random>
+#include "common_test.h"
+#include "fold/context.h"
+#include "fold/landscape.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+
+// Neighbours of |p| by removing or adding one pair, or two stacked pairs, found without hashing.
+std::vector<std::vector<int>> Neighbours(const primary_t& r, const std::vector<int>& p) {
+  const int N = int(r.size());
+  std::vector<std::vector<int>> neighbours;
+  for (int st = 0; st < N; ++st) {
+    for (int en = st + HAIRPIN_MIN_SZ + 1; en < N; ++en) {
+      auto q = p;
+      if (p[st] == en) {
+        q[st] = q[en] = -1;
+        neighbours.push_back(q);
+        if (p[st + 1] == en - 1) {
+          q[st + 1] = q[en - 1] = -1;
+          neighbours.push_back(q);
+        }
+        continue;
+      }
+      if (p[st] != -1 || p[en] != -1 || !CanPair(r[st], r[en])) continue;
+      bool crosses = false;
+      for (int i = st + 1; i < en; ++i)
+        crosses = crosses || (p[i] != -1 && (p[i] < st || p[i] > en));
+      if (crosses) continue;
+      q[st] = en;
+      q[en] = st;
+      neighbours.push_back(q);
+      if (en - st - 3 >= HAIRPIN_MIN_SZ && p[st + 1] == -1 && p[en - 1] == -1 &&
+          CanPair(r[st + 1], r[en - 1])) {
+        q[st + 1] = en - 1;
+        q[en - 1] = st + 1;
+        neighbours.push_back(q);
+      }
+    }
+  }
+  return neighbours;
+}
+
+int FindRoot(std::vector<int>& roots, int i) {
+  while (roots[i] != i)
+    i = roots[i];
+  return i;
+}
+}
+
+TEST(LandscapeTest, OneTreeWithOpenChain) {
+  const auto r = parsing::StringToPrimary("GGGAAAUCCCGCGCAAAGCGCUUAGCGAAAAGCUA");
+  context_options_t options(
+      context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+  options.suboptimal_unique = true;
+  // Enough to include the open chain, but not most of the structures with lonely pairs, so the
+  // helices are only connected by adding or removing them two pairs at a time.
+  LandscapeBuilder builder(r);
+  Context(r, g_em, options).SuboptimalViews(
+      [&builder](const subopt_view_t& view) { builder.Add(view); }, true, 150);
+  int num_roots = 0;
+  for (const auto& minimum : builder.BarrierTree())
+    num_roots += minimum.father == -1;
+  EXPECT_EQ(1, num_roots);
+}
+
+TEST(LandscapeTest, MatchesBruteForce) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    options.suboptimal_unique = true;
+    const auto computeds = Context(r, em, options).SuboptimalIntoVector(true, 80);
+    LandscapeBuilder builder(r);
+    Context(r, em, options).SuboptimalViews(
+        [&builder](const subopt_view_t& view) { builder.Add(view); }, true, 80);
+    ASSERT_EQ(int(computeds.size()), builder.NumStructures());
+
+    // Join each structure to its neighbours before it, tracking the first minimum in each
+    // component of the structures so far.
+    std::map<std::vector<int>, int> idxs;
+    std::vector<int> roots, firsts;
+    std::vector<landscape_minimum_t> expected;
+    for (int i = 0; i < int(computeds.size()); ++i) {
+      const auto& computed = computeds[i];
+      std::map<int, int> components;  // First minimum to root.
+      for (const auto& q : Neighbours(r, computed.s.p)) {
+        const auto iter = idxs.find(q);
+        if (iter == idxs.end()) continue;
+        const int root = FindRoot(roots, iter->second);
+        components[firsts[root]] = root;
+      }
+      idxs[computed.s.p] = i;
+      roots.push_back(i);
+      if (components.empty()) {
+        firsts.push_back(int(expected.size()));
+        expected.push_back(
+            {parsing::PairsToDotBracket(computed.s.p), computed.energy, -1, CAP_E, 0});
+        continue;
+      }
+      const int first = components.begin()->first;
+      firsts.push_back(first);
+      for (const auto& component : components) {
+        roots[component.second] = i;
+        if (component.first == first) continue;
+        expected[component.first].father = first;
+        expected[component.first].saddle = computed.energy;
+      }
+    }
+
+    const auto tree = builder.BarrierTree();
+    ASSERT_EQ(expected.size(), tree.size());
+    int num_structures = 0;
+    for (int i = 0; i < int(tree.size()); ++i) {
+      EXPECT_EQ(expected[i].db, tree[i].db);
+      EXPECT_EQ(expected[i].energy, tree[i].energy);
+      EXPECT_EQ(expected[i].father, tree[i].father);
+      EXPECT_EQ(expected[i].saddle, tree[i].saddle);
+      num_structures += tree[i].basin_size;
+    }
+    EXPECT_EQ(builder.NumStructures(), num_structures);
+
+    // Merging shallow minima keeps every structure in some basin.
+    const auto merged = builder.BarrierTree(20);
+    num_structures = 0;
+    for (const auto& minimum : merged) {
+      EXPECT_TRUE(minimum.father == -1 || minimum.saddle - minimum.energy >= 20);
+      num_structures += minimum.basin_size;
+    }
+    EXPECT_EQ(builder.NumStructures(), num_structures);
+  }
+}
+}
+}
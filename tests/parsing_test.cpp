@@ -12,6 +12,7 @@
 //
 // You should have received a copy of the GNU General Public License along with kekrna.
 // If not, see <http://www.gnu.org/licenses/>.
+#include <sstream>
 #include "parsing.h"
 #include "gtest/gtest.h"
 
@@ -157,5 +158,18 @@ TEST_F(ParsingTest, IsCtdString) {
   EXPECT_FALSE(IsCtdString("(...)"));
   EXPECT_FALSE(IsCtdString("((...))"));
 }
+
+TEST_F(ParsingTest, ParseAlignment) {
+  std::istringstream fasta(">a first\nGG-A\nCU\n>b\nGGCACU\n");
+  auto alignment = ParseAlignment(fasta);
+  EXPECT_EQ(std::vector<std::string>({"a", "b"}), alignment.names);
+  EXPECT_EQ(std::vector<std::string>({"GG-ACU", "GGCACU"}), alignment.rows);
+
+  std::istringstream stockholm(
+      "# STOCKHOLM 1.0\n#=GF ID x\n\na  GG-A\nb  GGCA\n\na  CU\nb  CU\n#=GC SS_cons ..\n//\n");
+  alignment = ParseAlignment(stockholm);
+  EXPECT_EQ(std::vector<std::string>({"a", "b"}), alignment.names);
+  EXPECT_EQ(std::vector<std::string>({"GG-ACU", "GGCACU"}), alignment.rows);
+}
 }
 }
@@ -0,0 +1,82 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cmath>
+#include <map>
+#include <random>
+#include "common_test.h"
+#include "energy/energy.h"
+#include "fold/context.h"
+#include "fold/partition.h"
+
+namespace kekrna {
+namespace fold {
+
+TEST(PartitionTest, MatchesEnumeration) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(18, eng);
+    const int N = int(r.size());
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto computeds = Context(r, em, options).SuboptimalIntoVector(false);
+    const energy_t mfe = Context(r, em, options).Fold().energy;
+    double q = 0.0;
+    std::vector<std::vector<double>> prob(N, std::vector<double>(N, 0.0));
+    for (const auto& computed : computeds) {
+      const double weight = BoltzmannWeight(computed.energy - mfe);
+      q += weight;
+      for (int i = 0; i < N; ++i)
+        if (computed.s.p[i] != -1) prob[i][computed.s.p[i]] += weight;
+    }
+
+    for (int num_threads : {1, 3}) {
+      options.partition_threads = num_threads;
+      const auto part = Context(r, em, options).Partition();
+      EXPECT_EQ(mfe, part.mfe);
+      EXPECT_NEAR(1.0, part.q / q, 1e-9);
+      EXPECT_NEAR(mfe - 10.0 * R * T * log(q), part.ensemble_energy, 1e-6);
+      ASSERT_EQ(N, int(part.prob.size()));
+      for (int i = 0; i < N; ++i)
+        for (int j = 0; j < N; ++j)
+          EXPECT_NEAR(prob[i][j] / q, part.prob[i][j], 1e-9);
+    }
+  }
+}
+
+TEST(PartitionTest, SamplesFromEnsemble) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(18, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto computeds = Context(r, em, options).SuboptimalIntoVector(true);
+    std::map<std::pair<std::vector<int>, std::vector<Ctd>>, int> counts;
+    const int num_samples = 2000;
+    for (const auto& sample : Context(r, em, options).StochasticSample(num_samples, eng)) {
+      EXPECT_EQ(sample.energy, energy::ComputeEnergyWithCtds(sample, *em).energy);
+      ++counts[{sample.s.p, sample.base_ctds}];
+    }
+    // The MFE structure is sampled about as often as its probability says.
+    double q = 0.0;
+    for (const auto& computed : computeds)
+      q += BoltzmannWeight(computed.energy - computeds[0].energy);
+    const double expected = num_samples / q;
+    const double sd = sqrt(expected * (1.0 - 1.0 / q));
+    const int mfe_count = counts[std::make_pair(computeds[0].s.p, computeds[0].base_ctds)];
+    EXPECT_NEAR(expected, mfe_count, 5 * sd + 1);
+  }
+}
+}
+}
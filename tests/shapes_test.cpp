@@ -0,0 +1,81 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <map>
+#include <random>
+#include "common_test.h"
+#include "energy/energy.h"
+#include "fold/context.h"
+#include "fold/shapes.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+TEST(ShapesTest, AbstractShape) {
+  const auto shape = [](const std::string& db, int level) {
+    return AbstractShape(parsing::DotBracketToPairs(db), level);
+  };
+  EXPECT_EQ("", shape("......", 5));
+  EXPECT_EQ("[]", shape("..((((...))))..", 3));
+  EXPECT_EQ("[][]", shape("((...))..((...))", 5));
+  // Bulge.
+  EXPECT_EQ("[]", shape("((.((...))))", 5));
+  EXPECT_EQ("[]", shape("((.((...))))", 4));
+  EXPECT_EQ("[[]]", shape("((.((...))))", 3));
+  // Interior loop.
+  EXPECT_EQ("[]", shape("((.((...)).))", 5));
+  EXPECT_EQ("[[]]", shape("((.((...)).))", 4));
+  EXPECT_EQ("[[]]", shape("((.((...)).))", 3));
+  // Multiloop.
+  EXPECT_EQ("[[][]]", shape("((((...))((...))))", 5));
+  EXPECT_EQ("[[][[]]]", shape("(((...))(.((...)).))", 4));
+}
+
+TEST(ShapesTest, MatchesEnumeration) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto computeds = Context(r, em, options).SuboptimalIntoVector(false, 40);
+    for (int level = MIN_SHAPE_LEVEL; level <= MAX_SHAPE_LEVEL; ++level) {
+      std::map<std::string, energy_t> expected;
+      for (const auto& computed : computeds) {
+        const auto shape = AbstractShape(computed.s.p, level);
+        const auto iter = expected.find(shape);
+        if (iter == expected.end() || computed.energy < iter->second)
+          expected[shape] = computed.energy;
+      }
+
+      const auto reps = Context(r, em, options).SuboptimalShapes(level, 40);
+      ASSERT_EQ(expected.size(), reps.size());
+      for (int i = 0; i < int(reps.size()); ++i) {
+        const auto& rep = reps[i];
+        EXPECT_EQ(expected[rep.shape], rep.computed.energy);
+        EXPECT_EQ(rep.shape, AbstractShape(rep.computed.s.p, level));
+        EXPECT_EQ(rep.computed.energy, energy::ComputeEnergyWithCtds(rep.computed, *em).energy);
+        if (i > 0) {
+          EXPECT_LE(reps[i - 1].computed.energy, rep.computed.energy);
+        }
+      }
+      const auto limited = Context(r, em, options).SuboptimalShapes(level, 40, 2);
+      ASSERT_EQ(std::min<std::size_t>(2, reps.size()), limited.size());
+      for (int i = 0; i < int(limited.size()); ++i)
+        EXPECT_EQ(reps[i].shape, limited[i].shape);
+    }
+  }
+}
+}
+}
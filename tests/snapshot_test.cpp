@@ -0,0 +1,79 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include <random>
+#include "common_test.h"
+#include "fold/context.h"
+#include "fold/globals.h"
+#include "fold/snapshot.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+const char* TABLES_FILENAME = "snapshot_test.tmp";
+}
+
+TEST(SnapshotTest, LoadOnlyMatching) {
+  const auto r = parsing::StringToPrimary("GGGGAAACCCCAUGCGAUAGCUAGC");
+  const auto checksum = g_em->Checksum();
+  remove(TABLES_FILENAME);
+  internal::SetGlobalState(r, *g_em);
+  EXPECT_FALSE(internal::LoadTables(TABLES_FILENAME, checksum, 0));
+  internal::ComputeTables0(int(r.size()));
+  internal::ComputeExterior();
+  internal::SaveTables(TABLES_FILENAME, checksum, 0);
+  const auto energy = internal::gext[0][internal::EXT];
+
+  internal::SetGlobalState(r, *g_em);
+  EXPECT_FALSE(internal::LoadTables(TABLES_FILENAME, checksum + 1, 0));
+  EXPECT_FALSE(internal::LoadTables(TABLES_FILENAME, checksum, 1));
+  EXPECT_TRUE(internal::LoadTables(TABLES_FILENAME, checksum, 0));
+  EXPECT_EQ(energy, internal::gext[0][internal::EXT]);
+
+  auto other_r = r;
+  other_r[3] = other_r[3] == A ? C : A;
+  internal::SetGlobalState(other_r, *g_em);
+  EXPECT_FALSE(internal::LoadTables(TABLES_FILENAME, checksum, 0));
+  internal::SetGlobalState(parsing::StringToPrimary("GGGGAAACCCC"), *g_em);
+  EXPECT_FALSE(internal::LoadTables(TABLES_FILENAME, checksum, 0));
+  constraints_t constraints;
+  constraints.forced_unpaired.push_back(0);
+  internal::SetGlobalState(r, *g_em, constraints);
+  EXPECT_FALSE(internal::LoadTables(TABLES_FILENAME, checksum, 0));
+  remove(TABLES_FILENAME);
+}
+
+TEST(SnapshotTest, ContextReusesTables) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(30, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto expected_computed = Context(r, em, options).Fold();
+    const auto expected_subopt = Context(r, em, options).SuboptimalIntoVector(true, 20);
+
+    remove(TABLES_FILENAME);
+    options.tables_filename = TABLES_FILENAME;
+    // The first fold saves the tables, and later ones load them.
+    EXPECT_EQ(expected_computed, Context(r, em, options).Fold());
+    EXPECT_EQ(expected_computed, Context(r, em, options).Fold());
+    EXPECT_EQ(expected_subopt, Context(r, em, options).SuboptimalIntoVector(true, 20));
+  }
+  remove(TABLES_FILENAME);
+}
+}
+}
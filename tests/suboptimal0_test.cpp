@@ -0,0 +1,70 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <random>
+#include "common_test.h"
+#include "fold/context.h"
+#include "fold/suboptimal0.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+// Structures with the same energy may be reported in any order.
+std::vector<computed_t> SortedByEnergy(std::vector<computed_t> computeds) {
+  std::stable_sort(computeds.begin(), computeds.end(),
+      [](const computed_t& a, const computed_t& b) {
+        return std::tie(a.energy, a.s, a.base_ctds) < std::tie(b.energy, b.s, b.base_ctds);
+      });
+  return computeds;
+}
+}
+
+TEST(Suboptimal0Test, MatchesSuboptimal1) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ZERO);
+    const auto computeds = Context(r, em, options).SuboptimalIntoVector(true, 30);
+    options.suboptimal_alg = context_options_t::SuboptimalAlg::ONE;
+    EXPECT_EQ(SortedByEnergy(Context(r, em, options).SuboptimalIntoVector(true, 30)),
+        SortedByEnergy(computeds));
+  }
+}
+
+TEST(Suboptimal0Test, SpillMatchesUnlimited) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    Context(r, em).Fold();
+    for (int num : {-1, 10}) {
+      std::vector<computed_t> unlimited, spilling;
+      internal::Suboptimal0(30, num).Run(
+          [&unlimited](const computed_t& c) { unlimited.push_back(c); });
+      // Too small for any nodes, so everything except the cheapest nodes is spilled.
+      internal::Suboptimal0(30, num, 1).Run(
+          [&spilling](const computed_t& c) { spilling.push_back(c); });
+      ASSERT_EQ(unlimited.size(), spilling.size());
+      for (int i = 0; i < int(unlimited.size()); ++i)
+        EXPECT_EQ(unlimited[i].energy, spilling[i].energy);
+      if (num == -1) {
+        EXPECT_EQ(SortedByEnergy(unlimited), SortedByEnergy(spilling));
+      }
+    }
+  }
+}
+}
+}
@@ -0,0 +1,417 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <algorithm>
+#include <random>
+#include <set>
+#include "common_test.h"
+#include "energy/energy.h"
+#include "fold/context.h"
+#include "fold/structure_hash.h"
+#include "fold/suboptimal_cursor.h"
+#include "fold/suboptimal1.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+class Suboptimal1ThreadsTest : public testing::TestWithParam<int> {
+public:
+  std::vector<computed_t> Suboptimal(const primary_t& r, const energy::EnergyModelPtr em,
+      int num_threads, bool unordered, bool sorted, energy_t delta, int num) {
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    options.suboptimal_threads = num_threads;
+    options.suboptimal_unordered = unordered;
+    return Context(r, em, options).SuboptimalIntoVector(sorted, delta, num);
+  }
+};
+
+namespace {
+
+std::vector<computed_t> SortedByStructure(std::vector<computed_t> computeds) {
+  std::sort(computeds.begin(), computeds.end(), [](const computed_t& a, const computed_t& b) {
+    if (a.s.p != b.s.p) return a.s.p < b.s.p;
+    return a.base_ctds < b.base_ctds;
+  });
+  return computeds;
+}
+
+std::vector<energy_t> Energies(const std::vector<computed_t>& computeds) {
+  std::vector<energy_t> energies;
+  for (const auto& computed : computeds)
+    energies.push_back(computed.energy);
+  return energies;
+}
+
+bool SatisfiesFilter(const std::vector<int>& p, const suboptimal_filter_t& filter) {
+  for (const auto& pair : filter.must_contain)
+    if (p[pair.first] != pair.second) return false;
+  for (const auto& pair : filter.must_avoid)
+    if (p[pair.first] == pair.second) return false;
+  for (auto i : filter.must_unpaired)
+    if (p[i] != -1) return false;
+  int num_pairs = 0, num_multiloops = 0;
+  for (int st = 0; st < int(p.size()); ++st) {
+    if (p[st] <= st) continue;
+    ++num_pairs;
+    int num_branches = 0;
+    for (int i = st + 1; i < p[st]; ++i) {
+      if (p[i] > i) {
+        ++num_branches;
+        i = p[i];
+      }
+    }
+    if (num_branches >= 2) ++num_multiloops;
+  }
+  return (filter.max_pairs == -1 || num_pairs <= filter.max_pairs) &&
+      (filter.max_multiloops == -1 || num_multiloops <= filter.max_multiloops);
+}
+}
+
+TEST_P(Suboptimal1ThreadsTest, MatchesSerial) {
+  std::mt19937 eng(0);
+  const int num_threads = GetParam();
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    // Unsorted output is reported in the same order as the serial enumeration.
+    const auto serial = Suboptimal(r, em, 1, false, false, 30, -1);
+    EXPECT_EQ(serial, Suboptimal(r, em, num_threads, false, false, 30, -1));
+    const auto expected = SortedByStructure(serial);
+    EXPECT_EQ(expected, SortedByStructure(Suboptimal(r, em, num_threads, true, false, 30, -1)));
+
+    // Sorted output breaks ties in the order of the serial unsorted enumeration. Unordered
+    // output only has to agree on the order of the energies.
+    const auto serial_sorted = Suboptimal(r, em, 1, false, true, 30, -1);
+    const auto energies = Energies(serial_sorted);
+    EXPECT_TRUE(std::is_sorted(energies.begin(), energies.end()));
+    EXPECT_EQ(expected, SortedByStructure(serial_sorted));
+    EXPECT_EQ(serial_sorted, Suboptimal(r, em, num_threads, false, true, 30, -1));
+    const auto unordered_sorted = Suboptimal(r, em, num_threads, true, true, 30, -1);
+    EXPECT_EQ(energies, Energies(unordered_sorted));
+    EXPECT_EQ(expected, SortedByStructure(unordered_sorted));
+
+    // Limited numbers of structures are the lowest energy ones, with the same ties.
+    const int num = std::min(50, int(serial_sorted.size()));
+    EXPECT_EQ(std::vector<computed_t>(serial_sorted.begin(), serial_sorted.begin() + num),
+        Suboptimal(r, em, num_threads, true, true, 30, num));
+    const auto limited = Suboptimal(r, em, 1, false, true, -1, 50);
+    EXPECT_EQ(limited, Suboptimal(r, em, num_threads, false, true, -1, 50));
+    EXPECT_EQ(limited, Suboptimal(r, em, num_threads, true, true, -1, 50));
+  }
+}
+
+TEST(Suboptimal1ShardTest, ShardsPartitionStructures) {
+  std::mt19937 eng(0);
+  const int num_shards = 3;
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto serial = Context(r, em, options).SuboptimalIntoVector(true, 30);
+    std::vector<computed_t> merged;
+    options.suboptimal_num_shards = num_shards;
+    for (int shard = 0; shard < num_shards; ++shard) {
+      options.suboptimal_shard = shard;
+      const auto computeds = Context(r, em, options).SuboptimalIntoVector(true, 30);
+      for (int i = 0; i < int(computeds.size()); ++i) {
+        if (i > 0) {
+          EXPECT_LE(computeds[i - 1].energy, computeds[i].energy);
+        }
+        merged.push_back(computeds[i]);
+      }
+    }
+    EXPECT_EQ(SortedByStructure(serial), SortedByStructure(merged));
+  }
+}
+
+TEST(Suboptimal1CacheTest, PackedExpansions) {
+  using internal::expand_t;
+  using internal::packed_expand_t;
+  const int max_pos = internal::MAX_PACKED_N;
+  for (const auto& exp : {expand_t(0), expand_t(-3, {max_pos, -1, internal::EXT_RCOAX}),
+           expand_t(12, {1, max_pos, internal::DP_U_RCOAX}, {0, 1, internal::DP_P},
+               {max_pos, CTD_FCOAX_WITH_PREV}, {0, CTD_FCOAX_WITH_NEXT})}) {
+    const auto packed = packed_expand_t::Pack(exp);
+    EXPECT_EQ(exp.energy, packed.energy);
+    EXPECT_EQ(exp.to_expand, packed.to_expand());
+    EXPECT_EQ(exp.unexpanded, packed.unexpanded());
+    EXPECT_EQ(exp.to_expand.st != -1, packed.has_to_expand());
+    EXPECT_EQ(exp.unexpanded.st != -1, packed.has_unexpanded());
+    EXPECT_EQ(exp.ctd0.idx, packed.ctd0().idx);
+    EXPECT_EQ(exp.ctd0.ctd, packed.ctd0().ctd);
+    EXPECT_EQ(exp.ctd1.idx, packed.ctd1().idx);
+    EXPECT_EQ(exp.ctd1.ctd, packed.ctd1().ctd);
+  }
+}
+
+TEST(Suboptimal1CacheTest, LimitIncludesTable) {
+  using internal::expand_t;
+  const int N = 60;
+  const std::size_t table_bytes = std::size_t(internal::NumIndexSlots(N)) * sizeof(uint32_t);
+  internal::ExpansionCache unlimited;
+  unlimited.Reset(N);
+  EXPECT_LE(table_bytes, unlimited.Bytes());
+
+  const std::size_t max_bytes = table_bytes + 4096;
+  internal::ExpansionCache limited(max_bytes);
+  limited.Reset(N);
+  const std::vector<expand_t> exps(5, expand_t(0));
+  for (int st = 0; st < N; ++st) {
+    for (int en = st; en < N; ++en) {
+      limited.Insert({st, en, internal::DP_P}, exps);
+      EXPECT_LE(limited.Bytes(), max_bytes);
+    }
+  }
+}
+
+TEST(Suboptimal1CacheTest, EvictionMatchesUnlimited) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    Context(r, em).Fold();
+    for (bool sorted : {false, true}) {
+      std::vector<computed_t> unlimited, evicting;
+      internal::Suboptimal1(30, -1).Run(
+          [&unlimited](const computed_t& c) { unlimited.push_back(c); }, sorted);
+      // Too small for any expansions, so every lookup which misses evicts everything.
+      internal::Suboptimal1(30, -1, 1, true, 0, 1, 1).Run(
+          [&evicting](const computed_t& c) { evicting.push_back(c); }, sorted);
+      EXPECT_EQ(unlimited, evicting);
+    }
+  }
+}
+
+TEST(Suboptimal1CountTest, MatchesEnumeration) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    for (energy_t delta : {0, 5, 30}) {
+      context_options_t options(
+          context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+      std::map<energy_t, double> expected;
+      for (const auto& computed : Context(r, em, options).SuboptimalIntoVector(false, delta))
+        expected[computed.energy] += 1.0;
+      EXPECT_EQ(expected, Context(r, em, options).SuboptimalHistogram(delta));
+
+      // Only structures which satisfy the constraints are counted.
+      options.constraints = fold::ParseConstraintString(std::string(r.size(), 'x'));
+      EXPECT_EQ(1u, Context(r, em, options).SuboptimalHistogram(delta).size());
+    }
+  }
+}
+
+TEST(Suboptimal1ViewTest, MatchesComputed) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    for (auto alg : context_options_t::SUBOPTIMAL_ALGS) {
+      for (bool sorted : {false, true}) {
+        context_options_t options(context_options_t::TableAlg::TWO, alg);
+        const auto expected = Context(r, em, options).SuboptimalIntoVector(sorted, 20);
+        std::vector<computed_t> computeds;
+        Context(r, em, options).SuboptimalViews(
+            [&computeds](const subopt_view_t& view) {
+              const secondary_t s({view.r.begin(), view.r.end()}, {view.p.begin(), view.p.end()});
+              computeds.push_back({s, {view.base_ctds.begin(), view.base_ctds.end()}, view.energy});
+              EXPECT_EQ(parsing::PairsToDotBracket(computeds.back().s.p), view.db.Data());
+            },
+            sorted, 20);
+        EXPECT_EQ(expected, computeds);
+
+        const auto results = Context(r, em, options).SuboptimalIntoResults(sorted, 20);
+        ASSERT_EQ(int(expected.size()), results.Size());
+        for (int i = 0; i < results.Size(); ++i)
+          EXPECT_EQ(expected[i], results.Computed(i));
+      }
+    }
+  }
+}
+
+TEST(Suboptimal1HashTest, MatchesStructureHash) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    std::set<uint64_t> hashes;
+    const auto check_hash = [&hashes](const subopt_view_t& view) {
+      EXPECT_EQ(StructureHash(view.p, view.base_ctds), view.hash);
+      hashes.insert(view.hash);
+    };
+    const int num = Context(r, em, options).SuboptimalViews(check_hash, false, 30);
+    // Distinct structures should not collide.
+    EXPECT_EQ(num, int(hashes.size()));
+    Context(r, em, options).SuboptimalViews(check_hash, true, 30);
+    options.suboptimal_threads = 2;
+    Context(r, em, options).SuboptimalViews(check_hash, true, 30);
+    options.suboptimal_threads = 1;
+    options.suboptimal_unique = true;
+    Context(r, em, options).SuboptimalViews(check_hash, false, 30);
+    Context(r, em, options).SuboptimalViews(check_hash, true, 30);
+    options.suboptimal_unique = false;
+    Context ctx(r, em, options);
+    auto cursor = ctx.OpenSuboptimalCursor(30);
+    for (int i = 0; i < 20 && cursor->Next(check_hash); ++i) {}
+    cursor = ctx.OpenSuboptimalCursor(30, cursor->Position());
+    ASSERT_TRUE(cursor != nullptr);
+    while (cursor->Next(check_hash)) {}
+  }
+}
+
+TEST(Suboptimal1UniqueTest, MatchesBestCtds) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    std::map<std::vector<int>, energy_t> best;
+    for (const auto& computed : Context(r, em, options).SuboptimalIntoVector(false, 30)) {
+      auto iter = best.find(computed.s.p);
+      if (iter == best.end() || computed.energy < iter->second)
+        best[computed.s.p] = computed.energy;
+    }
+
+    options.suboptimal_unique = true;
+    const auto unique = Context(r, em, options).SuboptimalIntoVector(false, 30);
+    ASSERT_EQ(best.size(), unique.size());
+    std::set<std::vector<int>> seen;
+    for (const auto& computed : unique) {
+      EXPECT_TRUE(seen.insert(computed.s.p).second);
+      EXPECT_EQ(best[computed.s.p], computed.energy);
+      EXPECT_EQ(computed.energy, energy::ComputeEnergyWithCtds(computed, *em).energy);
+    }
+
+    // Sorted output and structure limits go through each energy in turn.
+    std::vector<energy_t> energies;
+    for (const auto& pair_energy : best)
+      energies.push_back(pair_energy.second);
+    std::sort(energies.begin(), energies.end());
+    std::vector<energy_t> sorted_energies;
+    for (const auto& computed : Context(r, em, options).SuboptimalIntoVector(true, 30))
+      sorted_energies.push_back(computed.energy);
+    EXPECT_EQ(energies, sorted_energies);
+    const auto limited = Context(r, em, options).SuboptimalIntoVector(false, 30, 10);
+    ASSERT_EQ(std::min<std::size_t>(10, energies.size()), limited.size());
+    for (int i = 0; i < int(limited.size()); ++i)
+      EXPECT_EQ(energies[i], limited[i].energy);
+  }
+}
+
+TEST(Suboptimal1FilterTest, MatchesFilteredEnumeration) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto all = Context(r, em, options).SuboptimalIntoVector(false, 30);
+    ASSERT_FALSE(all.empty());
+
+    // Take the predicates from the enumerated structures, so some but not all satisfy them.
+    std::vector<suboptimal_filter_t> filters(5);
+    const auto& some = all[eng() % all.size()].s.p;
+    int num_pairs = 0;
+    for (int i = 0; i < int(r.size()); ++i) {
+      if (some[i] > i) {
+        if (num_pairs++ == 0) filters[0].must_contain.emplace_back(i, some[i]);
+        filters[1].must_avoid.emplace_back(i, some[i]);
+      }
+      if (some[i] == -1 && filters[1].must_unpaired.size() < 3u)
+        filters[1].must_unpaired.push_back(i);
+    }
+    filters[2].max_pairs = num_pairs / 2;
+    filters[3].max_multiloops = 0;
+    filters[4] = filters[0];
+    filters[4].max_pairs = filters[2].max_pairs + 2;
+
+    for (const auto& filter : filters) {
+      std::vector<computed_t> expected;
+      for (const auto& computed : all)
+        if (SatisfiesFilter(computed.s.p, filter)) expected.push_back(computed);
+      options.suboptimal_filter = filter;
+      options.suboptimal_threads = 1;
+      // Pruning doesn't change the order the other structures are found in.
+      EXPECT_EQ(expected, Context(r, em, options).SuboptimalIntoVector(false, 30));
+      const auto sorted = Context(r, em, options).SuboptimalIntoVector(true, 30);
+      const auto energies = Energies(sorted);
+      EXPECT_TRUE(std::is_sorted(energies.begin(), energies.end()));
+      EXPECT_EQ(SortedByStructure(expected), SortedByStructure(sorted));
+      options.suboptimal_threads = 2;
+      EXPECT_EQ(expected, Context(r, em, options).SuboptimalIntoVector(false, 30));
+      options.suboptimal_threads = 1;
+
+      if (filter.max_pairs != -1 || filter.max_multiloops != -1) continue;
+      std::map<energy_t, double> histogram;
+      for (const auto& computed : expected)
+        histogram[computed.energy] += 1.0;
+      EXPECT_EQ(histogram, Context(r, em, options).SuboptimalHistogram(30));
+      options.suboptimal_unique = true;
+      std::set<std::vector<int>> structures;
+      for (const auto& computed : expected)
+        structures.insert(computed.s.p);
+      std::set<std::vector<int>> unique;
+      for (const auto& computed : Context(r, em, options).SuboptimalIntoVector(false, 30))
+        unique.insert(computed.s.p);
+      EXPECT_EQ(structures, unique);
+      options.suboptimal_unique = false;
+    }
+  }
+}
+
+TEST(Suboptimal1AnytimeTest, CoversReportedLevels) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(60, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto all = Context(r, em, options).SuboptimalIntoVector(true, 30);
+    const energy_t mfe = all[0].energy;
+    std::vector<suboptimal_budget_t> budgets(4);
+    budgets[1].num_structures = int(all.size()) / 3;
+    budgets[2].memory_bytes = 1;
+    budgets[3].time_ms = 1000000;
+    for (int num_threads : {1, 2}) {
+      options.suboptimal_threads = num_threads;
+      for (const auto& budget : budgets) {
+        std::vector<energy_t> energies;
+        const auto res = Context(r, em, options).SuboptimalAnytime(
+            [&energies](const subopt_view_t& view) { energies.push_back(view.energy); }, budget,
+            30);
+        ASSERT_EQ(res.num_structures, int(energies.size()));
+        EXPECT_TRUE(std::is_sorted(energies.begin(), energies.end()));
+        if (budget.num_structures != 0 || budget.memory_bytes != 0) {
+          EXPECT_FALSE(res.complete);
+        } else {
+          EXPECT_TRUE(res.complete);
+          EXPECT_EQ(mfe + 30, res.covered_energy);
+          EXPECT_EQ(Energies(all), energies);
+        }
+        // Every structure up to the covered energy was reported.
+        const int num_covered = int(std::count_if(all.begin(), all.end(),
+            [&res](const computed_t& c) { return c.energy <= res.covered_energy; }));
+        ASSERT_LE(num_covered, res.num_structures);
+        for (int i = 0; i < num_covered; ++i)
+          EXPECT_EQ(all[i].energy, energies[i]);
+        if (budget.num_structures != 0) {
+          EXPECT_EQ(budget.num_structures, res.num_structures);
+          EXPECT_LT(res.covered_energy, all[budget.num_structures].energy);
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(Suboptimal1ThreadsTest, Suboptimal1ThreadsTest, testing::Values(2, 4));
+}
+}
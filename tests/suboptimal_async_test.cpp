@@ -0,0 +1,57 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <random>
+#include "common_test.h"
+#include "fold/context.h"
+#include "fold/suboptimal_async.h"
+#include "parsing.h"
+
+namespace kekrna {
+namespace fold {
+
+TEST(SuboptimalAsyncTest, MatchesSynchronous) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    const auto expected = Context(r, em, options).SuboptimalIntoVector(true, 30);
+    // Small capacities make both sides wait on each other.
+    for (int capacity : {1, 2, 4096}) {
+      std::vector<computed_t> computeds;
+      std::vector<std::string> dbs;
+      {
+        AsyncSuboptimalCallback async(
+            [&computeds, &dbs](const subopt_view_t& view) {
+              computeds.emplace_back(
+                  secondary_t(primary_t(view.r.begin(), view.r.end()),
+                      std::vector<int>(view.p.begin(), view.p.end())),
+                  std::vector<Ctd>(view.base_ctds.begin(), view.base_ctds.end()), view.energy);
+              dbs.emplace_back(view.db.Data());
+            },
+            r, capacity);
+        Context(r, em, options).SuboptimalViews(
+            [&async](const subopt_view_t& view) { async.Push(view); }, true, 30);
+        async.Finish();
+      }
+      EXPECT_EQ(expected, computeds);
+      ASSERT_EQ(expected.size(), dbs.size());
+      for (std::size_t i = 0; i < dbs.size(); ++i)
+        EXPECT_EQ(parsing::PairsToDotBracket(expected[i].s.p), dbs[i]);
+    }
+  }
+}
+}
+}
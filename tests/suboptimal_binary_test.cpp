@@ -0,0 +1,61 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <cstdio>
+#include <random>
+#include "common_test.h"
+#include "fold/context.h"
+#include "fold/suboptimal_binary.h"
+
+namespace kekrna {
+namespace fold {
+
+namespace {
+const char* BINARY_FILENAME = "suboptimal_binary_test.tmp";
+}
+
+TEST(SuboptimalBinaryTest, RoundTrip) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    context_options_t options(
+        context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+    for (bool sorted : {false, true}) {
+      const auto expected = Context(r, em, options).SuboptimalIntoVector(sorted, 30);
+      FILE* fp = fopen(BINARY_FILENAME, "wb");
+      ASSERT_NE(nullptr, fp);
+      {
+        SuboptimalBinaryWriter writer(fp, r);
+        Context(r, em, options).SuboptimalViews(
+            [&writer](const subopt_view_t& view) { writer.Write(view); }, sorted, 30);
+      }
+      fclose(fp);
+
+      fp = fopen(BINARY_FILENAME, "rb");
+      ASSERT_NE(nullptr, fp);
+      std::vector<computed_t> computeds;
+      {
+        SuboptimalBinaryReader reader(fp);
+        EXPECT_EQ(r, reader.Primary());
+        while (reader.Next())
+          computeds.push_back(reader.Current());
+      }
+      fclose(fp);
+      EXPECT_EQ(expected, computeds);
+    }
+  }
+  std::remove(BINARY_FILENAME);
+}
+}
+}
@@ -0,0 +1,60 @@
+// Copyright 2016, Eliot Courtney.
+//
+// This file is part of kekrna.
+//
+// kekrna is free software: you can redistribute it and/or modify it under the terms of the
+// GNU General Public License as published by the Free Software Foundation, either version 3 of
+// the License, or (at your option) any later version.
+//
+// kekrna is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even
+// the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with kekrna.
+// If not, see <http://www.gnu.org/licenses/>.
+#include <random>
+#include "common_test.h"
+#include "fold/context.h"
+
+namespace kekrna {
+namespace fold {
+
+TEST(SuboptimalCursorTest, ResumesWhereItStopped) {
+  std::mt19937 eng(0);
+  for (const auto& em : g_ems) {
+    const auto r = GenerateRandomPrimary(40, eng);
+    for (int cache_mb : {0, 1}) {
+      context_options_t options(
+          context_options_t::TableAlg::TWO, context_options_t::SuboptimalAlg::ONE);
+      options.suboptimal_cache_mb = cache_mb;
+      const auto expected = Context(r, em, options).SuboptimalIntoVector(false, 30);
+
+      // Read a page at a time, each from a new cursor resumed from the last position.
+      std::vector<computed_t> computeds;
+      std::string position;
+      for (bool done = false; !done;) {
+        auto cursor = Context(r, em, options).OpenSuboptimalCursor(30, position);
+        ASSERT_TRUE(cursor != nullptr);
+        EXPECT_EQ(int(computeds.size()), cursor->NumReported());
+        computed_t computed;
+        for (int i = 0; i < 37 && !done; ++i) {
+          done = !cursor->Next(computed);
+          if (!done) computeds.push_back(computed);
+        }
+        position = cursor->Position();
+      }
+      EXPECT_EQ(expected, computeds);
+      // A finished cursor stays finished.
+      computed_t computed;
+      EXPECT_FALSE(Context(r, em, options).OpenSuboptimalCursor(30, position)->Next(computed));
+
+      // Positions are only valid for the same fold.
+      EXPECT_TRUE(Context(r, em, options).OpenSuboptimalCursor(20, position) == nullptr);
+      options.suboptimal_filter.max_pairs = 5;
+      EXPECT_TRUE(Context(r, em, options).OpenSuboptimalCursor(30, position) == nullptr);
+      EXPECT_TRUE(Context(r, em, options).OpenSuboptimalCursor(30, "kekcursor1 1 2") == nullptr);
+    }
+  }
+}
+}
+}